@@ -0,0 +1,262 @@
+// Copyright (c) 2016 Giorgio Marcias
+//
+// This source code is subject to the simplified BSD license.
+//
+// Author: Giorgio Marcias
+// email: marcias.giorgio@gmail.com
+
+#include <MPMCThreadPool/MPMCThreadPool.hpp>
+#include <algorithm>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+/**
+ *   @brief Returns the seconds elapsed since start.
+ */
+double secondsSince(const Clock::time_point start)
+{
+	return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+/**
+ *   @brief Busy-wait until counter reaches n.
+ */
+void waitFor(const std::atomic_size_t &counter, const std::size_t n)
+{
+	while (counter.load(std::memory_order_acquire) < n)
+		std::this_thread::yield();
+}
+
+/**
+ *   @brief Print a result row.
+ */
+void report(const std::string &name, const std::size_t nThreads, const bool token, const std::string &value)
+{
+	std::cout << std::left << std::setw(38) << name
+	          << std::right << std::setw(8) << nThreads
+	          << std::setw(8) << (token ? "yes" : "no")
+	          << "  " << value << std::endl;
+}
+
+/**
+ *   @brief Format a rate of operations per second.
+ */
+std::string rate(const std::size_t n, const double seconds)
+{
+	std::ostringstream out;
+	out << std::fixed << std::setprecision(2) << (n / seconds / 1e6) << " Mops/s";
+	return out.str();
+}
+
+/**
+ *   @brief Format percentiles (in nanoseconds) of a set of samples.
+ */
+std::string percentiles(std::vector<double> samples)
+{
+	std::sort(samples.begin(), samples.end());
+	const double p[] = { 0.5, 0.9, 0.99, 0.999 };
+	const char *names[] = { "p50", "p90", "p99", "p99.9" };
+	std::ostringstream out;
+	out << std::fixed << std::setprecision(0);
+	for (std::size_t i = 0; i < 4; ++i)
+		out << names[i] << "=" << samples[std::min(samples.size() - 1, std::size_t(p[i] * samples.size()))] << "ns ";
+	out << "max=" << samples.back() << "ns";
+	return out.str();
+}
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// BENCHMARKS
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ *   @brief Throughput of submitting empty tasks one by one and running them.
+ */
+void emptyTasks(mpmc_tp::MPMCThreadPool &pool, const std::size_t n, const bool useToken)
+{
+	std::atomic_size_t done(0);
+	mpmc_tp::ProducerToken token = pool.newProducerToken();
+	Clock::time_point start = Clock::now();
+	for (std::size_t i = 0; i < n; ++i) {
+		mpmc_tp::Task task([&done](){ done.fetch_add(1, std::memory_order_release); });
+		if (useToken)
+			pool.submitTask(token, std::move(task));
+		else
+			pool.submitTask(std::move(task));
+	}
+	waitFor(done, n);
+	report("empty tasks (single submit)", pool.size(), useToken, rate(n, secondsSince(start)));
+}
+
+/**
+ *   @brief Throughput of submitting empty tasks in bulk and running them,
+ *          with the threads dequeuing up to maxBatchSize tasks at once.
+ */
+void bulkTasks(mpmc_tp::MPMCThreadPool &pool, const std::size_t n, const bool useToken, const std::size_t maxBatchSize)
+{
+	std::atomic_size_t done(0);
+	pool.setMaxBatchSize(maxBatchSize);
+	mpmc_tp::ProducerToken token = pool.newProducerToken();
+	std::vector<mpmc_tp::Task> tasks;
+	tasks.reserve(n);
+	for (std::size_t i = 0; i < n; ++i)
+		tasks.emplace_back([&done](){ done.fetch_add(1, std::memory_order_release); });
+	Clock::time_point start = Clock::now();
+	if (useToken)
+		pool.submitTasks(token, std::make_move_iterator(tasks.begin()), std::make_move_iterator(tasks.end()));
+	else
+		pool.submitTasks(std::make_move_iterator(tasks.begin()), std::make_move_iterator(tasks.end()));
+	waitFor(done, n);
+	const double seconds = secondsSince(start);
+	pool.setMaxBatchSize(mpmc_tp::MPMCThreadPool::DEFAULT_MAX_BATCH_SIZE());
+	report("empty tasks (bulk submit, batch " + std::to_string(maxBatchSize) + ")", pool.size(), useToken, rate(n, seconds));
+}
+
+/**
+ *   @brief Percentiles of the cost of a submit call and of the delay between
+ *          the submission of a task and the start of its execution.
+ */
+void submitLatency(mpmc_tp::MPMCThreadPool &pool, const std::size_t n, const bool useToken)
+{
+	std::atomic_size_t done(0);
+	mpmc_tp::ProducerToken token = pool.newProducerToken();
+	std::vector<double> submitTimes(n);
+	std::vector<double> startDelays(n);
+	for (std::size_t i = 0; i < n; ++i) {
+		Clock::time_point submitted = Clock::now();
+		double *delay = &startDelays[i];
+		mpmc_tp::Task task([&done, submitted, delay](){
+			*delay = std::chrono::duration<double, std::nano>(Clock::now() - submitted).count();
+			done.fetch_add(1, std::memory_order_release);
+		});
+		if (useToken)
+			pool.submitTask(token, std::move(task));
+		else
+			pool.submitTask(std::move(task));
+		submitTimes[i] = std::chrono::duration<double, std::nano>(Clock::now() - submitted).count();
+		// let the pool go idle from time to time, to include wake-ups
+		if (i % 64 == 63)
+			waitFor(done, i + 1);
+	}
+	waitFor(done, n);
+	report("submit call", pool.size(), useToken, percentiles(submitTimes));
+	report("submit to start", pool.size(), useToken, percentiles(startDelays));
+}
+
+/**
+ *   @brief Cost of submitting a pack of empty tasks and waiting for it.
+ */
+template < class Traits >
+void taskPackWait(mpmc_tp::MPMCThreadPool &pool, const std::size_t nPacks, const std::size_t packSize, const std::string &name)
+{
+	mpmc_tp::ProducerToken token = pool.newProducerToken();
+	std::vector<double> times(nPacks);
+	for (std::size_t p = 0; p < nPacks; ++p) {
+		mpmc_tp::TaskPack<std::size_t, Traits> pack(packSize);
+		for (std::size_t i = 0; i < pack.size(); ++i)
+			pack.setTaskAt(i, [](const std::size_t i){ return i; }, i);
+		Clock::time_point start = Clock::now();
+		pool.submitTasks(token, pack.moveBegin(), pack.moveEnd());
+		pack.wait();
+		times[p] = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+	}
+	report(name, pool.size(), true, percentiles(times));
+}
+
+/**
+ *   @brief A task spawning many children from inside the pool, joined by the
+ *          last of them.
+ */
+void fanOutFanIn(mpmc_tp::MPMCThreadPool &pool, const std::size_t nRounds, const std::size_t width)
+{
+	std::atomic_size_t rounds(0);
+	Clock::time_point start = Clock::now();
+	for (std::size_t r = 0; r < nRounds; ++r) {
+		std::shared_ptr<std::atomic_size_t> remaining = std::make_shared<std::atomic_size_t>(width);
+		pool.submitTask([&pool, &rounds, remaining, width](){
+			for (std::size_t i = 0; i < width; ++i)
+				pool.submitTask([&rounds, remaining](){
+					if (remaining->fetch_sub(1, std::memory_order_acq_rel) == 1)
+						rounds.fetch_add(1, std::memory_order_release);
+				});
+		});
+		waitFor(rounds, r + 1);
+	}
+	report("fan-out/fan-in (x" + std::to_string(width) + ")", pool.size(), false, rate(nRounds * (width + 1), secondsSince(start)));
+}
+
+/**
+ *   @brief Spawn a binary tree of tasks of the given depth.
+ */
+void spawnTree(mpmc_tp::MPMCThreadPool &pool, std::atomic_size_t &leaves, const std::size_t depth)
+{
+	if (depth == 0) {
+		leaves.fetch_add(1, std::memory_order_release);
+		return;
+	}
+	for (std::size_t i = 0; i < 2; ++i)
+		pool.submitTask([&pool, &leaves, depth](){ spawnTree(pool, leaves, depth - 1); });
+}
+
+/**
+ *   @brief Throughput of recursively spawned tasks.
+ */
+void recursiveSpawn(mpmc_tp::MPMCThreadPool &pool, const std::size_t depth, const bool workStealing)
+{
+	std::atomic_size_t leaves(0);
+	pool.setWorkStealing(workStealing);
+	Clock::time_point start = Clock::now();
+	pool.submitTask([&pool, &leaves, depth](){ spawnTree(pool, leaves, depth); });
+	waitFor(leaves, std::size_t(1) << depth);
+	const double seconds = secondsSince(start);
+	pool.setWorkStealing(false);
+	report(std::string("recursive spawn") + (workStealing ? " (stealing)" : ""), pool.size(), false, rate((std::size_t(2) << depth) - 1, seconds));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+
+int main(int argc, char *argv[])
+{
+	// usage: MPMCThreadPool_benchmarks [scale] [thread counts...]
+	const std::size_t scale = argc > 1 ? std::max(std::atoi(argv[1]), 1) : 1;
+	std::vector<std::size_t> threadCounts;
+	for (int i = 2; i < argc; ++i)
+		threadCounts.push_back(std::max(std::atoi(argv[i]), 1));
+	if (threadCounts.empty()) {
+		const std::size_t hw = mpmc_tp::MPMCThreadPool::DEFAULT_SIZE();
+		for (std::size_t n = 1; n < hw; n *= 2)
+			threadCounts.push_back(n);
+		threadCounts.push_back(hw);
+	}
+
+	const std::size_t nTasks = 1000000 * scale;
+	const std::size_t nSamples = 100000 * scale;
+
+	std::cout << std::left << std::setw(38) << "benchmark"
+	          << std::right << std::setw(8) << "threads"
+	          << std::setw(8) << "token" << "  result" << std::endl;
+	for (std::size_t t = 0; t < threadCounts.size(); ++t) {
+		mpmc_tp::MPMCThreadPool pool(threadCounts[t]);
+		for (int useToken = 0; useToken < 2; ++useToken) {
+			emptyTasks(pool, nTasks, useToken != 0);
+			bulkTasks(pool, nTasks, useToken != 0, 1);
+			bulkTasks(pool, nTasks, useToken != 0, mpmc_tp::MPMCThreadPool::DEFAULT_MAX_BATCH_SIZE());
+			submitLatency(pool, nSamples, useToken != 0);
+		}
+		taskPackWait<mpmc_tp::TaskPackTraitsLockFree>(pool, 1000 * scale, 64, "TaskPack wait (LockFree, x64)");
+		taskPackWait<mpmc_tp::TaskPackTraitsBlocking>(pool, 1000 * scale, 64, "TaskPack wait (Blocking, x64)");
+		fanOutFanIn(pool, 1000 * scale, 256);
+		recursiveSpawn(pool, 16 + scale / 2, false);
+		recursiveSpawn(pool, 16 + scale / 2, true);
+	}
+}
@@ -6,6 +6,7 @@
 // email: marcias.giorgio@gmail.com
 
 #include <MPMCThreadPool/MPMCThreadPool.hpp>
+#include <MPMCThreadPool/ParallelAlgorithms.hpp>
 #include <iostream>
 #include <sstream>
 #include <iomanip>
@@ -146,5 +147,17 @@ int main(int argc, char *argv[])
 	std::cout << "done" << std::endl;
 	std::cout << "No deadlocks." << std::endl;
 
+
+
+	std::cout << "Parallel algorithms:" << std::endl;
+	std::vector<std::size_t> values(1000000);
+	mpmc_tp::parallelFor(threadPool, std::size_t(0), values.size(), 0, [&values](const std::size_t i){
+		values[i] = i;
+	});
+	std::size_t total = mpmc_tp::parallelReduce(threadPool, values.begin(), values.end(), 0, std::size_t(0), [](std::vector<std::size_t>::const_iterator it){
+		return *it;
+	}, std::plus<std::size_t>());
+	std::cout << "Sum of the first " << values.size() << " numbers: " << total << std::endl;
+
 	std::cout << "End" << std::endl;
 }
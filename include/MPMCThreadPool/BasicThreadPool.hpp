@@ -0,0 +1,227 @@
+// Copyright (c) 2016 Giorgio Marcias
+//
+// This source code is subject to the simplified BSD license.
+//
+// Author: Giorgio Marcias
+// email: marcias.giorgio@gmail.com
+
+#ifndef BasicThreadPool_hpp
+#define BasicThreadPool_hpp
+
+#include <MPMCThreadPool/MPMCThreadPool.hpp>
+
+namespace mpmc_tp {
+
+	////////////////////////////////////////////////////////////////////////////
+	// BASIC THREAD POOL
+	////////////////////////////////////////////////////////////////////////////
+
+	/// The BasicThreadPool class represents a pool of a fixed number of threads
+	/// running tasks of the static type T, chosen at compile time together
+	/// with the Policy (see DefaultPoolPolicy): the queue type, what idle
+	/// threads do, whether they count the tasks they run and how they run
+	/// them. Tasks are stored in the queue as they are, e.g. a plain job
+	/// descriptor with a function pointer, so that submitting and running them
+	/// involves no type erasure, no allocation and no indirect call but the
+	/// ones of T itself.
+	/// It is the lean counterpart of MPMCThreadPool, which is the
+	/// specialization for the type-erased Task and DefaultPoolPolicy: there
+	/// are no futures, priorities, work stealing, resizing or timers.
+	/// Any pending tasks are not processed but deleted by the destructor.
+	///
+	/// @code
+	/// struct Job {
+	///     void (*function)(Job &);
+	///     float *data;
+	///     std::size_t size;
+	/// };
+	///
+	/// struct JobPolicy : DefaultPoolPolicy {
+	///     static constexpr IdlePolicy IDLE_POLICY = IdlePolicy::SpinThenPark;
+	///     static constexpr bool STATS = false;
+	///     static void run(Job &job) { job.function(job); }
+	/// };
+	///
+	/// BasicThreadPool<Job, JobPolicy> pool;
+	/// pool.submitTask(Job{&process, data, size});
+	/// @endcode
+	template < class T, class Policy >
+	class BasicThreadPool {
+	public:
+		/// The type of the tasks.
+		using TaskType = T;
+
+		/// The policy.
+		using PolicyType = Policy;
+
+		/// The type of the queue of the tasks.
+		using QueueType = typename Policy::template Queue<T>;
+
+		////////////////////////////////////////////////////////////////////////
+		// STATIC METHODS
+		////////////////////////////////////////////////////////////////////////
+
+		/**
+		 *   @brief Return the static default size of the pool, given by
+		 *          std::thread::hardware_concurrency();
+		 */
+		static inline std::size_t DEFAULT_SIZE();
+
+		/**
+		 *   @brief Return the static default maximum number of spins of an
+		 *          idle thread before yielding.
+		 */
+		static inline std::size_t DEFAULT_MAX_SPINS();
+
+		////////////////////////////////////////////////////////////////////////
+
+
+
+		////////////////////////////////////////////////////////////////////////
+		// CONSTRUCTORS
+		////////////////////////////////////////////////////////////////////////
+
+		/**
+		 *   @brief Default constructor. It instantiates and invokes
+		 *          DEFAULT_SIZE() threads.
+		 */
+		inline BasicThreadPool();
+
+		/**
+		 *   @brief Constructor. It instantiates and invokes size threads.
+		 *   @param size      The number of threads.
+		 */
+		explicit inline BasicThreadPool(const std::size_t size);
+
+		/**
+		 *   @brief Copy constructor. BasicThreadPools can't be copied.
+		 */
+		BasicThreadPool(const BasicThreadPool &other) = delete;
+
+		////////////////////////////////////////////////////////////////////////
+
+
+
+		////////////////////////////////////////////////////////////////////////
+		// DESTRUCTOR
+		////////////////////////////////////////////////////////////////////////
+
+		/**
+		 *   @brief Destructor. It stops and deletes the threads.
+		 *          Any pending tasks are not processed but deleted.
+		 */
+		inline ~BasicThreadPool();
+
+		////////////////////////////////////////////////////////////////////////
+
+
+
+		////////////////////////////////////////////////////////////////////////
+		// ASSIGNMENT OPERATORS
+		////////////////////////////////////////////////////////////////////////
+
+		/**
+		 *   @brief Copy assignment operator. BasicThreadPools can't be copied.
+		 */
+		BasicThreadPool & operator=(const BasicThreadPool &other) = delete;
+
+		////////////////////////////////////////////////////////////////////////
+
+
+
+		////////////////////////////////////////////////////////////////////////
+		// MAIN METHODS
+		////////////////////////////////////////////////////////////////////////
+
+		/**
+		 *   @brief Returns the number of threads.
+		 */
+		inline std::size_t size() const;
+
+		/**
+		 *   @brief Submit a single task.
+		 *   @param task      The task to submit. (copy)
+		 */
+		inline void submitTask(const T &task);
+
+		/**
+		 *   @brief Submit a single task.
+		 *   @param task      The task to submit. (move)
+		 */
+		inline void submitTask(T &&task);
+
+		/**
+		 *   @brief Submit a number of tasks.
+		 *   @param first     The iterator to the first task. Use
+		 *                    std::make_move_iterator for moving the tasks.
+		 *   @param last      The iterator past the last task.
+		 */
+		template < class It >
+		inline void submitTasks(It first, It last);
+
+		/**
+		 *   @brief Run one pending task in the calling thread, if any.
+		 *   @return true if a task has been run, false otherwise.
+		 */
+		inline bool runPendingTask();
+
+		/**
+		 *   @brief Returns the approximate number of pending tasks.
+		 */
+		inline std::size_t nPendingTasks() const;
+
+		/**
+		 *   @brief Returns the number of tasks run by the threads so far, if
+		 *          Policy::STATS is true, otherwise 0.
+		 */
+		inline std::uint64_t nExecuted() const;
+
+		////////////////////////////////////////////////////////////////////////
+
+	private:
+		////////////////////////////////////////////////////////////////////////
+		// PRIVATE METHODS
+		////////////////////////////////////////////////////////////////////////
+
+		/**
+		 *   @brief The job of the i-th thread.
+		 */
+		inline void threadJob(const std::size_t i);
+
+		/**
+		 *   @brief Spin, and then yield, waiting for a task, adapting the
+		 *          number of spins to how often it succeeds.
+		 *   @return true if a task has been dequeued, false otherwise.
+		 */
+		inline bool spinForTask(T &task, std::size_t &spins);
+
+		/**
+		 *   @brief Wake up a parked thread for a submitted task, unless idle
+		 *          threads never park.
+		 */
+		inline void notify(const std::size_t n);
+
+		////////////////////////////////////////////////////////////////////////
+
+
+
+		////////////////////////////////////////////////////////////////////////
+		// PRIVATE MEMBERS
+		////////////////////////////////////////////////////////////////////////
+
+		QueueType                                           _queue;      ///< The queue of the tasks.
+		internal::EventCount                                _eventCount; ///< Parking lot of the idle threads.
+		std::atomic_bool                                    _active;     ///< Whether the threads have to keep running.
+		internal::PaddedArray<std::atomic<std::uint64_t>>   _executed;   ///< The number of tasks run by each thread (if Policy::STATS).
+		std::vector<std::thread>                            _threads;    ///< The threads.
+
+		////////////////////////////////////////////////////////////////////////
+	};
+
+	////////////////////////////////////////////////////////////////////////////
+
+}
+
+#include <MPMCThreadPool/inlines/BasicThreadPool.inl>
+
+#endif /* BasicThreadPool_hpp */
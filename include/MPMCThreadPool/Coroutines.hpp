@@ -0,0 +1,376 @@
+// Copyright (c) 2016 Giorgio Marcias
+//
+// This source code is subject to the simplified BSD license.
+//
+// Author: Giorgio Marcias
+// email: marcias.giorgio@gmail.com
+
+#ifndef Coroutines_hpp
+#define Coroutines_hpp
+
+#include <MPMCThreadPool/MPMCThreadPool.hpp>
+
+#if defined(__cpp_impl_coroutine) && defined(__has_include)
+#if __has_include(<coroutine>)
+/// Whether C++20 coroutines are available, and with them the content of this
+/// header.
+#define MPMC_TP_HAS_COROUTINES 1
+#endif
+#endif
+
+#ifndef MPMC_TP_HAS_COROUTINES
+#define MPMC_TP_HAS_COROUTINES 0
+#endif
+
+#if MPMC_TP_HAS_COROUTINES
+
+#include <coroutine>
+#include <optional>
+
+namespace mpmc_tp {
+
+	////////////////////////////////////////////////////////////////////////////
+	// SCHEDULING
+	////////////////////////////////////////////////////////////////////////////
+
+	/// The ScheduleAwaiter class is returned by MPMCThreadPool::schedule():
+	/// awaiting it suspends the coroutine and submits its resumption to the
+	/// pool, so that it continues in one of its threads.
+	class ScheduleAwaiter {
+	public:
+		/**
+		 *   @brief Constructor.
+		 *   @param pool     The pool to resume the coroutine in.
+		 */
+		explicit inline ScheduleAwaiter(MPMCThreadPool &pool);
+
+		inline bool await_ready() const noexcept;
+
+		inline void await_suspend(std::coroutine_handle<> coroutine);
+
+		inline void await_resume() const noexcept;
+
+	private:
+		MPMCThreadPool *_pool; ///< The pool to resume the coroutine in.
+	};
+
+	////////////////////////////////////////////////////////////////////////////
+
+
+
+	////////////////////////////////////////////////////////////////////////////
+	// INTERNAL STUFF
+	////////////////////////////////////////////////////////////////////////////
+
+	namespace internal {
+
+		/// The ResumeTask class is the task submitted by ScheduleAwaiter for
+		/// resuming a coroutine in the pool.
+		class ResumeTask {
+		public:
+			explicit inline ResumeTask(std::coroutine_handle<> coroutine);
+
+			inline void operator()();
+
+		private:
+			std::coroutine_handle<>  _coroutine; ///< The coroutine to resume.
+		};
+
+		/// A resumption runs rather than being discarded, which would leave
+		/// the coroutine suspended forever.
+		template < >
+		struct IsDiscardable<ResumeTask> : std::false_type { };
+
+
+
+		/// The CoroPromiseBase class is the part of the promise of a CoroTask
+		/// not depending on the result type: it keeps the coroutine awaiting
+		/// the task, resumed when the task completes, and the exception thrown
+		/// by the task, if any.
+		class CoroPromiseBase {
+		public:
+			/// The awaiter of the final suspension point: it transfers the
+			/// execution to the awaiting coroutine, without growing the stack.
+			struct FinalAwaiter {
+				inline bool await_ready() const noexcept;
+
+				template < class Promise >
+				inline std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> coroutine) noexcept;
+
+				inline void await_resume() const noexcept;
+			};
+
+			/**
+			 *   @brief Tasks are lazy: they start when awaited.
+			 */
+			inline std::suspend_always initial_suspend() const noexcept;
+
+			inline FinalAwaiter final_suspend() const noexcept;
+
+			inline void unhandled_exception() noexcept;
+
+			/**
+			 *   @brief Set the coroutine to resume when the task completes.
+			 */
+			inline void setContinuation(std::coroutine_handle<> continuation) noexcept;
+
+		protected:
+			std::coroutine_handle<>  _continuation; ///< The coroutine awaiting the task.
+			std::exception_ptr       _exception;    ///< The exception thrown by the task.
+		};
+
+		/// The CoroPromise class is the promise type of CoroTask<T>.
+		template < class T >
+		class CoroPromise : public CoroPromiseBase {
+		public:
+			inline CoroTask<T> get_return_object() noexcept;
+
+			template < class U >
+			inline void return_value(U &&value);
+
+			/**
+			 *   @brief Move the result out, or rethrow the exception.
+			 */
+			inline T result();
+
+		private:
+			std::optional<T>  _value; ///< The result of the task.
+		};
+
+		template < >
+		class CoroPromise<void> : public CoroPromiseBase {
+		public:
+			inline CoroTask<void> get_return_object() noexcept;
+
+			inline void return_void() const noexcept;
+
+			/**
+			 *   @brief Rethrow the exception, if any.
+			 */
+			inline void result();
+		};
+
+		/// The DetachedCoroutine class is the return type of coroutines that
+		/// nobody awaits: they start at once and free their frame at the end.
+		struct DetachedCoroutine {
+			struct promise_type {
+				inline DetachedCoroutine get_return_object() const noexcept;
+				inline std::suspend_never initial_suspend() const noexcept;
+				inline std::suspend_never final_suspend() const noexcept;
+				inline void return_void() const noexcept;
+				inline void unhandled_exception() const noexcept;
+			};
+		};
+
+		/**
+		 *   @brief Run task in a thread of pool, completing state with its
+		 *          result.
+		 */
+		template < class T >
+		inline DetachedCoroutine runCoroTask(MPMCThreadPool &pool, CoroTask<T> task, std::shared_ptr<FutureState<T>> state);
+
+	}
+
+	////////////////////////////////////////////////////////////////////////////
+
+
+
+	////////////////////////////////////////////////////////////////////////////
+	// CORO TASK
+	////////////////////////////////////////////////////////////////////////////
+
+	/// The CoroTask class is the return type of coroutines computing a result
+	/// of type T. It is lazy: the coroutine starts when the task is awaited,
+	/// in the awaiting thread, and when it completes it resumes the awaiting
+	/// coroutine in its own thread. Use 'co_await pool.schedule()' inside the
+	/// coroutine to move it to the threads of a pool, and
+	/// MPMCThreadPool::spawn to start it from ordinary code.
+	/// While suspended, a coroutine does not hold any thread, so that many
+	/// more operations than threads can be in flight.
+	template < class T >
+	class CoroTask {
+	public:
+		using promise_type = internal::CoroPromise<T>;
+
+		/// The awaiter of a CoroTask.
+		class Awaiter {
+		public:
+			explicit inline Awaiter(std::coroutine_handle<promise_type> coroutine) noexcept;
+
+			inline bool await_ready() const noexcept;
+
+			inline std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept;
+
+			inline T await_resume();
+
+		private:
+			std::coroutine_handle<promise_type>  _coroutine; ///< The coroutine of the task.
+		};
+
+		////////////////////////////////////////////////////////////////////////
+		// CONSTRUCTORS
+		////////////////////////////////////////////////////////////////////////
+
+		/**
+		 *   @brief Default constructor. The task is not valid.
+		 */
+		inline CoroTask() noexcept;
+
+		/**
+		 *   @brief Constructor taking ownership of a coroutine.
+		 */
+		explicit inline CoroTask(std::coroutine_handle<promise_type> coroutine) noexcept;
+
+		/**
+		 *   @brief Copy constructor deleted.
+		 */
+		CoroTask(const CoroTask &) = delete;
+
+		/**
+		 *   @brief Move constructor. other is left not valid.
+		 */
+		inline CoroTask(CoroTask &&other) noexcept;
+
+		////////////////////////////////////////////////////////////////////////
+
+
+
+		////////////////////////////////////////////////////////////////////////
+		// DESTRUCTOR
+		////////////////////////////////////////////////////////////////////////
+
+		/**
+		 *   @brief Destructor. It destroys the coroutine, which must not be
+		 *          running.
+		 */
+		inline ~CoroTask();
+
+		////////////////////////////////////////////////////////////////////////
+
+
+
+		////////////////////////////////////////////////////////////////////////
+		// ASSIGNMENT OPERATORS
+		////////////////////////////////////////////////////////////////////////
+
+		/**
+		 *   @brief Copy assignment operator deleted.
+		 */
+		CoroTask & operator=(const CoroTask &) = delete;
+
+		/**
+		 *   @brief Move assignment operator. other is left not valid.
+		 */
+		inline CoroTask & operator=(CoroTask &&other) noexcept;
+
+		////////////////////////////////////////////////////////////////////////
+
+
+
+		////////////////////////////////////////////////////////////////////////
+		// MAIN METHODS
+		////////////////////////////////////////////////////////////////////////
+
+		/**
+		 *   @brief Returns whether the task owns a coroutine.
+		 */
+		inline bool valid() const noexcept;
+
+		/**
+		 *   @brief Start the coroutine and suspend the awaiting one until it
+		 *          completes, then return its result or rethrow its exception.
+		 *   @note Awaiting a task that is not valid throws std::future_error.
+		 */
+		inline Awaiter operator co_await() && noexcept;
+
+		////////////////////////////////////////////////////////////////////////
+
+	private:
+		std::coroutine_handle<promise_type>  _coroutine; ///< The coroutine, null if not valid.
+	};
+
+	////////////////////////////////////////////////////////////////////////////
+
+
+
+	////////////////////////////////////////////////////////////////////////////
+	// AWAITABLE TRAITS
+	////////////////////////////////////////////////////////////////////////////
+
+	/// The TaskPackTraitsAwaitable class is a TaskPack traits, similarly to
+	/// TaskPackTraitsLockFree, whose completion can be awaited by a
+	/// coroutine: 'co_await pack;' suspends it, without holding a thread, and
+	/// the thread completing the last task of the pack resumes it.
+	/// Only one coroutine at a time can await a pack.
+	class TaskPackTraitsAwaitable : public TaskPackTraitsLockFree {
+	public:
+		/// The awaiter of the completion of a pack.
+		class Awaiter {
+		public:
+			explicit inline Awaiter(const TaskPackTraitsAwaitable &traits) noexcept;
+
+			inline bool await_ready() const noexcept;
+
+			inline bool await_suspend(std::coroutine_handle<> coroutine) noexcept;
+
+			inline void await_resume() const noexcept;
+
+		private:
+			const TaskPackTraitsAwaitable  *_traits; ///< The traits of the pack.
+		};
+
+		////////////////////////////////////////////////////////////////////////
+		// CONSTRUCTORS
+		////////////////////////////////////////////////////////////////////////
+
+		/**
+		 *   @brief Constructor with initial size.
+		 *   @param size     The size corresponds to the number of packed tasks.
+		 */
+		inline TaskPackTraitsAwaitable(const std::size_t size);
+
+		////////////////////////////////////////////////////////////////////////
+
+
+
+		////////////////////////////////////////////////////////////////////////
+		// MAIN METHODS
+		////////////////////////////////////////////////////////////////////////
+
+		/**
+		 *   @brief Set the size, and zero the number of completed tasks.
+		 *   @param size The size corresponds to the number of packed tasks.
+		 *   @note Not thread-safe: call it only while no task of the pack
+		 *         runs and no coroutine awaits it.
+		 */
+		inline void setTraitsSize(const std::size_t size) override;
+
+		/**
+		 *   @brief The signal indicating the i-th task has been completed.
+		 *          The last one resumes the awaiting coroutine, if any.
+		 *   @param i        The index of the task just completed.
+		 *   @note If a callback has bee provided, it gets called here.
+		 */
+		inline void signalTaskComplete(const std::size_t i) override;
+
+		/**
+		 *   @brief Suspend the awaiting coroutine until all the packed tasks
+		 *          have completed.
+		 */
+		inline Awaiter operator co_await() const noexcept;
+
+		////////////////////////////////////////////////////////////////////////
+
+	protected:
+		mutable std::atomic<void *>  _waiter; ///< Address of the awaiting coroutine, or this once complete.
+	};
+
+	////////////////////////////////////////////////////////////////////////////
+
+}
+
+#include <MPMCThreadPool/inlines/Coroutines.inl>
+
+#endif /* MPMC_TP_HAS_COROUTINES */
+
+#endif /* Coroutines_hpp */
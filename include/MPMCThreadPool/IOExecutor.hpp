@@ -0,0 +1,440 @@
+// Copyright (c) 2016 Giorgio Marcias
+//
+// This source code is subject to the simplified BSD license.
+//
+// Author: Giorgio Marcias
+// email: marcias.giorgio@gmail.com
+
+#ifndef IOExecutor_hpp
+#define IOExecutor_hpp
+
+#include <MPMCThreadPool/MPMCThreadPool.hpp>
+
+#if defined(__unix__) || defined(__APPLE__)
+/// Whether the IOExecutor class is available (on POSIX systems).
+#define MPMC_TP_HAS_IO_EXECUTOR 1
+#else
+#define MPMC_TP_HAS_IO_EXECUTOR 0
+#endif
+
+#if !defined(MPMC_TP_HAS_IO_URING) && defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+/// Whether IOExecutor is driven by io_uring (on Linux, if the kernel supports
+/// it at runtime). Define it to 0 for running the operations on the blocking
+/// lane of the pool instead.
+#define MPMC_TP_HAS_IO_URING 1
+#endif
+#endif
+
+#ifndef MPMC_TP_HAS_IO_URING
+#define MPMC_TP_HAS_IO_URING 0
+#endif
+
+#if MPMC_TP_HAS_IO_EXECUTOR
+
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+#include <unistd.h>
+
+#if MPMC_TP_HAS_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+namespace mpmc_tp {
+
+	class IOExecutor;
+
+	////////////////////////////////////////////////////////////////////////////
+	// INTERNAL STUFF
+	////////////////////////////////////////////////////////////////////////////
+
+	namespace internal {
+
+		/// The IOOperation class is a read or a write of an IOExecutor, from
+		/// its submission to its completion.
+		class IOOperation {
+		public:
+			inline IOOperation(const bool write, const int fd, void *buffer, const std::size_t size, const std::int64_t offset);
+
+			virtual inline ~IOOperation() = default;
+
+			/**
+			 *   @brief Submit the continuation of the operation to pool.
+			 *   @param pool     The pool running the continuation.
+			 *   @param result   The number of bytes transferred, or -errno.
+			 */
+			virtual inline void complete(MPMCThreadPool &pool, const std::ptrdiff_t result) = 0;
+
+			bool          write;  ///< Whether it is a write rather than a read.
+			int           fd;     ///< The file descriptor.
+			void         *buffer; ///< The buffer to read into or to write from.
+			std::size_t   size;   ///< The number of bytes to transfer.
+			std::int64_t  offset; ///< The offset in the file.
+		};
+
+
+
+		/// The IOCallback class is an operation whose continuation calls a
+		/// function with the result.
+		template < class F >
+		class IOCallback : public IOOperation {
+		public:
+			template < class G >
+			inline IOCallback(const bool write, const int fd, void *buffer, const std::size_t size, const std::int64_t offset, G &&g);
+
+			inline void complete(MPMCThreadPool &pool, const std::ptrdiff_t result) override;
+
+		private:
+			F  _f; ///< The function to call with the result.
+		};
+
+
+
+		/// The IOCompletion class is the task calling the function of an
+		/// IOCallback with the result.
+		template < class F >
+		class IOCompletion {
+		public:
+			template < class G >
+			inline IOCompletion(G &&g, const std::ptrdiff_t result);
+
+			inline void operator()();
+
+		private:
+			F               _f;      ///< The function to call with the result.
+			std::ptrdiff_t  _result; ///< The number of bytes transferred, or -errno.
+		};
+
+		/// A completion runs rather than being discarded, since the operation
+		/// has been performed.
+		template < class F >
+		struct IsDiscardable<IOCompletion<F>> : std::false_type { };
+
+
+
+		/// The IOResult class is the callable object giving the result of an
+		/// operation to a future: it throws std::system_error on failure.
+		class IOResult {
+		public:
+			explicit inline IOResult(const std::ptrdiff_t result);
+
+			inline std::ptrdiff_t operator()() const;
+
+		private:
+			std::ptrdiff_t  _result; ///< The number of bytes transferred, or -errno.
+		};
+
+		/// The future of an operation gets its result rather than a broken
+		/// promise, since the operation has been performed.
+		template < >
+		struct IsDiscardable<FutureTask<std::ptrdiff_t, IOResult>> : std::false_type { };
+
+
+
+		/// The IOPromise class is an operation whose continuation completes a
+		/// future.
+		class IOPromise : public IOOperation {
+		public:
+			inline IOPromise(const bool write, const int fd, void *buffer, const std::size_t size, const std::int64_t offset, std::shared_ptr<FutureState<std::ptrdiff_t>> state);
+
+			inline void complete(MPMCThreadPool &pool, const std::ptrdiff_t result) override;
+
+		private:
+			std::shared_ptr<FutureState<std::ptrdiff_t>>  _state; ///< The state of the future.
+		};
+
+
+
+		/// The BlockingIOTask class is the task performing an operation on the
+		/// blocking lane of the pool, when io_uring is not available.
+		class BlockingIOTask {
+		public:
+			inline BlockingIOTask(IOExecutor &executor, std::unique_ptr<IOOperation> &&op);
+
+			inline void operator()();
+
+		private:
+			IOExecutor                    *_executor; ///< The executor of the operation.
+			std::unique_ptr<IOOperation>   _op;       ///< The operation.
+		};
+
+		/// An operation on the blocking lane runs rather than being discarded,
+		/// as its completion does.
+		template < >
+		struct IsDiscardable<BlockingIOTask> : std::false_type { };
+
+
+
+#if MPMC_TP_HAS_IO_URING
+		/// The IORing class is an io_uring instance, set up by raw system
+		/// calls. Any thread can push entries to its submission queue, while
+		/// one thread only reaps its completion queue.
+		class IORing {
+		public:
+			inline IORing();
+
+			IORing(const IORing &) = delete;
+
+			inline ~IORing();
+
+			IORing & operator=(const IORing &) = delete;
+
+			/**
+			 *   @brief Set up the ring.
+			 *   @param entries  The number of entries of the submission queue.
+			 *   @return true on success, false if io_uring is not supported.
+			 */
+			inline bool open(const unsigned entries);
+
+			/**
+			 *   @brief Returns whether the ring has been set up.
+			 */
+			inline bool isOpen() const;
+
+			/**
+			 *   @brief Push an entry to the submission queue, without handing
+			 *          it over to the kernel yet, unless the queue is full.
+			 */
+			inline void push(const std::uint8_t opcode, const int fd, void *buffer, const std::size_t size, const std::int64_t offset, const std::uint64_t userData);
+
+			/**
+			 *   @brief Hand the pushed entries over to the kernel. If another
+			 *          thread is doing it, that thread takes care of them too,
+			 *          so that concurrent pushes are submitted in batches by a
+			 *          single system call.
+			 */
+			inline void submit();
+
+			/**
+			 *   @brief Wait for at least one completion, then call
+			 *          f(userData, result) for each available one. Call it from
+			 *          one thread only.
+			 */
+			template < class F >
+			inline void reap(F &&f);
+
+		private:
+			/**
+			 *   @brief The io_uring_enter system call.
+			 */
+			inline int enter(const unsigned toSubmit, const unsigned minComplete, const unsigned flags);
+
+			int               _fd;          ///< The file descriptor of the ring, -1 if not set up.
+			void             *_sqRing;      ///< The mapped submission queue ring.
+			std::size_t       _sqRingSize;  ///< The size of _sqRing.
+			void             *_cqRing;      ///< The mapped completion queue ring (may be _sqRing).
+			std::size_t       _cqRingSize;  ///< The size of _cqRing.
+			io_uring_sqe     *_sqes;        ///< The mapped submission queue entries.
+			std::size_t       _sqesSize;    ///< The size of _sqes.
+			unsigned         *_sqHead;      ///< The head of the submission queue, advanced by the kernel.
+			unsigned         *_sqTail;      ///< The tail of the submission queue.
+			unsigned         *_sqArray;     ///< The indices of the submission queue entries.
+			unsigned          _sqMask;      ///< The mask of the submission queue indices.
+			unsigned          _sqEntries;   ///< The number of submission queue entries.
+			unsigned         *_cqHead;      ///< The head of the completion queue.
+			unsigned         *_cqTail;      ///< The tail of the completion queue, advanced by the kernel.
+			io_uring_cqe     *_cqes;        ///< The completion queue entries.
+			unsigned          _cqMask;      ///< The mask of the completion queue indices.
+			std::mutex        _mutex;       ///< Mutex of the producers of the submission queue.
+			std::atomic_bool  _pending;     ///< Whether entries have been pushed since the last submission.
+			std::atomic_bool  _submitting;  ///< Whether a thread is submitting the entries.
+		};
+#endif
+
+	}
+
+	////////////////////////////////////////////////////////////////////////////
+
+
+
+	////////////////////////////////////////////////////////////////////////////
+	// IO EXECUTOR
+	////////////////////////////////////////////////////////////////////////////
+
+	/// The IOExecutor class performs asynchronous file reads and writes for
+	/// the tasks of a MPMCThreadPool: when an operation completes, its
+	/// continuation is submitted to the pool, so that no thread of the pool
+	/// blocks on I/O and a few threads can keep many operations in flight.
+	/// On Linux the operations are driven by io_uring: they are pushed to the
+	/// submission queue of a ring and handed over to the kernel in batches,
+	/// and a single thread of the executor waits for their completions. Where
+	/// io_uring is not available (other systems, old kernels, or if it is not
+	/// permitted) the operations run on the blocking lane of the pool instead
+	/// (see MPMCThreadPool::submitBlocking).
+	/// Buffers must stay valid until the operation completes, and the executor
+	/// must be destroyed before its pool.
+	class IOExecutor {
+	public:
+		////////////////////////////////////////////////////////////////////////
+		// STATIC METHODS
+		////////////////////////////////////////////////////////////////////////
+
+		/**
+		 *   @brief Return the static default number of entries of the
+		 *          submission queue.
+		 */
+		static inline std::size_t DEFAULT_QUEUE_DEPTH();
+
+		////////////////////////////////////////////////////////////////////////
+
+
+
+		////////////////////////////////////////////////////////////////////////
+		// CONSTRUCTORS
+		////////////////////////////////////////////////////////////////////////
+
+		/**
+		 *   @brief Constructor. It sets up the ring, if possible, and starts
+		 *          the thread waiting for the completions.
+		 *   @param pool       The pool running the continuations.
+		 *   @param queueDepth The number of entries of the submission queue:
+		 *                     more operations can be in flight, but at most
+		 *                     as many are submitted by a single system call.
+		 */
+		explicit inline IOExecutor(MPMCThreadPool &pool, const std::size_t queueDepth = IOExecutor::DEFAULT_QUEUE_DEPTH());
+
+		/**
+		 *   @brief Copy constructor deleted.
+		 */
+		IOExecutor(const IOExecutor &) = delete;
+
+		////////////////////////////////////////////////////////////////////////
+
+
+
+		////////////////////////////////////////////////////////////////////////
+		// DESTRUCTOR
+		////////////////////////////////////////////////////////////////////////
+
+		/**
+		 *   @brief Destructor. It waits for the operations in flight.
+		 */
+		inline ~IOExecutor();
+
+		////////////////////////////////////////////////////////////////////////
+
+
+
+		////////////////////////////////////////////////////////////////////////
+		// ASSIGNMENT OPERATORS
+		////////////////////////////////////////////////////////////////////////
+
+		/**
+		 *   @brief Copy assignment operator deleted.
+		 */
+		IOExecutor & operator=(const IOExecutor &) = delete;
+
+		////////////////////////////////////////////////////////////////////////
+
+
+
+		////////////////////////////////////////////////////////////////////////
+		// OPERATIONS
+		////////////////////////////////////////////////////////////////////////
+
+		/**
+		 *   @brief Read from a file asynchronously. When the read completes,
+		 *          f(result) is submitted to the pool, where result is the
+		 *          number of bytes read or -errno on failure. As with
+		 *          pread, the transfer may be short: at most 0x7ffff000
+		 *          bytes are transferred at once on Linux.
+		 *   @param fd        The file descriptor.
+		 *   @param buffer    The buffer to read into.
+		 *   @param size      The number of bytes to read.
+		 *   @param offset    The offset in the file.
+		 *   @param f         The continuation, taking a std::ptrdiff_t. (move)
+		 */
+		template < class F >
+		inline void read(const int fd, void *buffer, const std::size_t size, const std::int64_t offset, F &&f);
+
+		/**
+		 *   @brief Write to a file asynchronously. When the write completes,
+		 *          f(result) is submitted to the pool, where result is the
+		 *          number of bytes written or -errno on failure. As with
+		 *          pwrite, the transfer may be short: at most 0x7ffff000
+		 *          bytes are transferred at once on Linux.
+		 *   @param fd        The file descriptor.
+		 *   @param buffer    The buffer to write from.
+		 *   @param size      The number of bytes to write.
+		 *   @param offset    The offset in the file.
+		 *   @param f         The continuation, taking a std::ptrdiff_t. (move)
+		 */
+		template < class F >
+		inline void write(const int fd, const void *buffer, const std::size_t size, const std::int64_t offset, F &&f);
+
+		/**
+		 *   @brief Read from a file asynchronously.
+		 *   @return The future holding the number of bytes read, or a
+		 *           std::system_error on failure.
+		 */
+		inline Future<std::ptrdiff_t> read(const int fd, void *buffer, const std::size_t size, const std::int64_t offset);
+
+		/**
+		 *   @brief Write to a file asynchronously.
+		 *   @return The future holding the number of bytes written, or a
+		 *           std::system_error on failure.
+		 */
+		inline Future<std::ptrdiff_t> write(const int fd, const void *buffer, const std::size_t size, const std::int64_t offset);
+
+		/**
+		 *   @brief Block the calling thread until the continuations of all the
+		 *          operations submitted so far have been submitted to the
+		 *          pool. Called from a thread of a pool, it runs the pending
+		 *          tasks of the pool meanwhile.
+		 */
+		inline void wait();
+
+		/**
+		 *   @brief Returns the number of operations in flight.
+		 */
+		inline std::size_t inFlight() const;
+
+		/**
+		 *   @brief Returns whether the operations are driven by io_uring,
+		 *          rather than run on the blocking lane of the pool.
+		 */
+		inline bool usesIOUring() const;
+
+		////////////////////////////////////////////////////////////////////////
+
+	private:
+		friend class internal::BlockingIOTask;
+
+		/**
+		 *   @brief Start an operation.
+		 */
+		inline void start(std::unique_ptr<internal::IOOperation> &&op);
+
+		/**
+		 *   @brief Submit the continuation of a completed operation and
+		 *          destroy it.
+		 */
+		inline void finish(std::unique_ptr<internal::IOOperation> &&op, const std::ptrdiff_t result);
+
+		/**
+		 *   @brief The job of the thread waiting for the completions, until
+		 *          the executor is destroyed.
+		 */
+		inline void reap();
+
+		MPMCThreadPool        *_pool;       ///< The pool running the continuations.
+		std::atomic_size_t     _inFlight;   ///< The number of operations in flight.
+		internal::EventCount   _eventCount; ///< Parking lot of the threads waiting for the operations in flight.
+#if MPMC_TP_HAS_IO_URING
+		internal::IORing       _ring;       ///< The ring, if set up.
+		std::thread            _reaper;     ///< The thread waiting for the completions.
+#endif
+	};
+
+	////////////////////////////////////////////////////////////////////////////
+
+}
+
+#include <MPMCThreadPool/inlines/IOExecutor.inl>
+
+#endif
+
+#endif /* IOExecutor_hpp */
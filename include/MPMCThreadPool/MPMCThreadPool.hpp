@@ -9,9 +9,53 @@
 #define MPMCThreadPool_hpp
 
 #include <concurrentqueue/concurrentqueue.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
 #include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <random>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
 #include <vector>
 
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+#include <intrin.h>
+#endif
+
+#if defined(__linux__)
+#include <dirent.h>
+#include <fstream>
+#include <pthread.h>
+#include <sched.h>
+#include <sstream>
+#include <string>
+#endif
+
+#ifndef MPMC_TP_TASK_BUFFER_SIZE
+/// Size in bytes of the inline buffer of Task: callable objects fitting in
+/// it are stored without any heap allocation.
+#define MPMC_TP_TASK_BUFFER_SIZE 48
+#endif
+
+#ifndef MPMC_TP_STATS
+/// Whether the threads of the pool collect statistics (see
+/// MPMCThreadPool::stats()). When 0 the counters are compiled out.
+#define MPMC_TP_STATS 0
+#endif
+
 namespace mpmc_tp {
 
 	using namespace moodycamel;
@@ -19,75 +63,63 @@ namespace mpmc_tp {
 
 
 	////////////////////////////////////////////////////////////////////////////
-	// NAMESPACE-LEVEL DEFINITIONS
+	// TASK
 	////////////////////////////////////////////////////////////////////////////
 
-	using SimpleTaskType = std::function<void()>;
+	namespace internal {
 
-	////////////////////////////////////////////////////////////////////////////
+		/// Whether a task of type F may be discarded without running by
+		/// OverflowPolicy::DropOldest. It is false for the tasks that others
+		/// wait for and have no future to learn they were discarded from,
+		/// which then run in the submitting thread instead.
+		template < class F >
+		struct IsDiscardable : std::true_type { };
 
+	}
 
+	/// The BasicTask class is a move-only wrapper of any callable object with
+	/// signature 'void()'. Callable objects that fit into BufferSize bytes (and
+	/// that can be moved without throwing) are stored inline, so wrapping them
+	/// does not allocate; bigger ones are moved into the heap.
+	/// Unlike std::function, it does not require the wrapped object to be
+	/// copyable, so that closures owning their data can be moved through the
+	/// queue of the pool.
+	template < std::size_t BufferSize >
+	class BasicTask {
+		static_assert(BufferSize >= sizeof(void *), "The buffer of a task must be able to hold at least a pointer.");
 
-	/// The MPMCThreadPool class represents a pool of a fixed number of threads.
-	/// Threads are instantiated and invoked when a MPMCThreadPool object is
-	/// constructed and they are kept alive for the whole lifetime of the thread
-	/// pool.
-	/// At any time, any instantiated thread either is performing a task or is
-	/// wating for a new task to perform to become available.
-	/// Users of the thread pool can post tasks and, possibly, wait for their
-	/// completion.
-	/// The thread pool keeps a lock-free queue of tasks (that can be copied or
-	/// moved) allowing for fast single post or bulk post (which is faster than
-	/// multiple single enqueuings). For further information on such performant
-	/// lock-free queue see https://github.com/cameron314/concurrentqueue
-	/// This thread pool is completely thread-safe and multiple producers can
-	/// post tasks independently without needing to sinchronize.
-	/// For slightly better performance, each producer (i.e. a user that posts
-	/// tasks and runs in a given thread) can get and specify a token allowing
-	/// faster enqueuing.
-	class MPMCThreadPool {
 	public:
-
 		////////////////////////////////////////////////////////////////////////
-		// STATIC METHODS
+		// CONSTRUCTORS
 		////////////////////////////////////////////////////////////////////////
 
 		/**
-		 *   @brief Return the static default size of the pool, given by
-		 *          std::thread::hardware_concurrency();
+		 *   @brief Default constructor. The task is empty.
 		 */
-		static inline std::size_t DEFAULT_SIZE();
-
-		////////////////////////////////////////////////////////////////////////
-
-
-
-		////////////////////////////////////////////////////////////////////////
-		// CONSTRUCTORS
-		////////////////////////////////////////////////////////////////////////
+		inline BasicTask() noexcept;
 
 		/**
-		 *   @brief Default constructor. It instantiates and invokes
-		 *          DEFAULT_SIZE() threads.
+		 *   @brief Constructor of an empty task.
 		 */
-		inline MPMCThreadPool();
+		inline BasicTask(std::nullptr_t) noexcept;
 
 		/**
-		 *   @brief Default constructor. It instantiates and invokes size
-		 *          threads.
-		 *   @param size      The initial number of threads.
+		 *   @brief Constructor wrapping a callable object.
+		 *   @param f        The callable object to wrap, having signature
+		 *                   'void()'. (move)
 		 */
-		explicit inline MPMCThreadPool(const std::size_t size);
+		template < class F, class = typename std::enable_if<!std::is_same<typename std::decay<F>::type, BasicTask>::value && !std::is_same<typename std::decay<F>::type, std::nullptr_t>::value>::type >
+		inline BasicTask(F &&f);
 
 		/**
-		 *   @brief Copy constructor. MPMCThreadPools can't be copied.
+		 *   @brief Copy constructor deleted.
 		 */
-		MPMCThreadPool(const MPMCThreadPool &other) = delete;
+		BasicTask(const BasicTask &) = delete;
 
 		/**
-		 *   @brief Move constructor. MPMCThreadPools can't be moved.
+		 *   @brief Move constructor. other is left empty.
 		 */
-		MPMCThreadPool(MPMCThreadPool &&other) = default;
+		inline BasicTask(BasicTask &&other) noexcept;
 
 		////////////////////////////////////////////////////////////////////////
 
@@ -97,11 +129,7 @@ namespace mpmc_tp {
 		// DESTRUCTOR
 		////////////////////////////////////////////////////////////////////////
 
-		/**
-		 *   @brief Default destructor. It stops and deletes the active threads.
-		 *          Any pending tasks are not processed but deleted.
-		 */
-		inline ~MPMCThreadPool();
+		inline ~BasicTask();
 
 		////////////////////////////////////////////////////////////////////////
 
@@ -112,149 +140,2021 @@ namespace mpmc_tp {
 		////////////////////////////////////////////////////////////////////////
 
 		/**
-		 *   @brief Copy assignment operator. MPMCThreadPools can't be copied.
+		 *   @brief Copy assignment operator deleted.
 		 */
-		MPMCThreadPool & operator=(const MPMCThreadPool &other) = delete;
+		BasicTask & operator=(const BasicTask &) = delete;
 
 		/**
-		 *   @brief Move assignment operator. MPMCThreadPools can't be moved.
+		 *   @brief Move assignment operator. other is left empty.
 		 */
-		MPMCThreadPool & operator=(MPMCThreadPool &&other) = default;
+		inline BasicTask & operator=(BasicTask &&other) noexcept;
+
+		/**
+		 *   @brief Empty the task.
+		 */
+		inline BasicTask & operator=(std::nullptr_t) noexcept;
 
 		////////////////////////////////////////////////////////////////////////
 
 
 
 		////////////////////////////////////////////////////////////////////////
-		// SIZE-RELATED METHODS
+		// MAIN METHODS
 		////////////////////////////////////////////////////////////////////////
 
 		/**
-		 *   @brief Returns the size of the pool.
+		 *   @brief Returns whether the task wraps a callable object.
 		 */
-		inline std::size_t size() const;
+		explicit inline operator bool() const noexcept;
 
 		/**
-		 *   @brief Increase the size of the pool with n new threads. The new
-		 *          threads are activated and start soon to process tasks.
-		 *   @param n         The number of new threads to add.
+		 *   @brief Invoke the wrapped callable object.
+		 *   @note Throws std::bad_function_call if the task is empty.
 		 */
-		inline void expand(const std::size_t n);
+		inline void operator()();
 
 		/**
-		 *   @brief Decrease the size of the pool by removing n threads. It
-		 *          actually stops n threads (after they complete the tasks they
-		 *          are working on).
-		 *   @param n         The number of new threads to remove.
-		 *   @note If the shrink leads to 0 threads and the queue is not empty
-		 *         the remaining tasks are not processed until new threads are
-		 *         are added by calling 'expand(n)' with n > 0.
+		 *   @brief Returns whether the pool may discard the task without
+		 *          running it (see internal::IsDiscardable).
 		 */
-		inline void shrink(const std::size_t n);
+		inline bool discardable() const noexcept;
+
+#if MPMC_TP_STATS
+		/**
+		 *   @brief Record the time the task is submitted to the pool.
+		 */
+		inline void setSubmitTime(const std::chrono::steady_clock::time_point time) noexcept;
+
+		/**
+		 *   @brief Returns the time the task was submitted to the pool, or the
+		 *          epoch of the clock if it was not.
+		 */
+		inline std::chrono::steady_clock::time_point submitTime() const noexcept;
+#endif
 
 		////////////////////////////////////////////////////////////////////////
 
+	private:
+		/// Type-specific operations on the stored callable object.
+		struct Manager {
+			void (*invoke)(void *);              ///< Invoke the object.
+			void (*move)(void *dst, void *src);  ///< Move the object from src to dst, destroying the one in src.
+			void (*destroy)(void *);             ///< Destroy the object.
+			bool   discardable;                  ///< Whether the object may be destroyed without being invoked.
+		};
+
+		/// Operations on a callable object of type F stored in the buffer.
+		template < class F >
+		struct InlineManager {
+			static inline void invoke(void *p);
+			static inline void move(void *dst, void *src);
+			static inline void destroy(void *p);
+			static const Manager MANAGER;
+		};
 
+		/// Operations on a callable object of type F stored in the heap and
+		/// pointed by the buffer.
+		template < class F >
+		struct HeapManager {
+			static inline void invoke(void *p);
+			static inline void move(void *dst, void *src);
+			static inline void destroy(void *p);
+			static const Manager MANAGER;
+		};
 
-		////////////////////////////////////////////////////////////////////////
-		// METHODS FOR TASKS
-		////////////////////////////////////////////////////////////////////////
+		/// Whether a callable object of type F is stored inline.
+		template < class F >
+		using FitsInline = std::integral_constant<bool, sizeof(F) <= BufferSize && alignof(F) <= alignof(std::max_align_t) && std::is_nothrow_move_constructible<F>::value>;
+
+		template < class F >
+		inline void store(F &&f, std::true_type);
+
+		template < class F >
+		inline void store(F &&f, std::false_type);
+
+		typename std::aligned_storage<BufferSize, alignof(std::max_align_t)>::type _buffer;  ///< Storage for the callable object, or for the pointer to it.
+		const Manager                                                              *_manager; ///< Operations on the callable object, nullptr if empty.
+#if MPMC_TP_STATS
+		std::chrono::steady_clock::time_point                                      _submitTime; ///< When the task was submitted to the pool.
+#endif
+	};
+
+	////////////////////////////////////////////////////////////////////////////
+
+
+
+	////////////////////////////////////////////////////////////////////////////
+	// NAMESPACE-LEVEL DEFINITIONS
+	////////////////////////////////////////////////////////////////////////////
+
+	/// The type of the tasks processed by MPMCThreadPool.
+	using Task = BasicTask<MPMC_TP_TASK_BUFFER_SIZE>;
+
+	using SimpleTaskType = Task;
+
+	/// What the threads of a MPMCThreadPool do when they find no task.
+	enum class IdlePolicy {
+		Block,        ///< Park immediately until a task is submitted. Saves CPU and battery.
+		SpinThenPark, ///< Spin for a while, then yield a few times, then park. The spin duration adapts to how often spinning recently found a task.
+		BusyPoll      ///< Never park: keep spinning and yielding. Lowest latency, burns a core per idle thread.
+	};
+
+	template < class R >
+	class Future;
+
+	class ScheduleAwaiter;
+
+	template < class T >
+	class CoroTask;
+
+	class TaskPackArena;
+
+	class BlockingScope;
+
+	class IOExecutor;
+
+	class TimerHandle;
+
+	class TaskGroup;
+
+	/// The DefaultPoolPolicy struct sets at compile time how a BasicThreadPool
+	/// queues, waits for and runs its tasks. Custom policies can derive from it
+	/// and hide the members to change.
+	struct DefaultPoolPolicy {
+		/// The type of the queue of tasks of type T. It must provide the
+		/// enqueue, enqueue_bulk, try_dequeue and size_approx methods of
+		/// moodycamel::ConcurrentQueue.
+		template < class T >
+		using Queue = moodycamel::ConcurrentQueue<T>;
+
+		/// What idle threads do (the initial setting of MPMCThreadPool).
+		static constexpr IdlePolicy IDLE_POLICY = IdlePolicy::Block;
+
+		/// Whether threads count the tasks they run (MPMC_TP_STATS for
+		/// MPMCThreadPool).
+		static constexpr bool STATS = MPMC_TP_STATS != 0;
+
+		/**
+		 *   @brief Run task, by calling it.
+		 */
+		template < class T >
+		static inline void run(T &task);
+	};
+
+	template < class T, class Policy = DefaultPoolPolicy >
+	class BasicThreadPool;
+
+	/// The full-featured thread pool, running type-erased tasks: the
+	/// specialization of BasicThreadPool for Task and DefaultPoolPolicy.
+	using MPMCThreadPool = BasicThreadPool<Task, DefaultPoolPolicy>;
+
+	/// The WorkerStats struct is a snapshot of the statistics of a thread of
+	/// MPMCThreadPool, or of their sum. Counters are collected only if
+	/// MPMC_TP_STATS is defined to 1, otherwise they are zero.
+	struct WorkerStats {
+		/// Number of buckets of the latency histogram.
+		static constexpr std::size_t N_LATENCY_BUCKETS = 32;
+
+		/**
+		 *   @brief Constructor. All counters are zero.
+		 */
+		inline WorkerStats();
+
+		/**
+		 *   @brief Add the counters of other.
+		 */
+		inline WorkerStats & operator+=(const WorkerStats &other);
+
+		std::uint64_t             tasksExecuted; ///< Number of tasks run.
+		std::uint64_t             tasksStolen;   ///< Number of tasks stolen from the local deques of the others.
+		std::uint64_t             wakeups;       ///< Number of times the thread has been woken up after parking.
+		std::chrono::nanoseconds  busyTime;      ///< Time spent running tasks.
+		std::chrono::nanoseconds  parkedTime;    ///< Time spent parked waiting for tasks.
+		std::size_t               localTasks;    ///< Approximate number of tasks in the local deque.
+		/// Histogram of the delays between the submission of tasks and the
+		/// start of their execution: bucket i counts the delays in
+		/// [2^i, 2^(i+1)) nanoseconds, the last one also the longer ones.
+		std::array<std::uint64_t, N_LATENCY_BUCKETS> latency;
+	};
+
+	/// The PoolStats struct is a snapshot of the state of a MPMCThreadPool.
+	struct PoolStats {
+		/**
+		 *   @brief Constructor. All counters are zero.
+		 */
+		inline PoolStats();
+
+		std::size_t               queuedTasks;   ///< Approximate number of tasks in the shared queues.
+		std::size_t               localTasks;    ///< Approximate number of tasks in the local deques.
+		std::size_t               parkedThreads; ///< Number of threads parked waiting for tasks.
+		std::uint64_t             droppedTasks;  ///< Number of tasks discarded by OverflowPolicy::DropOldest.
+		std::vector<WorkerStats>  workers;       ///< Statistics of each thread.
+		WorkerStats               total;         ///< Sum of the statistics of all the threads, including the removed ones.
+	};
+
+	/// How the threads of a MPMCThreadPool are pinned to the CPUs.
+	enum class AffinityPolicy {
+		None,    ///< Threads are not pinned: the OS may migrate them.
+		Compact, ///< Threads are pinned filling the CPUs of a NUMA node before moving to the next one.
+		Scatter  ///< Threads are pinned spreading them round-robin across the NUMA nodes.
+	};
+
+	/// What submitting a task to a MPMCThreadPool at its capacity does (see
+	/// MPMCThreadPool::setCapacity).
+	enum class OverflowPolicy {
+		Block,      ///< Wait for room. Threads of the pool run pending tasks meanwhile, so that they cannot deadlock.
+		Reject,     ///< Throw std::overflow_error: the task is not submitted. See also MPMCThreadPool::trySubmit.
+		CallerRuns, ///< Run the task in the calling thread, which slows down the producer.
+		DropOldest  ///< Discard the oldest pending task of the shared queues, from the lowest priority level. Its future, if any, gets a broken promise. The tasks of TaskPack and TaskGraph, fired timers, continuations, coroutine resumptions and I/O completions are not discarded, since others wait for them: they run in the submitting thread instead.
+	};
+
+	/// The ElasticPolicy struct sets how an elastic MPMCThreadPool adapts its
+	/// number of threads to the load (see MPMCThreadPool::setElastic).
+	struct ElasticPolicy {
+		/**
+		 *   @brief Constructor with the default settings.
+		 */
+		inline ElasticPolicy();
+
+		std::size_t                minSize;       ///< Number of threads never retired.
+		std::size_t                maxSize;       ///< Maximum number of threads.
+		std::size_t                maxQueueDepth; ///< Number of queued tasks per thread beyond which threads are added.
+		std::chrono::microseconds  maxLatency;    ///< Delay between submission and start of a task beyond which a thread is added.
+		std::chrono::milliseconds  idleTimeout;   ///< Time threads must be found parked before as many are removed.
+		std::chrono::milliseconds  period;        ///< Time between two checks of the load.
+	};
+
+	namespace internal {
+
+		class Worker;
+
+		/// The type returned by calling F with arguments Args (std::result_of
+		/// is deprecated in C++17 and removed in C++20).
+#if defined(__cpp_lib_is_invocable)
+		template < class F, class ...Args >
+		using InvokeResult = typename std::invoke_result<F, Args...>::type;
+#else
+		template < class F, class ...Args >
+		using InvokeResult = typename std::result_of<F(Args...)>::type;
+#endif
+
+		/**
+		 *   @brief Hint the processor the calling thread is spin-waiting.
+		 */
+		inline void cpuRelax();
+
+		/**
+		 *   @brief If the calling thread belongs to a pool, run one of the
+		 *          tasks pending in it, so that a thread waiting for something
+		 *          helps instead of idling.
+		 *   @return true if a task has been run, false otherwise.
+		 */
+		inline bool helpCurrentPool();
+
+		/**
+		 *   @brief Submit a task on behalf of the pool itself, e.g. a fired
+		 *          timer, an I/O completion, a continuation or a resumed
+		 *          coroutine: it is queued even beyond the capacity, whatever
+		 *          the overflow policy, since the submitting thread can
+		 *          neither wait for room nor run it.
+		 *   @param pool      The pool to submit the task to.
+		 *   @param task      The task to submit. (move)
+		 */
+		inline void resubmit(MPMCThreadPool &pool, SimpleTaskType &&task);
+
+		/**
+		 *   @brief Submit tasks on behalf of the pool itself, beyond the
+		 *          capacity if needed.
+		 *   @param pool      The pool to submit the tasks to.
+		 *   @param first     The iterator to the first task to submit. (move)
+		 *   @param last      The iterator past the last task to submit.
+		 */
+		template < class It >
+		inline void resubmit(MPMCThreadPool &pool, It first, It last);
+
+
+
+		/// The EventCount class lets threads park until an event is notified,
+		/// without requiring notifiers to take any lock when nobody is parked.
+		/// A thread that is going to park first calls 'prepareWait', then
+		/// checks again the condition it is waiting for, and finally either
+		/// calls 'cancelWait' (if the condition holds) or 'commitWait'.
+		/// Notifiers first make the condition hold, then call 'notifyOne' or
+		/// 'notifyAll': these only read an atomic counter of the parked threads
+		/// and touch the mutex and the condition variable only if it is not 0.
+		class EventCount {
+		public:
+			////////////////////////////////////////////////////////////////////
+			// CONSTRUCTORS
+			////////////////////////////////////////////////////////////////////
+
+			/**
+			 *   @brief Default constructor.
+			 */
+			inline EventCount();
+
+			/**
+			 *   @brief Copy constructor deleted.
+			 */
+			EventCount(const EventCount &) = delete;
+
+			/**
+			 *   @brief Move constructor deleted.
+			 */
+			EventCount(EventCount &&) = delete;
+
+			////////////////////////////////////////////////////////////////////
+
+
+
+			////////////////////////////////////////////////////////////////////
+			// ASSIGNMENT OPERATORS
+			////////////////////////////////////////////////////////////////////
+
+			/**
+			 *    @brief Copy assignment operator deleted.
+			 */
+			EventCount & operator=(const EventCount &) = delete;
+
+			/**
+			 *    @brief Move assignment operator deleted.
+			 */
+			EventCount & operator=(EventCount &&) = delete;
+
+			////////////////////////////////////////////////////////////////////
+
+
+
+			////////////////////////////////////////////////////////////////////
+			// MAIN METHODS
+			////////////////////////////////////////////////////////////////////
+
+			/**
+			 *   @brief Announce the calling thread is going to park.
+			 *   @return The key to pass to 'commitWait'.
+			 */
+			inline std::uint64_t prepareWait();
+
+			/**
+			 *   @brief Withdraw the announcement made with 'prepareWait'.
+			 */
+			inline void cancelWait();
+
+			/**
+			 *   @brief Park the calling thread until a notification following
+			 *          the call to 'prepareWait' that returned key.
+			 *   @param key      The key returned by 'prepareWait'.
+			 */
+			inline void commitWait(const std::uint64_t key);
+
+			/**
+			 *   @brief Wake up at least one parked thread, if any.
+			 */
+			inline void notifyOne();
+
+			/**
+			 *   @brief Wake up all parked threads, if any.
+			 */
+			inline void notifyAll();
+
+			/**
+			 *   @brief Returns the number of threads that announced they are
+			 *          going to park.
+			 */
+			inline std::size_t nWaiters() const;
+
+			////////////////////////////////////////////////////////////////////
+
+		private:
+			static constexpr std::uint64_t WAITERS_MASK = (std::uint64_t(1) << 32) - 1;  ///< Bits of _state counting the waiters.
+			static constexpr std::uint64_t EPOCH_ONE    = std::uint64_t(1) << 32;        ///< Increment of the epoch in _state.
+
+			/**
+			 *   @brief Advance the epoch if there are waiters.
+			 *   @return true if there are waiters to wake up, false otherwise.
+			 */
+			inline bool advance();
+
+			std::atomic<std::uint64_t>  _state;   ///< Epoch (high 32 bits) and number of waiters (low 32 bits).
+			std::mutex                  _mutex;   ///< Mutex for parking the waiters.
+			std::condition_variable     _condVar; ///< Condition variable for parking the waiters.
+		};
+
+
+
+		/// Assumed size of a cache line, for keeping apart data written by
+		/// different threads.
+		static constexpr std::size_t CACHE_LINE_SIZE = 64;
+
+		/// The PaddedArray class is a fixed-size array whose elements are each
+		/// aligned to a cache line of their own (or more, if bigger), so that
+		/// threads writing different elements do not invalidate each other's
+		/// caches.
+		template < class T >
+		class PaddedArray {
+			static_assert(alignof(T) <= CACHE_LINE_SIZE, "Elements of a PaddedArray cannot be aligned more than a cache line.");
+
+		public:
+			/**
+			 *   @brief Constructor. Elements are value-initialized.
+			 *   @param size     The number of elements.
+			 */
+			explicit inline PaddedArray(const std::size_t size);
+
+			/**
+			 *   @brief Constructor taking the memory from an arena, which must
+			 *          outlive the array. Elements are value-initialized.
+			 *   @param size     The number of elements.
+			 *   @param arena    The arena to allocate from.
+			 */
+			inline PaddedArray(const std::size_t size, TaskPackArena &arena);
+
+			/**
+			 *   @brief Copy constructor deleted.
+			 */
+			PaddedArray(const PaddedArray &) = delete;
+
+			inline ~PaddedArray();
+
+			/**
+			 *   @brief Copy assignment operator deleted.
+			 */
+			PaddedArray & operator=(const PaddedArray &) = delete;
+
+			/**
+			 *   @brief Returns the number of elements.
+			 */
+			inline std::size_t size() const;
+
+			inline T & operator[](const std::size_t i);
+
+			inline const T & operator[](const std::size_t i) const;
+
+			/**
+			 *   @brief Access the i-th element.
+			 *   @note Throws std::out_of_range if i is not valid.
+			 */
+			inline T & at(const std::size_t i);
+
+			/**
+			 *   @brief Access the i-th element.
+			 *   @note Throws std::out_of_range if i is not valid.
+			 */
+			inline const T & at(const std::size_t i) const;
+
+		private:
+			/// Distance between two consecutive elements.
+			static constexpr std::size_t STRIDE = (sizeof(T) + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE * CACHE_LINE_SIZE;
+
+			/**
+			 *   @brief Construct the elements in _data, destroying them if one
+			 *          throws.
+			 */
+			inline void construct();
+
+			std::size_t  _size;   ///< The number of elements.
+			char        *_memory; ///< The allocated memory, null if taken from an arena.
+			char        *_data;   ///< The first element, aligned to a cache line.
+		};
+
+
+
+		/// The CompletionCounter class counts the completed tasks of a pack.
+		/// Instead of a single atomic counter, which all threads would bump,
+		/// tasks are spread over stripes of counters each in its own cache
+		/// line (task i goes to stripe i % nStripes, so that the tasks running
+		/// at the same time, usually consecutive, hit different stripes); the
+		/// task completing a stripe bumps a top-level counter, and the one
+		/// completing the last stripe completes the pack. Small packs have no
+		/// stripes: their tasks bump the top-level counter directly, and no
+		/// memory is allocated.
+		/// Counters are incremented with release semantics and checked with
+		/// acquire semantics, so that everything the tasks have written is
+		/// visible once the pack is seen complete.
+		class CompletionCounter {
+		public:
+			/**
+			 *   @brief Constructor.
+			 *   @param size     The number of tasks.
+			 */
+			explicit inline CompletionCounter(const std::size_t size);
+
+			/**
+			 *   @brief Set the number of tasks and zero the counters. Not
+			 *          thread-safe.
+			 */
+			inline void reset(const std::size_t size);
+
+			/**
+			 *   @brief Count the completion of the i-th task.
+			 *   @return true if it was the last one, false otherwise.
+			 */
+			inline bool signal(const std::size_t i);
+
+			/**
+			 *   @brief Returns whether all the tasks have completed.
+			 */
+			inline bool complete() const;
+
+			/**
+			 *   @brief Returns the number of completed tasks so far.
+			 */
+			inline std::size_t count() const;
+
+		private:
+			/**
+			 *   @brief Returns the number of stripes for size tasks: one for
+			 *          small packs, up to one per hardware thread for big ones.
+			 */
+			static inline std::size_t nStripes(const std::size_t size);
+
+			std::size_t                                       _size;     ///< The number of tasks.
+			std::size_t                                       _nStripes; ///< The number of stripes.
+			std::size_t                                       _target;   ///< The value of the top-level counter when all the tasks have completed.
+			std::unique_ptr<PaddedArray<std::atomic_size_t>>  _stripes;  ///< The counters of the stripes, null if there is only one.
+			char                                              _pad0[CACHE_LINE_SIZE];
+			std::atomic_size_t                                _top;      ///< The top-level counter, in its own cache line.
+			char                                              _pad1[CACHE_LINE_SIZE];
+		};
+
+
+
+		class TimerWheel;
+
+		/// The TimerLink struct is a link of the circular doubly-linked lists
+		/// of the slots of a TimerWheel: each slot is the sentinel of its list.
+		struct TimerLink {
+			/**
+			 *   @brief Constructor. The link is alone, i.e. an empty list.
+			 */
+			inline TimerLink();
+
+			TimerLink(const TimerLink &) = delete;
+
+			TimerLink & operator=(const TimerLink &) = delete;
+
+			/**
+			 *   @brief Returns whether the list of this sentinel is empty.
+			 */
+			inline bool empty() const;
+
+			/**
+			 *   @brief Insert this link before link, i.e. at the back of the
+			 *          list if link is its sentinel.
+			 */
+			inline void linkBefore(TimerLink &link);
+
+			/**
+			 *   @brief Remove this link from its list.
+			 */
+			inline void unlink();
+
+			/**
+			 *   @brief Move all the links of the list of sentinel other to the
+			 *          list of this sentinel, which must be empty.
+			 */
+			inline void take(TimerLink &other);
+
+			TimerLink  *prev; ///< The previous link.
+			TimerLink  *next; ///< The next link.
+		};
+
+		/// The TimerNode struct is a task scheduled on a TimerWheel, shared by
+		/// the wheel, the task submitted when it fires and the handles.
+		struct TimerNode : public TimerLink {
+			/// The states of a timer.
+			enum State {
+				ARMED,     ///< Waiting in the wheel.
+				FIRED,     ///< Submitted to the pool.
+				RUNNING,   ///< Being run.
+				CANCELLED, ///< Cancelled: it will not run (again).
+				DONE       ///< Run (one-shot timers only).
+			};
+
+			/**
+			 *   @brief Constructor.
+			 *   @param w        The wheel.
+			 *   @param t        The task. (move)
+			 *   @param p        The period in ticks, 0 for one-shot timers.
+			 */
+			inline TimerNode(TimerWheel &w, Task &&t, const std::uint64_t p);
+
+			TimerWheel                  *wheel;  ///< The wheel.
+			Task                         task;   ///< The task, run at each expiry.
+			std::uint64_t                expiry; ///< The tick of the next expiry. Guarded by the mutex of the wheel.
+			std::uint64_t                period; ///< The period in ticks, 0 for one-shot timers.
+			std::atomic_int              state;  ///< The State of the timer.
+			std::shared_ptr<TimerNode>   self;   ///< The reference held by the wheel while armed.
+		};
+
+		/// The TimerTask class is the task submitted to the pool when a timer
+		/// fires: it runs the task of the timer, unless cancelled meanwhile,
+		/// and re-arms periodic timers.
+		class TimerTask {
+		public:
+			explicit inline TimerTask(std::shared_ptr<TimerNode> &&node);
+
+			inline void operator()();
+
+		private:
+			std::shared_ptr<TimerNode>  _node; ///< The timer.
+		};
+
+		/// A fired timer runs rather than being discarded: periodic timers
+		/// re-arm when they run.
+		template < >
+		struct IsDiscardable<TimerTask> : std::false_type { };
+
+		/// The TimerWheel class is a hierarchical timing wheel (Varghese and
+		/// Lauck) scheduling the tasks of a MPMCThreadPool at given times.
+		/// Time is divided in ticks of TICK_NS nanoseconds; level l has
+		/// N_SLOTS slots of N_SLOTS^l ticks each, so that inserting and
+		/// cancelling a timer take constant time, whatever the number of
+		/// timers. Level 0 holds the timers expiring in the next N_SLOTS
+		/// ticks, one slot per tick; whenever the current tick crosses a slot
+		/// of an upper level, its timers are cascaded to the lower ones.
+		/// A single thread, started with the first timer, advances the wheel:
+		/// it sleeps until the next non-empty slot of level 0 (or the next
+		/// cascade) and submits the expired tasks to the pool in bulk, where
+		/// the threads of the pool run them.
+		class TimerWheel {
+		public:
+			using Clock = std::chrono::steady_clock;
+
+			/// Duration of a tick in nanoseconds.
+			static constexpr std::int64_t TICK_NS = 1000000;
+			/// Number of bits of the slot index of a level.
+			static constexpr std::size_t SLOT_BITS = 6;
+			/// Number of slots of a level.
+			static constexpr std::size_t N_SLOTS = std::size_t(1) << SLOT_BITS;
+			/// Number of levels: the wheel spans 2^36 ticks (more than two
+			/// years), later timers are cascaded until they fit.
+			static constexpr std::size_t N_LEVELS = 6;
+
+			/**
+			 *   @brief Constructor.
+			 *   @param pool     The pool to submit the expired tasks to.
+			 */
+			explicit inline TimerWheel(MPMCThreadPool &pool);
+
+			TimerWheel(const TimerWheel &) = delete;
+
+			/**
+			 *   @brief Destructor. It stops the thread and drops the timers.
+			 */
+			inline ~TimerWheel();
+
+			TimerWheel & operator=(const TimerWheel &) = delete;
+
+			/**
+			 *   @brief Schedule task at time, and then every period if it is
+			 *          not zero. A task due already is submitted at once.
+			 *   @return The timer.
+			 */
+			inline std::shared_ptr<TimerNode> schedule(const Clock::time_point time, const Clock::duration period, Task &&task);
+
+			/**
+			 *   @brief Cancel a timer.
+			 *   @return true if the task will not run (again), false if it has
+			 *           already run or started, or if it was cancelled.
+			 */
+			inline bool cancel(TimerNode &node);
+
+			/**
+			 *   @brief Arm a periodic timer again after running its task,
+			 *          unless cancelled meanwhile.
+			 */
+			inline void rearm(const std::shared_ptr<TimerNode> &node);
+
+			/**
+			 *   @brief Stop the thread: no timer expires afterwards.
+			 */
+			inline void stop();
+
+			/**
+			 *   @brief Returns the number of armed timers.
+			 */
+			inline std::size_t size() const;
+
+		private:
+			/**
+			 *   @brief Returns the first tick not before time.
+			 */
+			inline std::uint64_t ticks(const Clock::time_point time) const;
+
+			/**
+			 *   @brief Returns the number of whole ticks elapsed since the
+			 *          start.
+			 */
+			inline std::uint64_t elapsedTicks() const;
+
+			/**
+			 *   @brief Link node into the slot of its expiry, which is after
+			 *          the current tick. Call it holding _mutex.
+			 */
+			inline void insert(TimerNode &node);
+
+			/**
+			 *   @brief Advance the current tick by one, cascading the timers
+			 *          of the upper levels as needed and collecting the
+			 *          expired tasks. Call it holding _mutex.
+			 */
+			inline void advance(std::vector<Task> &fired);
+
+			/**
+			 *   @brief The job of the thread advancing the wheel.
+			 */
+			inline void run();
+
+			MPMCThreadPool           *_pool;     ///< The pool to submit the expired tasks to.
+			const Clock::time_point   _start;    ///< The time of tick 0.
+			std::uint64_t             _current;  ///< The last tick processed.
+			std::uint64_t             _wakeTick; ///< The tick the thread sleeps until.
+			std::size_t               _size;     ///< The number of armed timers.
+			std::array<std::array<TimerLink, N_SLOTS>, N_LEVELS> _slots; ///< The slots of each level.
+			mutable std::mutex        _mutex;    ///< Mutex guarding the wheel.
+			std::condition_variable   _condVar;  ///< Condition variable for the thread to sleep until the next expiry.
+			std::thread               _thread;   ///< The thread advancing the wheel, started with the first timer.
+			bool                      _running;  ///< Whether the thread has been started.
+			bool                      _stopped;  ///< Whether the thread has been stopped.
+		};
+
+
+
+		/// The TokenRegistry class owns the producer tokens that the threads
+		/// submitting to the shared queue of a pool use implicitly. Tokens are
+		/// created on the first submission of a thread and destroyed when the
+		/// thread exits, so that the queue recycles their sub-queues, or when
+		/// the pool is destroyed, whichever comes first.
+		class TokenRegistry {
+		public:
+			/**
+			 *   @brief Constructor.
+			 *   @param queue    The queue of the tokens.
+			 */
+			explicit inline TokenRegistry(ConcurrentQueue<SimpleTaskType> &queue);
+
+			TokenRegistry(const TokenRegistry &) = delete;
+
+			TokenRegistry & operator=(const TokenRegistry &) = delete;
+
+			/**
+			 *   @brief Create a token for the calling thread.
+			 *   @return The token, nullptr if the registry is closed.
+			 */
+			inline ProducerToken * acquire();
+
+			/**
+			 *   @brief Destroy a token, unless the registry is closed, i.e.
+			 *          it has been destroyed already.
+			 */
+			inline void release(ProducerToken *token);
+
+			/**
+			 *   @brief Destroy all the tokens, while the queue is still alive.
+			 */
+			inline void close();
+
+			/**
+			 *   @brief Returns whether the registry is closed.
+			 */
+			inline bool closed() const;
+
+		private:
+			mutable std::mutex                           _mutex;  ///< Mutex guarding the registry.
+			ConcurrentQueue<SimpleTaskType>             *_queue;  ///< The queue, nullptr once closed.
+			std::vector<std::unique_ptr<ProducerToken>>  _tokens; ///< The tokens.
+		};
+
+		/// The TokenCache class holds the producer tokens of a thread, one per
+		/// pool it submits to, and gives them back when the thread exits.
+		class TokenCache {
+		public:
+			inline TokenCache();
+
+			TokenCache(const TokenCache &) = delete;
+
+			/**
+			 *   @brief Destructor. It gives back the tokens.
+			 */
+			inline ~TokenCache();
+
+			TokenCache & operator=(const TokenCache &) = delete;
+
+			/**
+			 *   @brief Returns the token of the calling thread from registry,
+			 *          creating it on the first call, nullptr if the registry
+			 *          is closed.
+			 */
+			inline ProducerToken * get(const std::shared_ptr<TokenRegistry> &registry);
+
+		private:
+			/// A token and its registry, kept alive so that its address is
+			/// not reused by the registry of another pool.
+			struct Entry {
+				std::shared_ptr<TokenRegistry>  registry; ///< The registry.
+				ProducerToken                  *token;    ///< The token.
+			};
+
+			std::vector<Entry>  _entries; ///< The tokens of the thread.
+		};
+
+		/**
+		 *   @brief Returns the TokenCache of the calling thread.
+		 */
+		inline TokenCache & tokenCache();
+
+	}
+
+	////////////////////////////////////////////////////////////////////////////
+
+
+
+	/// The MPMCThreadPool class (i.e. BasicThreadPool<Task, DefaultPoolPolicy>)
+	/// represents a pool of a fixed number of threads.
+	/// Threads are instantiated and invoked when a MPMCThreadPool object is
+	/// constructed and they are kept alive for the whole lifetime of the thread
+	/// pool.
+	/// At any time, any instantiated thread either is performing a task or is
+	/// wating for a new task to perform to become available.
+	/// Users of the thread pool can post tasks and, possibly, wait for their
+	/// completion.
+	/// The thread pool keeps a lock-free queue of move-only tasks allowing for
+	/// fast single post or bulk post (which is faster than multiple single
+	/// enqueuings). For further information on such performant lock-free
+	/// queue see https://github.com/cameron314/concurrentqueue
+	/// This thread pool is completely thread-safe and multiple producers can
+	/// post tasks independently without needing to sinchronize.
+	/// For slightly better performance, each producer (i.e. a user that posts
+	/// tasks and runs in a given thread) can get and specify a token allowing
+	/// faster enqueuing.
+	/// Optionally, the pool can work in work-stealing mode: each thread owns a
+	/// local deque where tasks submitted from inside a task are pushed, and
+	/// that the owner consumes in LIFO order for cache locality; idle threads
+	/// steal in FIFO order from the deques of random victims before falling
+	/// back to the shared queue.
+	/// Tasks can be submitted with a priority level: the pool keeps a queue
+	/// per level and the threads poll them from the highest to the lowest.
+	/// In order not to starve the lowest levels, periodically each thread
+	/// polls them in reverse order.
+	/// Threads can be pinned to CPUs, either explicitly or by an
+	/// AffinityPolicy. Pinned threads are grouped by the NUMA node of their
+	/// CPU: each node has its own queue, that the threads of the node poll
+	/// before the shared one, where tasks touching node-local memory can be
+	/// submitted. Pinning is supported on Linux only, elsewhere it is ignored.
+	/// Tasks that block, e.g. on file reads, can be submitted to a separate
+	/// blocking lane, a pool of its own, so that they do not hold the threads
+	/// running CPU-bound tasks. A task that has to block anyway can declare it
+	/// by a BlockingScope: the pool adds a thread meanwhile.
+	/// Tasks can be scheduled at a given time, after a delay or periodically:
+	/// they wait in a hierarchical timing wheel, advanced by a single thread,
+	/// and are submitted to the pool when due.
+	/// The number of pending tasks can be bounded, so that a fast producer
+	/// cannot grow the queues without limit: at the capacity, producers wait,
+	/// fail, run the task themselves or discard the oldest one.
+	/// Other instantiations of BasicThreadPool (see BasicThreadPool.hpp) run
+	/// tasks of a static type, without any type erasure, with the policies
+	/// chosen at compile time.
+	template < >
+	class BasicThreadPool<Task, DefaultPoolPolicy> {
+	public:
+
+		////////////////////////////////////////////////////////////////////////
+		// STATIC METHODS
+		////////////////////////////////////////////////////////////////////////
+
+		/**
+		 *   @brief Return the static default size of the pool, given by
+		 *          std::thread::hardware_concurrency();
+		 */
+		static inline std::size_t DEFAULT_SIZE();
+
+		/**
+		 *   @brief Return the static default maximum number of spins of an
+		 *          idle thread before yielding.
+		 */
+		static inline std::size_t DEFAULT_MAX_SPINS();
+
+		/**
+		 *   @brief Return the static default number of task dequeues of a
+		 *          thread between two polls of the priority levels in reverse
+		 *          order.
+		 */
+		static inline std::size_t DEFAULT_AGING_PERIOD();
+
+		/**
+		 *   @brief Return the static default maximum number of tasks a thread
+		 *          dequeues at once from the queue of the lowest priority
+		 *          level.
+		 */
+		static inline std::size_t DEFAULT_MAX_BATCH_SIZE();
+
+		/**
+		 *   @brief Return the static default number of threads of the blocking
+		 *          lane, given by DEFAULT_SIZE().
+		 */
+		static inline std::size_t DEFAULT_BLOCKING_SIZE();
+
+		/**
+		 *   @brief Return the static default number of tasks the queue of each
+		 *          priority level has room for when the pool is constructed,
+		 *          i.e. 32 blocks of ConcurrentQueue.
+		 */
+		static inline std::size_t DEFAULT_QUEUE_CAPACITY();
+
+		////////////////////////////////////////////////////////////////////////
+
+
+
+		////////////////////////////////////////////////////////////////////////
+		// CONSTRUCTORS
+		////////////////////////////////////////////////////////////////////////
+
+		/**
+		 *   @brief Default constructor. It instantiates and invokes
+		 *          DEFAULT_SIZE() threads.
+		 */
+		inline BasicThreadPool();
+
+		/**
+		 *   @brief Default constructor. It instantiates and invokes size
+		 *          threads.
+		 *   @param size      The initial number of threads.
+		 */
+		explicit inline BasicThreadPool(const std::size_t size);
+
+		/**
+		 *   @brief Constructor. It instantiates and invokes size threads, and
+		 *          it sets up a queue for each priority level.
+		 *   @param size        The initial number of threads.
+		 *   @param nPriorities The number of priority levels (at least 1).
+		 */
+		inline BasicThreadPool(const std::size_t size, const std::size_t nPriorities);
+
+		/**
+		 *   @brief Constructor. It instantiates and invokes size threads, and
+		 *          it sets up a queue for each priority level, allocating
+		 *          room for queueCapacity tasks in advance, so that bursts up
+		 *          to that size do not allocate. The queues still grow
+		 *          beyond it, unless bounded by setCapacity.
+		 *   @param size          The initial number of threads.
+		 *   @param nPriorities   The number of priority levels (at least 1).
+		 *   @param queueCapacity The number of tasks to allocate room for in
+		 *                        the queue of each priority level.
+		 */
+		inline BasicThreadPool(const std::size_t size, const std::size_t nPriorities, const std::size_t queueCapacity);
+
+		/**
+		 *   @brief Copy constructor. MPMCThreadPools can't be copied.
+		 */
+		BasicThreadPool(const MPMCThreadPool &other) = delete;
+
+		/**
+		 *   @brief Move constructor. MPMCThreadPools can't be moved.
+		 */
+		BasicThreadPool(MPMCThreadPool &&other) = default;
+
+		////////////////////////////////////////////////////////////////////////
+
+
+
+		////////////////////////////////////////////////////////////////////////
+		// DESTRUCTOR
+		////////////////////////////////////////////////////////////////////////
+
+		/**
+		 *   @brief Default destructor. It stops and deletes the active threads,
+		 *          and waits for the ones being removed, then destroys the
+		 *          blocking lane.
+		 *          Any pending tasks are not processed but deleted, timed
+		 *          tasks included: call drain() first to run them.
+		 */
+		inline ~BasicThreadPool();
+
+		////////////////////////////////////////////////////////////////////////
+
+
+
+		////////////////////////////////////////////////////////////////////////
+		// ASSIGNMENT OPERATORS
+		////////////////////////////////////////////////////////////////////////
+
+		/**
+		 *   @brief Copy assignment operator. MPMCThreadPools can't be copied.
+		 */
+		MPMCThreadPool & operator=(const MPMCThreadPool &other) = delete;
+
+		/**
+		 *   @brief Move assignment operator. MPMCThreadPools can't be moved.
+		 */
+		MPMCThreadPool & operator=(MPMCThreadPool &&other) = default;
+
+		////////////////////////////////////////////////////////////////////////
+
+
+
+		////////////////////////////////////////////////////////////////////////
+		// SIZE-RELATED METHODS
+		////////////////////////////////////////////////////////////////////////
+
+		/**
+		 *   @brief Returns the size of the pool.
+		 */
+		inline std::size_t size() const;
+
+		/**
+		 *   @brief Increase the size of the pool with n new threads. The new
+		 *          threads are activated and start soon to process tasks.
+		 *   @param n         The number of new threads to add.
+		 */
+		inline void expand(const std::size_t n);
+
+		/**
+		 *   @brief Decrease the size of the pool by removing n threads. It
+		 *          actually stops n threads (after they complete the tasks they
+		 *          are working on), without waiting for them: it can be called
+		 *          from a task as well.
+		 *   @param n         The number of new threads to remove.
+		 *   @note If the shrink leads to 0 threads and the queue is not empty
+		 *         the remaining tasks are not processed until new threads are
+		 *         are added by calling 'expand(n)' with n > 0.
+		 */
+		inline void shrink(const std::size_t n);
+
+		/**
+		 *   @brief Make the pool elastic: a supervising thread checks the load
+		 *          every policy.period and adds threads, up to policy.maxSize,
+		 *          when no thread is parked and either the queued tasks exceed
+		 *          policy.maxQueueDepth per thread or the delay of a probe
+		 *          task exceeds policy.maxLatency. When some threads have
+		 *          been parked at every check for policy.idleTimeout, as many
+		 *          as were always parked are removed, down to policy.minSize,
+		 *          without waiting for them. The size is brought within the
+		 *          bounds at once.
+		 *   @param policy    The elastic policy.
+		 *   @note Throws std::invalid_argument if policy.minSize is greater
+		 *         than policy.maxSize.
+		 */
+		inline void setElastic(const ElasticPolicy &policy);
+
+		/**
+		 *   @brief Stop adapting the size of the pool, which keeps its
+		 *          current number of threads.
+		 */
+		inline void disableElastic();
+
+		/**
+		 *   @brief Returns whether the pool is elastic.
+		 */
+		inline bool elastic() const;
+
+		////////////////////////////////////////////////////////////////////////
+
+
+
+		////////////////////////////////////////////////////////////////////////
+		// BLOCKING LANE
+		////////////////////////////////////////////////////////////////////////
+
+		/**
+		 *   @brief Returns the pool of the blocking lane, creating it with
+		 *          blockingSize() threads on first use. It has the same
+		 *          interface as any pool (e.g. 'blockingPool().submit(f)' for
+		 *          a future), and it can be resized or made elastic
+		 *          independently of this one. Threads of the blocking lane are
+		 *          not replaced when they block in a BlockingScope.
+		 */
+		inline MPMCThreadPool & blockingPool();
+
+		/**
+		 *   @brief Submit a task that blocks (e.g. on I/O) to the blocking
+		 *          lane, so that it does not hold a thread of this pool.
+		 *   @param task      The task to move into the queue of the lane.
+		 */
+		inline void submitBlocking(SimpleTaskType &&task);
+
+		/**
+		 *   @brief Set the number of threads of the blocking lane, resizing it
+		 *          if it already exists.
+		 *   @param n         The number of threads of the lane.
+		 */
+		inline void setBlockingSize(const std::size_t n);
+
+		/**
+		 *   @brief Returns the number of threads of the blocking lane (also
+		 *          before it is created).
+		 */
+		inline std::size_t blockingSize() const;
+
+		////////////////////////////////////////////////////////////////////////
+
+
+
+		////////////////////////////////////////////////////////////////////////
+		// SETTINGS
+		////////////////////////////////////////////////////////////////////////
+
+		/**
+		 *   @brief Enable or disable the work-stealing mode. When enabled,
+		 *          tasks submitted from a thread of this pool are pushed into
+		 *          its local deque instead of the shared queue. Idle threads
+		 *          steal from the local deques of the others. Disabled by
+		 *          default.
+		 *   @param enabled   Whether the work-stealing mode is enabled.
+		 */
+		inline void setWorkStealing(const bool enabled);
+
+		/**
+		 *   @brief Returns whether the work-stealing mode is enabled.
+		 */
+		inline bool workStealing() const;
+
+		/**
+		 *   @brief Set what the threads do when they find no task. The
+		 *          default is IdlePolicy::Block.
+		 *   @param policy    The idle policy.
+		 */
+		inline void setIdlePolicy(const IdlePolicy policy);
+
+		/**
+		 *   @brief Returns the idle policy.
+		 */
+		inline IdlePolicy idlePolicy() const;
+
+		/**
+		 *   @brief Set the maximum number of spins of an idle thread before
+		 *          yielding. With IdlePolicy::SpinThenPark each thread spins
+		 *          at most this many times, fewer if spinning recently did not
+		 *          find any task. With IdlePolicy::BusyPoll each thread always
+		 *          spins this many times between yields. The default is
+		 *          DEFAULT_MAX_SPINS().
+		 *   @param n         The maximum number of spins.
+		 */
+		inline void setMaxSpins(const std::size_t n);
+
+		/**
+		 *   @brief Returns the maximum number of spins of an idle thread.
+		 */
+		inline std::size_t maxSpins() const;
+
+		/**
+		 *   @brief Returns the number of priority levels.
+		 */
+		inline std::size_t nPriorities() const;
+
+		/**
+		 *   @brief Pin the threads to the CPUs according to a policy. It
+		 *          applies to the current threads as well as to the ones
+		 *          added later. The default is AffinityPolicy::None.
+		 *          Only the CPUs the process was allowed to run on when the
+		 *          topology was detected (e.g. by taskset or a cpuset) are
+		 *          used.
+		 *   @param policy    The affinity policy.
+		 *   @return true if every thread has been pinned (or unpinned),
+		 *           false if the OS refused or pinning is not supported.
+		 */
+		inline bool setAffinity(const AffinityPolicy policy);
+
+		/**
+		 *   @brief Pin the threads to the given CPUs: the i-th thread is
+		 *          pinned to cpus[i % cpus.size()]. It applies to the current
+		 *          threads as well as to the ones added later. An empty list
+		 *          unpins the threads, giving them back the CPUs of the
+		 *          process; threads never pinned are left untouched.
+		 *   @param cpus      The indices of the CPUs.
+		 *   @return true if every thread has been pinned (or unpinned),
+		 *           false if the OS refused (e.g. for a CPU outside the
+		 *           mask of the process) or pinning is not supported.
+		 *           Threads not pinned are not bound to any node.
+		 */
+		inline bool setAffinity(const std::vector<std::size_t> &cpus);
+
+		/**
+		 *   @brief Returns the number of NUMA nodes of the machine.
+		 */
+		inline std::size_t nNodes() const;
+
+		/**
+		 *   @brief Returns a snapshot of the state of the pool. Queue depths
+		 *          are always reported, while the counters of the threads are
+		 *          collected only if MPMC_TP_STATS is defined to 1.
+		 */
+		inline PoolStats stats() const;
+
+		/**
+		 *   @brief Zero the counters of the threads.
+		 */
+		inline void resetStats();
+
+		/**
+		 *   @brief Set how often the threads poll the priority levels in
+		 *          reverse order, so that the lowest ones are not starved by
+		 *          a steady flow of tasks with higher priority. The default is
+		 *          DEFAULT_AGING_PERIOD().
+		 *   @param n         The number of dequeues of a thread between two
+		 *                    polls in reverse order, 0 to never do it.
+		 */
+		inline void setAgingPeriod(const std::size_t n);
+
+		/**
+		 *   @brief Returns how often the threads poll the priority levels in
+		 *          reverse order.
+		 */
+		inline std::size_t agingPeriod() const;
+
+		/**
+		 *   @brief Set the maximum number of tasks a thread dequeues at once
+		 *          from the queue of the lowest priority level: it runs the
+		 *          first one and moves the others to its local deque, where
+		 *          idle threads can steal them. The size of the batches adapts
+		 *          to how many tasks are found, and threads take one task at a
+		 *          time while other threads are parked. The default is
+		 *          DEFAULT_MAX_BATCH_SIZE().
+		 *   @param n         The maximum number of tasks, 1 (or 0) to dequeue
+		 *                    one task at a time.
+		 */
+		inline void setMaxBatchSize(const std::size_t n);
+
+		/**
+		 *   @brief Returns the maximum number of tasks a thread dequeues at
+		 *          once.
+		 */
+		inline std::size_t maxBatchSize() const;
+
+		/**
+		 *   @brief Bound the number of pending tasks, i.e. submitted and not
+		 *          started yet, wherever they are queued: submitting beyond
+		 *          the capacity applies the overflow policy, while trySubmit
+		 *          fails. A batch larger than the capacity is let in whole
+		 *          when no task is pending. Tasks already pending when the
+		 *          capacity is set are not counted. The tasks the pool
+		 *          submits itself (fired timers, I/O completions,
+		 *          continuations, resumed coroutines and the successors of
+		 *          TaskGraph nodes) are always let in, and may exceed the
+		 *          capacity. The default is 0, i.e. unbounded, which costs
+		 *          nothing on submission.
+		 *   @param capacity  The maximum number of pending tasks, 0 for no
+		 *                    bound.
+		 *   @param policy    What submitting at the capacity does.
+		 */
+		inline void setCapacity(const std::size_t capacity, const OverflowPolicy policy = OverflowPolicy::Block);
+
+		/**
+		 *   @brief Returns the maximum number of pending tasks, 0 if unbounded.
+		 */
+		inline std::size_t capacity() const;
+
+		/**
+		 *   @brief Returns what submitting a task at the capacity does.
+		 */
+		inline OverflowPolicy overflowPolicy() const;
+
+		////////////////////////////////////////////////////////////////////////
+
+
+
+		////////////////////////////////////////////////////////////////////////
+		// METHODS FOR TASKS
+		////////////////////////////////////////////////////////////////////////
+
+		/**
+		 *   @brief Run one of the pending tasks in the calling thread, if any.
+		 *          A thread of the pool looks for it like it does between
+		 *          tasks, while any other thread takes it from the shared
+		 *          queues, from the highest priority level. An exception
+		 *          thrown by the task propagates to the caller.
+		 *   @return true if a task has been run, false otherwise.
+		 */
+		inline bool runPendingTask();
+
+		/**
+		 *   @brief Run the pending tasks in the calling thread too, alongside
+		 *          the threads of the pool, until none is left, then wait for
+		 *          the pool to be idle (see waitIdle).
+		 *          An exception thrown by a task run here propagates to the
+		 *          caller, leaving the other pending tasks in the pool: the
+		 *          task counts as done, so drain() can be called again.
+		 *   @note Throws std::logic_error if called from a thread of the pool.
+		 */
+		inline void drain();
+
+		/**
+		 *   @brief Wait until no task submitted to the pool, or to its blocking
+		 *          lane, is queued or running, including the tasks they
+		 *          submit meanwhile. Timed tasks count only once their time
+		 *          has come. It parks on a counter of the tasks in flight,
+		 *          woken up by the task bringing it to zero.
+		 *   @note Throws std::logic_error if called from a thread of the pool,
+		 *         whose task would wait for itself.
+		 */
+		inline void waitIdle();
+
+		/**
+		 *   @brief Returns the number of tasks queued or running.
+		 */
+		inline std::size_t nInFlight() const;
+
+		/**
+		 *   @brief Submit a single task, unless the pool is at its capacity:
+		 *          it never blocks, whatever the overflow policy.
+		 *   @param task      The task to submit. (move, only if submitted)
+		 *   @return true if the task has been submitted, false otherwise.
+		 */
+		inline bool trySubmit(SimpleTaskType &&task);
+
+		/**
+		 *   @brief Obtain a new producer token for posting tasks faster. It can
+		 *          be used for submitting tasks with the lowest priority only.
+		 *          Destroy it before the pool, so that its sub-queue is
+		 *          recycled. Tokens are not needed otherwise: submitting
+		 *          without one uses a token of the calling thread, created on
+		 *          its first submission and given back when it exits.
+		 */
+		inline ProducerToken newProducerToken();
+
+
+		/**
+		 *   @brief Submit a single task by moving it into the queue.
+		 *   @param task      The task to move into the queue.
+		 */
+		inline void submitTask(SimpleTaskType &&task);
+
+		/**
+		 *   @brief Submit a single task by moving it into the queue, specifying
+		 *          the producer token. This results in faster enqueuing.
+		 *   @param token     The producer token for faster enqueuing.
+		 *   @param task      The task to move into the queue.
+		 */
+		inline void submitTask(const ProducerToken &token, SimpleTaskType &&task);
+
+		/**
+		 *   @brief Submit a single task by moving it into the queue of the
+		 *          given priority level.
+		 *   @param priority  The priority level, from 0 (the lowest, used by
+		 *                    the other methods) to nPriorities() - 1.
+		 *   @param task      The task to move into the queue.
+		 *   @note Throws std::out_of_range if the priority level is not valid.
+		 */
+		inline void submitTask(const std::size_t priority, SimpleTaskType &&task);
+
+		/**
+		 *   @brief Submit a single task belonging to a group: once the group
+		 *          is cancelled, the task is skipped if it has not started
+		 *          yet.
+		 *   @param group     The group the task belongs to.
+		 *   @param f         The callable object to submit as task.
+		 */
+		template < class F >
+		inline void submitTask(const TaskGroup &group, F &&f);
+
+		/**
+		 *   @brief Submit a bulk of tasks. Pass a std::move_iterator, since
+		 *          tasks are moved into the queue.
+		 *   @param first     The iterator to the first task to enqueue.
+		 *   @param task      The iterator to the last task (except) to enqueue.
+		 */
+		template < class It >
+		inline void submitTasks(It first, It last);
+
+		/**
+		 *   @brief Submit a bulk of tasks, specifying the producer token. This
+		 *          results in faster enqueuing. Pass a std::move_iterator, since
+		 *          tasks are moved into the queue.
+		 *   @param token     The producer token for faster enqueuing.
+		 *   @param first     The iterator to the first task to enqueue.
+		 *   @param task      The iterator to the last task (except) to enqueue.
+		 */
+		template < class It >
+		inline void submitTasks(const ProducerToken &token, It first, It last);
+
+		/**
+		 *   @brief Submit a bulk of tasks into the queue of the given priority
+		 *          level. Pass a std::move_iterator, since tasks are moved into
+		 *          the queue.
+		 *   @param priority  The priority level, from 0 (the lowest, used by
+		 *                    the other methods) to nPriorities() - 1.
+		 *   @param first     The iterator to the first task to enqueue.
+		 *   @param task      The iterator to the last task (except) to enqueue.
+		 *   @note Throws std::out_of_range if the priority level is not valid.
+		 */
+		template < class It >
+		inline void submitTasks(const std::size_t priority, It first, It last);
+
+		/**
+		 *   @brief Submit a single task by moving it into the queue of a NUMA
+		 *          node. It is preferably performed by the threads pinned to
+		 *          the CPUs of that node, and by the others only when they
+		 *          have nothing else to do.
+		 *   @param node      The index of the NUMA node, less than nNodes().
+		 *   @param task      The task to move into the queue.
+		 *   @note Throws std::out_of_range if the node is not valid.
+		 */
+		inline void submitTaskToNode(const std::size_t node, SimpleTaskType &&task);
+
+		/**
+		 *   @brief Submit a bulk of tasks into the queue of a NUMA node. Pass a
+		 *          std::move_iterator, since tasks are moved into the queue.
+		 *   @param node      The index of the NUMA node, less than nNodes().
+		 *   @param first     The iterator to the first task to enqueue.
+		 *   @param task      The iterator to the last task (except) to enqueue.
+		 *   @note Throws std::out_of_range if the node is not valid.
+		 */
+		template < class It >
+		inline void submitTasksToNode(const std::size_t node, It first, It last);
+
+		/**
+		 *   @brief Submit a function as a task, returning a future for its
+		 *          result.
+		 *   @param f         The function to submit. (move)
+		 *   @param args      Possible parameters to bind to f. (move)
+		 *   @return The future holding the result of f (or the exception it
+		 *           throws) when the task completes.
+		 */
+		template < class F, class ...Args >
+		inline Future<internal::InvokeResult<F, Args...>> submit(F &&f, Args &&...args);
+
+		/**
+		 *   @brief Returns an awaitable that, when awaited by a coroutine,
+		 *          resumes it in a thread of the pool: 'co_await
+		 *          pool.schedule();'.
+		 *   @note Requires C++20 coroutines and MPMCThreadPool/Coroutines.hpp.
+		 */
+		inline ScheduleAwaiter schedule();
+
+		/**
+		 *   @brief Start a coroutine in a thread of the pool, returning a
+		 *          future for its result.
+		 *   @param task      The coroutine to run. (move)
+		 *   @return The future holding the result of the coroutine (or the
+		 *           exception it throws) when it completes.
+		 *   @note Requires C++20 coroutines and MPMCThreadPool/Coroutines.hpp.
+		 */
+		template < class T >
+		inline Future<T> spawn(CoroTask<T> &&task);
+
+		////////////////////////////////////////////////////////////////////////
+
+
+
+		////////////////////////////////////////////////////////////////////////
+		// METHODS FOR TIMED TASKS
+		////////////////////////////////////////////////////////////////////////
+
+		/**
+		 *   @brief Submit a task when the given time comes. Times have a
+		 *          resolution of a millisecond.
+		 *   @param time      The time to submit the task at. If it is past,
+		 *                    the task is submitted at once.
+		 *   @param task      The task to schedule. (move)
+		 *   @return The handle for cancelling the task.
+		 */
+		template < class Duration >
+		inline TimerHandle submitAt(const std::chrono::time_point<std::chrono::steady_clock, Duration> &time, SimpleTaskType &&task);
+
+		/**
+		 *   @brief Submit a task after the given delay.
+		 *   @param delay     The delay, rounded up to a millisecond.
+		 *   @param task      The task to schedule. (move)
+		 *   @return The handle for cancelling the task.
+		 */
+		template < class Rep, class Period >
+		inline TimerHandle submitAfter(const std::chrono::duration<Rep, Period> &delay, SimpleTaskType &&task);
+
+		/**
+		 *   @brief Submit a task periodically, the first time after one
+		 *          period, until cancelled. Runs never overlap: a run starting
+		 *          late delays the next ones, which are not made up for.
+		 *   @param period    The period, rounded up to a millisecond.
+		 *   @param task      The task to run at each period. (move)
+		 *   @return The handle for cancelling the task.
+		 */
+		template < class Rep, class Period >
+		inline TimerHandle submitEvery(const std::chrono::duration<Rep, Period> &period, SimpleTaskType &&task);
+
+		/**
+		 *   @brief Returns the number of timed tasks waiting for their time.
+		 */
+		inline std::size_t nTimers() const;
+
+		////////////////////////////////////////////////////////////////////////
+
+
+
+	private:
+		friend class BlockingScope;
+
+		friend void internal::resubmit(MPMCThreadPool &pool, SimpleTaskType &&task);
+
+		template < class It >
+		friend void internal::resubmit(MPMCThreadPool &pool, It first, It last);
+
+		using WorkerList = std::vector<std::shared_ptr<internal::Worker>>;
+
+		/// The InFlightScope class counts a task dequeued by the pool out of
+		/// the tasks in flight when it goes out of scope, once the task has
+		/// run, even if it throws.
+		class InFlightScope {
+		public:
+			/**
+			 *   @brief Constructor.
+			 *   @param pool     The pool the task has been dequeued from.
+			 *   @param task     The task.
+			 */
+			inline InFlightScope(MPMCThreadPool &pool, SimpleTaskType &task);
+
+			InFlightScope(const InFlightScope &) = delete;
+
+			/**
+			 *   @brief Destructor. It destroys the task, so that its captures
+			 *          are released before the pool may be found idle, and
+			 *          counts it out.
+			 */
+			inline ~InFlightScope();
+
+			InFlightScope & operator=(const InFlightScope &) = delete;
+
+		private:
+			MPMCThreadPool  *_pool; ///< The pool the task has been dequeued from.
+			SimpleTaskType  *_task; ///< The task.
+		};
+
+
+
+		////////////////////////////////////////////////////////////////////////
+		// PRIVATE METHODS
+		////////////////////////////////////////////////////////////////////////
+
+		/**
+		 *   @brief This specifies the job of the threads: they wait for tasks
+		 *          to be enqueued, dequeue one of them and perform it. They
+		 *          loop in this wait-dequeue-perform until the thread pool is
+		 *          destructed.
+		 *   @param worker    The state owned by the thread.
+		 */
+		inline void threadJob(internal::Worker &worker);
+
+		/**
+		 *   @brief Try to get the next task to perform: from the queues of the
+		 *          priority levels above the lowest, then from the local deque,
+		 *          then from the queue of its NUMA node, then from the local
+		 *          deques of the others, then from the queue of the lowest
+		 *          priority level (in batches), then from the queues of the
+		 *          other nodes.
+		 *          Periodically, the priority levels are polled in reverse
+		 *          order.
+		 *   @param worker    The worker looking for a task.
+		 *   @param task      Where to move the task.
+		 *   @return true if a task has been found, false otherwise.
+		 */
+		inline bool nextTask(internal::Worker &worker, SimpleTaskType &task);
+
+		/**
+		 *   @brief Spin and then yield while looking for the next task,
+		 *          according to the idle policy.
+		 *   @param worker    The worker looking for a task.
+		 *   @param task      Where to move the task.
+		 *   @param policy    The idle policy, other than IdlePolicy::Block.
+		 *   @return true if a task has been found, false otherwise.
+		 */
+		inline bool spinForTask(internal::Worker &worker, SimpleTaskType &task, const IdlePolicy policy);
+
+		/**
+		 *   @brief Run a task, updating the statistics of worker.
+		 */
+		inline void runTask(internal::Worker &worker, SimpleTaskType &task);
+
+		/**
+		 *   @brief Take room for n tasks within the capacity, if any,
+		 *          applying the overflow policy when there is not enough.
+		 *   @return The number of tasks to enqueue, fewer than n only with
+		 *           OverflowPolicy::CallerRuns: the caller runs the others.
+		 */
+		inline std::size_t admit(const std::size_t n);
+
+		/**
+		 *   @brief The capacity part of admit, which also counts the admitted
+		 *          tasks in flight.
+		 */
+		inline std::size_t reserve(const std::size_t n);
+
+		/**
+		 *   @brief Count n tasks submitted by the pool itself as pending, if
+		 *          the pool is bounded, and in flight, skipping the capacity.
+		 */
+		inline void admitInternal(const std::size_t n);
+
+		/**
+		 *   @brief Give back the room of a task taken from the queues, if the
+		 *          pool is bounded, and wake up a producer waiting for it.
+		 */
+		inline void release();
+
+		/**
+		 *   @brief Count a task out of the tasks in flight, once it has run or
+		 *          has been discarded, and wake up the threads waiting for the
+		 *          pool to be idle if it was the last one.
+		 */
+		inline void finish();
+
+		/**
+		 *   @brief Discard the oldest pending task of the shared queues, or
+		 *          run it in the calling thread if it is not discardable.
+		 *   @return true if a task has been discarded or run, false
+		 *           otherwise.
+		 */
+		inline bool dropOldest();
+
+		/**
+		 *   @brief Enqueue a task into the shared queue of the lowest priority
+		 *          level, with the producer token of the calling thread.
+		 */
+		inline void enqueue(SimpleTaskType &&task);
+
+		/**
+		 *   @brief Enqueue n tasks into the shared queue of the lowest priority
+		 *          level, with the producer token of the calling thread.
+		 */
+		template < class It >
+		inline void enqueueBulk(It first, const std::size_t n);
+
+		/**
+		 *   @brief Record the submission time of a task, if statistics are
+		 *          enabled.
+		 */
+		template < class T >
+		static inline void markSubmitted(T &&task);
+
+		/**
+		 *   @brief Record the submission time of a bulk of tasks, if
+		 *          statistics are enabled and they are already of type
+		 *          SimpleTaskType: other callable objects become tasks only
+		 *          when enqueued, without a submission time.
+		 */
+		template < class It >
+		static inline void markSubmitted(It first, It last);
+
+		template < class It >
+		static inline void markSubmitted(It first, It last, std::true_type);
+
+		template < class It >
+		static inline void markSubmitted(It first, It last, std::false_type);
+
+		/**
+		 *   @brief Try to dequeue a task from the queues of the NUMA nodes.
+		 *   @param worker    The worker looking for a task.
+		 *   @param task      Where to move the task.
+		 *   @param others    Whether to poll the queues of the other nodes
+		 *                    rather than the one of the node of worker.
+		 *   @return true if a task has been found, false otherwise.
+		 */
+		inline bool nodeTask(internal::Worker &worker, SimpleTaskType &task, const bool others);
+
+		/**
+		 *   @brief Try to dequeue a batch of tasks from the queue of the lowest
+		 *          priority level: the first one is returned, the others are
+		 *          pushed to the local deque of worker.
+		 *   @param worker    The worker looking for a task.
+		 *   @param task      Where to move the task.
+		 *   @return true if a task has been found, false otherwise.
+		 */
+		inline bool batchTask(internal::Worker &worker, SimpleTaskType &task);
+
+		/**
+		 *   @brief Pin the i-th thread according to the current affinity.
+		 *          Call it holding _flag.
+		 *   @return true if the thread has been pinned as required, or left
+		 *           alone, false if pinning has failed.
+		 */
+		inline bool applyAffinity(internal::Worker &worker, const std::size_t i);
+
+		/**
+		 *   @brief Returns the worker of this pool running in the calling
+		 *          thread if the work-stealing mode is enabled, nullptr
+		 *          otherwise.
+		 */
+		inline internal::Worker * localWorker() const;
+
+		/**
+		 *   @brief Try to steal a task from the local deque of a random victim.
+		 *   @param worker    The thief.
+		 *   @param task      Where to move the stolen task.
+		 *   @return true if a task has been stolen, false otherwise.
+		 */
+		inline bool stealTask(internal::Worker &worker, SimpleTaskType &task);
+
+		/**
+		 *   @brief Returns whether any task is waiting either in the queue or
+		 *          in the local deques, as seen by worker.
+		 *   @param worker    The worker checking for tasks.
+		 */
+		inline bool hasPendingTasks(internal::Worker &worker);
+
+		/**
+		 *   @brief Returns the approximate number of tasks in the shared
+		 *          queues.
+		 */
+		inline std::size_t queuedTasks() const;
+
+		/**
+		 *   @brief Join the removed threads which have exited. Call it holding
+		 *          _flag.
+		 */
+		inline void reapRetired();
+
+		/**
+		 *   @brief The job of the supervising thread of an elastic pool: it
+		 *          periodically checks the load, adding threads or removing
+		 *          the idle ones.
+		 */
+		inline void supervise();
+
+		/**
+		 *   @brief Stop the supervising thread, if running, and wait for it.
+		 */
+		inline void stopSupervisor();
+
+		/**
+		 *   @brief Add a thread replacing the one of worker, which is about to
+		 *          block, if no thread is parked and tasks are pending.
+		 *   @return true if a thread has been added, false otherwise.
+		 */
+		inline bool compensate(internal::Worker &worker);
+
+		////////////////////////////////////////////////////////////////////////
+
+
+
+		////////////////////////////////////////////////////////////////////////
+		// PRIVATE MEMBERS
+		////////////////////////////////////////////////////////////////////////
+
+		mutable std::atomic_flag           _flag;          ///< Atomic flag for lock-free mutual exclusion.
+		std::shared_ptr<const WorkerList>  _workers;       ///< Snapshot of the threads and their state, replaced on resize.
+		std::atomic_size_t                 _workersVersion;///< Incremented whenever _workers is replaced.
+		std::atomic_size_t                 _nActives;      ///< Number of active threads.
+		std::deque<ConcurrentQueue<SimpleTaskType>> _taskQueues; ///< Queues of tasks, one per priority level.
+		std::deque<ConcurrentQueue<SimpleTaskType>> _nodeQueues; ///< Queues of tasks, one per NUMA node (none if there is only one node).
+		WorkerList                         _retired;       ///< Threads removed from the pool and not yet joined.
+		std::vector<std::size_t>           _cpus;          ///< CPUs to pin the threads to, round-robin (empty for no pinning).
+		bool                               _pinned;        ///< Whether the threads have ever been pinned, so that unpinning must restore the CPUs of the process. Guarded by _flag.
+		std::atomic_bool                   _active;        ///< Signal for stopping the threads.
+		std::atomic_bool                   _workStealing;  ///< Whether tasks submitted by the threads go to their local deques.
+		std::atomic<IdlePolicy>            _idlePolicy;    ///< What the threads do when they find no task.
+		std::atomic_size_t                 _maxSpins;      ///< Maximum number of spins of an idle thread before yielding.
+		std::atomic_size_t                 _agingPeriod;   ///< Number of dequeues of a thread between two polls of the priority levels in reverse order.
+		std::atomic_size_t                 _maxBatchSize;  ///< Maximum number of tasks a thread dequeues at once.
+		std::atomic_bool                   _elastic;       ///< Whether the size adapts to the load.
+		ElasticPolicy                      _elasticPolicy; ///< How the size adapts to the load. Guarded by _flag.
+		std::atomic<std::int64_t>          _probeSubmitted;///< Submission time in nanoseconds of the pending latency probe, 0 if none.
+		std::atomic<std::int64_t>          _probeLatency;  ///< Delay in nanoseconds of the last latency probe.
+		std::thread                        _supervisor;    ///< The supervising thread, if elastic.
+		bool                               _supervising;   ///< Whether the supervising thread must keep running. Guarded by _supervisorMutex.
+		std::mutex                         _supervisorMutex;   ///< Mutex for starting and stopping the supervising thread.
+		std::condition_variable            _supervisorCondVar; ///< Condition variable for the supervising thread to wait for its next check.
+		internal::EventCount               _eventCount;    ///< Parking lot of the threads when the queue is empty.
+		std::atomic<MPMCThreadPool *>      _blockingPool;  ///< The pool of the blocking lane, nullptr until first used.
+		std::size_t                        _blockingSize;  ///< Number of threads of the blocking lane. Guarded by _flag.
+		bool                               _compensate;    ///< Whether threads blocking in a BlockingScope are replaced (false in a blocking lane).
+		internal::TimerWheel               _timers;        ///< The timed tasks.
+		std::atomic_size_t                 _capacity;      ///< Maximum number of pending tasks, 0 if unbounded.
+		std::atomic<OverflowPolicy>        _overflowPolicy;///< What submitting at the capacity does.
+		std::atomic_size_t                 _nPending;      ///< Number of pending tasks submitted while bounded.
+		std::atomic<std::uint64_t>         _nDropped;      ///< Number of tasks discarded by OverflowPolicy::DropOldest.
+		internal::EventCount               _roomEventCount;///< Parking lot of the producers waiting for room.
+		std::atomic_size_t                 _nInFlight;     ///< Number of tasks queued or running.
+		internal::EventCount               _idleEventCount;///< Parking lot of the threads waiting for the pool to be idle.
+		std::shared_ptr<internal::TokenRegistry> _producerTokens; ///< The producer tokens of the threads submitting to the shared queue.
+#if MPMC_TP_STATS
+		WorkerStats                        _retiredStats;  ///< Sum of the statistics of the removed threads.
+#endif
+
+		////////////////////////////////////////////////////////////////////////
+
+	};
+
+
+
+
+
+
+	////////////////////////////////////////////////////////////////////////////
+	// TIMER HANDLE
+	////////////////////////////////////////////////////////////////////////////
+
+	/// The TimerHandle class refers to a task scheduled by
+	/// MPMCThreadPool::submitAt, submitAfter or submitEvery, for cancelling
+	/// it. Handles can be copied and dropped freely, but must not be used
+	/// after the pool is destroyed.
+	class TimerHandle {
+	public:
+		/**
+		 *   @brief Default constructor. The handle refers to no task.
+		 */
+		inline TimerHandle();
+
+		/**
+		 *   @brief Cancel the task: a one-shot task which has not started yet
+		 *          does not run, a periodic task does not run again.
+		 *   @return true if the task will not run (again), false if it has
+		 *           already started or run, or if it was cancelled already.
+		 */
+		inline bool cancel();
+
+		/**
+		 *   @brief Returns whether the task is going to run (again).
+		 */
+		inline bool pending() const;
+
+	private:
+		friend MPMCThreadPool;
+
+		/**
+		 *   @brief Constructor from the timer.
+		 */
+		explicit inline TimerHandle(std::shared_ptr<internal::TimerNode> node);
+
+		std::shared_ptr<internal::TimerNode>  _node; ///< The timer, null if none.
+	};
+
+	////////////////////////////////////////////////////////////////////////////
+
+
+
+	////////////////////////////////////////////////////////////////////////////
+	// BLOCKING SCOPE
+	////////////////////////////////////////////////////////////////////////////
 
+	/// The BlockingScope class declares that the task running in the calling
+	/// thread is about to block (e.g. waiting for a file read or for a lock
+	/// held elsewhere) for the lifetime of the object. If the thread belongs
+	/// to a pool where no thread is parked and tasks are pending, the pool is
+	/// expanded by a compensation thread, which is removed again when the
+	/// scope ends, so that CPU-bound tasks keep running on as many threads as
+	/// before. Elsewhere it does nothing.
+	/// For tasks known in advance to block, MPMCThreadPool::submitBlocking is
+	/// cheaper.
+	class BlockingScope {
+	public:
 		/**
-		 *   @brief Obtain a new producer token for posting tasks faster.
+		 *   @brief Constructor. It adds a thread to the pool of the calling
+		 *          thread, if needed.
 		 */
-		inline ProducerToken newProducerToken();
+		inline BlockingScope();
 
+		/**
+		 *   @brief Copy constructor deleted.
+		 */
+		BlockingScope(const BlockingScope &) = delete;
 
 		/**
-		 *   @brief Submit a single task by copying it into the queue.
-		 *   @param task      The task to copy into the queue.
+		 *   @brief Destructor. It removes the added thread, if any, without
+		 *          waiting for it.
 		 */
-		inline void submitTask(const SimpleTaskType &task);
+		inline ~BlockingScope();
 
 		/**
-		 *   @brief Submit a single task by moving it into the queue.
-		 *   @param task      The task to move into the queue.
+		 *   @brief Copy assignment operator deleted.
 		 */
-		inline void submitTask(SimpleTaskType &&task);
+		BlockingScope & operator=(const BlockingScope &) = delete;
 
 		/**
-		 *   @brief Submit a single task by copying it into the queue, specifying
-		 *          the producer token. This results in faster enqueuing.
-		 *   @param token     The producer token for faster enqueuing.
-		 *   @param task      The task to copy into the queue.
+		 *   @brief Returns whether a thread has been added.
 		 */
-		inline void submitTask(const ProducerToken &token, const SimpleTaskType &task);
+		inline bool compensated() const;
+
+	private:
+		MPMCThreadPool  *_pool; ///< The pool a thread has been added to, nullptr if none.
+	};
+
+	////////////////////////////////////////////////////////////////////////////
 
+
+
+	////////////////////////////////////////////////////////////////////////////
+	// CANCELLATION
+	////////////////////////////////////////////////////////////////////////////
+
+	/// The StopToken class lets a running task poll whether the TaskGroup or
+	/// the TaskPack it belongs to has been cancelled, so that long tasks can
+	/// give up early. Polling is a relaxed load of a flag.
+	class StopToken {
+	public:
 		/**
-		 *   @brief Submit a single task by moving it into the queue, specifying
-		 *          the producer token. This results in faster enqueuing.
-		 *   @param token     The producer token for faster enqueuing.
-		 *   @param task      The task to move into the queue.
+		 *   @brief Default constructor. The token is never stopped.
 		 */
-		inline void submitTask(const ProducerToken &token, SimpleTaskType &&task);
+		inline StopToken();
 
 		/**
-		 *   @brief Submit a bulk of tasks. Pass a std::move_iterator for moving
-		 *          tasks into the queue.
-		 *   @param first     The iterator to the first task to enqueue.
-		 *   @param task      The iterator to the last task (except) to enqueue.
+		 *   @brief Constructor from the flag to poll.
+		 *   @param flag      The flag set on cancellation, shared with its
+		 *                    owner, or aliasing an object outliving the
+		 *                    token.
 		 */
-		template < class It >
-		inline void submitTasks(It first, It last);
+		explicit inline StopToken(std::shared_ptr<const std::atomic_bool> flag);
 
 		/**
-		 *   @brief Submit a bulk of tasks, specifying the producer token. This
-		 *          results in faster enqueuing. Pass a std::move_iterator for
-		 *          moving tasks into the queue.
-		 *   @param token     The producer token for faster enqueuing.
-		 *   @param first     The iterator to the first task to enqueue.
-		 *   @param task      The iterator to the last task (except) to enqueue.
+		 *   @brief Returns whether the group of the token has been cancelled.
 		 */
-		template < class It >
-		inline void submitTasks(const ProducerToken &token, It first, It last);
+		inline bool stopRequested() const;
 
-		////////////////////////////////////////////////////////////////////////
+		/**
+		 *   @brief Returns whether the token refers to a group at all.
+		 */
+		inline bool stopPossible() const;
 
+	private:
+		std::shared_ptr<const std::atomic_bool>  _flag; ///< The flag set on cancellation, null if none.
+	};
 
 
-	private:
 
-		////////////////////////////////////////////////////////////////////////
-		// PRIVATE METHODS
-		////////////////////////////////////////////////////////////////////////
+	namespace internal {
 
-		/**
-		 *   @brief This specifies the job of the threads: they wait for tasks
-		 *          to be enqueued, dequeue one of them and perform it. They
-		 *          loop in this wait-dequeue-perform until the thread pool is
-		 *          destructed.
-		 */
-		inline void threadJob(std::atomic_bool &active);
+		/// The GroupTask class is the callable object wrapping a task of a
+		/// TaskGroup: it runs the task unless the group has been cancelled
+		/// meanwhile, in which case the task is dropped without running.
+		template < class F >
+		class GroupTask {
+		public:
+			/**
+			 *   @brief Constructor.
+			 *   @param flag     The flag of the group.
+			 *   @param f        The callable object to run. (move)
+			 */
+			inline GroupTask(std::shared_ptr<const std::atomic_bool> flag, F &&f);
 
-		////////////////////////////////////////////////////////////////////////
+			/**
+			 *   @brief Run the task, unless the group has been cancelled.
+			 */
+			inline void operator()();
 
+		private:
+			std::shared_ptr<const std::atomic_bool>  _flag; ///< The flag of the group.
+			F                                        _f;    ///< The callable object to run.
+		};
 
+	}
 
-		////////////////////////////////////////////////////////////////////////
-		// PRIVATE MEMBERS
-		////////////////////////////////////////////////////////////////////////
 
-		mutable std::atomic_flag         _flag;     ///< Atomic flag for lock-free mutual exclusion.
-		std::deque<std::thread>          _threads;  ///< Array of thread objects.
-		std::deque<std::atomic_bool>     _actives;  ///< Signals for stopping the threads.
-		std::atomic_size_t               _nActives; ///< Number of active threads.
-		ConcurrentQueue<SimpleTaskType>  _taskQueue;///< Queue of tasks.
-		std::atomic_bool                 _active;   ///< Signal for stopping the threads.
-		std::mutex                       _mutex;    ///< Mutex for blocking the threads when the queue is empty.
-		std::condition_variable          _condVar;  ///< Condition variable for thread wakeup when the queue is no more empty.
 
-		////////////////////////////////////////////////////////////////////////
+	/// The TaskGroup class is a set of tasks, possibly submitted to different
+	/// pools, that can be cancelled all together, e.g. when the client they
+	/// work for disconnects: the tasks that have not started yet are skipped
+	/// when the pool dequeues them, without running, and the running ones can
+	/// poll a StopToken of the group to give up early.
+	/// Copies refer to the same group. Cancellation cannot be undone: use a
+	/// new group for the next tasks.
+	///
+	/// @code
+	/// TaskGroup group;
+	/// StopToken token = group.token();
+	/// for (std::size_t i = 0; i < n; ++i)
+	///     pool.submitTask(group, [=]() {
+	///         for (std::size_t j = 0; j < m && !token.stopRequested(); ++j)
+	///             work(i, j);
+	///     });
+	/// // ...
+	/// group.cancel();
+	/// @endcode
+	class TaskGroup {
+	public:
+		/**
+		 *   @brief Default constructor. It creates a new group.
+		 */
+		inline TaskGroup();
 
-	};
+		/**
+		 *   @brief Wrap a callable object into a task of the group, to be
+		 *          submitted with any method of the pool.
+		 *   @param f         The callable object to wrap. (move)
+		 *   @return The task, which does not run f if the group has been
+		 *           cancelled by then.
+		 */
+		template < class F >
+		inline internal::GroupTask<typename std::decay<F>::type> wrap(F &&f) const;
+
+		/**
+		 *   @brief Cancel the group: its tasks which have not started yet will
+		 *          not run, and its tokens are stopped.
+		 */
+		inline void cancel();
+
+		/**
+		 *   @brief Returns whether the group has been cancelled.
+		 */
+		inline bool cancelled() const;
 
+		/**
+		 *   @brief Returns a token for polling the cancellation of the group
+		 *          from its running tasks.
+		 */
+		inline StopToken token() const;
 
+	private:
+		std::shared_ptr<std::atomic_bool>  _cancelled; ///< Whether the group has been cancelled, shared by its tasks and tokens.
+	};
 
+	////////////////////////////////////////////////////////////////////////////
 
 
 
@@ -347,10 +2247,12 @@ namespace mpmc_tp {
 		////////////////////////////////////////////////////////////////////////
 
 		/**
-		 *   @brief Set the size.
+		 *   @brief Set the size, and zero the number of completed tasks.
 		 *   @param size The size corresponds to the number of packed tasks.
+		 *   @note Not thread-safe: call it only while no task of the pack
+		 *         runs and no thread waits for it.
 		 */
-		inline void setTraitsSize(const std::size_t size);
+		virtual inline void setTraitsSize(const std::size_t size);
 
 		/**
 		 *   @brief Set the interval between a check for completion and next one.
@@ -399,6 +2301,8 @@ namespace mpmc_tp {
 		 *   @brief Wait for the packed tasks to complete. It is lock-free,
 		 *          relying on a loop, so it is better to use this traits for 
 		 *          few, short tasks. Call this from the task producer.
+		 *          Called from a thread of a pool, it runs the pending tasks
+		 *          of the pool while waiting.
 		 */
 		virtual inline void wait() const;
 
@@ -413,7 +2317,7 @@ namespace mpmc_tp {
 		virtual inline void waitComplete() const;
 
 		std::size_t                      _size;            ///< The number of packed tasks.
-		std::atomic_size_t               _nCompletedTasks; ///< The number of completed tasks so far.
+		internal::CompletionCounter      _completion;      ///< The counter of the completed tasks.
 		std::chrono::nanoseconds         _interval;        ///< The time to wait between a check and the next in wait().
 		std::function<void(std::size_t)> _callback;        ///< Optional callback to call inside signalTaskComplete().
 	};
@@ -494,6 +2398,14 @@ namespace mpmc_tp {
 		// MAIN METHODS
 		////////////////////////////////////////////////////////////////////////
 
+		/**
+		 *   @brief Set the size, and zero the number of completed tasks.
+		 *   @param size The size corresponds to the number of packed tasks.
+		 *   @note Not thread-safe: call it only while no task of the pack
+		 *         runs and no thread waits for it.
+		 */
+		inline void setTraitsSize(const std::size_t size) override;
+
 		/**
 		 *   @brief The signal indicating the i-th task has been completed.
 		 *          Mandatory.
@@ -509,13 +2421,16 @@ namespace mpmc_tp {
 		 *          '_completed' to true and notifying all waiting threads with
 		 *          '_waitCondVar'. It is better for a pack with many short
 		 *          tasks. Call this from the task producer.
+		 *          Called from a thread of a pool, it runs the pending tasks
+		 *          of the pool while waiting, and blocks only when there are
+		 *          none, checking again from time to time.
 		 */
 		inline void wait() const override;
 
 		////////////////////////////////////////////////////////////////////////
 
 	protected:
-		mutable std::atomic_bool         _waitWoken;   ///< Flag indicating whether the thread waiting for the end has been woken up.
+		mutable std::atomic_bool         _waitWoken;   ///< Set by the last task when it is done notifying, so that the waiting thread can return.
 		mutable std::mutex               _waitMutex;   ///< Mutex for blocking the waiting threads.
 		mutable std::condition_variable  _waitCondVar; ///< Condition variable for blocking/waking up waiting threads.
 	};
@@ -538,6 +2453,364 @@ namespace mpmc_tp {
 
 	namespace internal {
 
+#if MPMC_TP_STATS
+		/// The WorkerCounters class holds the statistics of a thread of the
+		/// pool. Only the owner updates them, while anyone may read them: they
+		/// are padded to a cache line of their own, so that updates do not
+		/// slow down the accesses to the neighbouring data.
+		class WorkerCounters {
+		public:
+			/**
+			 *   @brief Constructor. All counters are zero.
+			 */
+			inline WorkerCounters();
+
+			/**
+			 *   @brief Count a task run, started with the given delay from its
+			 *          submission and lasting for the given time.
+			 */
+			inline void taskExecuted(const std::chrono::nanoseconds delay, const std::chrono::nanoseconds duration);
+
+			/**
+			 *   @brief Count a stolen task.
+			 */
+			inline void taskStolen();
+
+			/**
+			 *   @brief Count a wakeup after having been parked for the given
+			 *          time.
+			 */
+			inline void wokenUp(const std::chrono::nanoseconds parked);
+
+			/**
+			 *   @brief Add the counters to stats.
+			 */
+			inline void snapshot(WorkerStats &stats) const;
+
+			/**
+			 *   @brief Zero the counters. An update of the owner running
+			 *          meanwhile may be lost or may survive the reset.
+			 */
+			inline void reset();
+
+		private:
+			char                        _pad0[CACHE_LINE_SIZE];
+			std::atomic<std::uint64_t>  _tasksExecuted;
+			std::atomic<std::uint64_t>  _tasksStolen;
+			std::atomic<std::uint64_t>  _wakeups;
+			std::atomic<std::uint64_t>  _busyNanos;
+			std::atomic<std::uint64_t>  _parkedNanos;
+			std::atomic<std::uint64_t>  _latency[WorkerStats::N_LATENCY_BUCKETS];
+			char                        _pad1[CACHE_LINE_SIZE];
+		};
+#endif
+
+		/// The WorkStealingQueue class is the local deque of a thread of the
+		/// pool. The owner pushes and pops tasks at the back (LIFO), while
+		/// thieves steal them from the front (FIFO), so that the oldest (and
+		/// usually biggest) tasks migrate and the newest stay in cache.
+		/// Accesses are guarded by an atomic flag, and an atomic counter allows
+		/// to check for emptiness without taking it.
+		class WorkStealingQueue {
+		public:
+			////////////////////////////////////////////////////////////////////
+			// CONSTRUCTORS
+			////////////////////////////////////////////////////////////////////
+
+			/**
+			 *   @brief Default constructor. The deque is empty.
+			 */
+			inline WorkStealingQueue();
+
+			/**
+			 *   @brief Copy constructor deleted.
+			 */
+			WorkStealingQueue(const WorkStealingQueue &) = delete;
+
+			/**
+			 *   @brief Move constructor deleted.
+			 */
+			WorkStealingQueue(WorkStealingQueue &&) = delete;
+
+			////////////////////////////////////////////////////////////////////
+
+
+
+			////////////////////////////////////////////////////////////////////
+			// ASSIGNMENT OPERATORS
+			////////////////////////////////////////////////////////////////////
+
+			/**
+			 *    @brief Copy assignment operator deleted.
+			 */
+			WorkStealingQueue & operator=(const WorkStealingQueue &) = delete;
+
+			/**
+			 *    @brief Move assignment operator deleted.
+			 */
+			WorkStealingQueue & operator=(WorkStealingQueue &&) = delete;
+
+			////////////////////////////////////////////////////////////////////
+
+
+
+			////////////////////////////////////////////////////////////////////
+			// MAIN METHODS
+			////////////////////////////////////////////////////////////////////
+
+			/**
+			 *   @brief Returns the approximate number of tasks in the deque.
+			 */
+			inline std::size_t sizeApprox() const;
+
+			/**
+			 *   @brief Push a task at the back. Owner only.
+			 *   @param task     The task to move into the deque.
+			 */
+			inline void push(SimpleTaskType &&task);
+
+			/**
+			 *   @brief Push a bulk of tasks at the back. Owner only. Pass a
+			 *          std::move_iterator for moving tasks into the deque.
+			 *   @param first    The iterator to the first task to push.
+			 *   @param last     The iterator to the last task (except) to push.
+			 */
+			template < class It >
+			inline void pushBulk(It first, It last);
+
+			/**
+			 *   @brief Pop the newest task from the back. Owner only.
+			 *   @param task     Where to move the popped task.
+			 *   @return true if a task has been popped, false otherwise.
+			 */
+			inline bool pop(SimpleTaskType &task);
+
+			/**
+			 *   @brief Steal the oldest task from the front. Any thread.
+			 *   @param task     Where to move the stolen task.
+			 *   @return true if a task has been stolen, false otherwise.
+			 */
+			inline bool steal(SimpleTaskType &task);
+
+			////////////////////////////////////////////////////////////////////
+
+		private:
+			mutable std::atomic_flag    _flag;  ///< Atomic flag for mutual exclusion.
+			std::deque<SimpleTaskType>  _tasks; ///< The tasks.
+			std::atomic_size_t          _size;  ///< The number of tasks, readable without the flag.
+		};
+
+
+
+		/// The Worker class holds the state of a thread of the pool.
+		class Worker {
+		public:
+			/**
+			 *   @brief Constructor.
+			 *   @param p        The pool owning the thread.
+			 *   @param queue    The queue of the lowest priority level of p.
+			 *   @param seed     The seed for choosing the victims to steal from.
+			 */
+			inline Worker(MPMCThreadPool &p, ConcurrentQueue<SimpleTaskType> &queue, const std::size_t seed);
+
+			MPMCThreadPool                      *pool;           ///< The pool owning the thread.
+			std::thread                          thread;         ///< The thread object.
+			std::atomic_bool                     active;         ///< Signal for stopping the thread.
+			std::atomic_bool                     exited;         ///< Set by the thread when it is about to exit.
+			WorkStealingQueue                    localQueue;     ///< The local deque of tasks.
+			std::minstd_rand                     random;         ///< Generator for choosing the victims to steal from.
+			std::shared_ptr<const std::vector<std::shared_ptr<Worker>>> victims; ///< Last seen snapshot of the workers of the pool.
+			std::size_t                          victimsVersion; ///< Version of the snapshot in victims.
+			std::size_t                          spins;          ///< Current number of spins before yielding, adapted over time.
+			std::size_t                          nPolls;         ///< Number of polls for tasks, for aging the priority levels.
+			std::atomic_size_t                   node;           ///< The NUMA node of the CPU the thread is pinned to.
+			ConsumerToken                        consumerToken;  ///< Consumer token of the queue of the lowest priority level.
+			std::vector<SimpleTaskType>          batch;          ///< Buffer for dequeuing tasks in bulk.
+			std::size_t                          batchSize;      ///< Current number of tasks to dequeue at once, adapted over time.
+#if MPMC_TP_STATS
+			WorkerCounters                       counters;       ///< Statistics of the thread.
+#endif
+		};
+
+
+
+		/// The Topology class describes the NUMA nodes of the machine and their
+		/// CPUs. On Linux it is read from sysfs, elsewhere (or if that fails)
+		/// the machine is described as a single node.
+		class Topology {
+		public:
+			/**
+			 *   @brief Returns the topology of the machine, detected once.
+			 */
+			static inline const Topology & instance();
+
+			/**
+			 *   @brief Returns the number of NUMA nodes.
+			 */
+			inline std::size_t nNodes() const;
+
+			/**
+			 *   @brief Returns the NUMA node of a CPU (0 if unknown).
+			 */
+			inline std::size_t nodeOf(const std::size_t cpu) const;
+
+			/**
+			 *   @brief Returns all the CPUs the process may run on.
+			 */
+			inline std::vector<std::size_t> cpus() const;
+
+			/**
+			 *   @brief Returns the CPUs ordered by the given policy.
+			 */
+			inline std::vector<std::size_t> cpus(const AffinityPolicy policy) const;
+
+		private:
+			/**
+			 *   @brief Constructor. It detects the topology, restricted to
+			 *          the CPUs of the affinity mask of the calling thread.
+			 */
+			inline Topology();
+
+			std::vector<std::vector<std::size_t>>  _nodes; ///< The CPUs of each node the process may run on.
+		};
+
+		/**
+		 *   @brief Pin a thread to a set of CPUs.
+		 *   @return true on success, false on failure or if not supported.
+		 */
+		inline bool pinThread(std::thread &thread, const std::vector<std::size_t> &cpus);
+
+		/**
+		 *   @brief Returns a reference to the worker running in the calling
+		 *          thread, or to nullptr if it is not a thread of any pool.
+		 */
+		inline Worker *& currentWorker();
+
+
+
+		/// The FutureValue class is the storage of the result of a task,
+		/// constructed in place when the task completes. It holds the result
+		/// of a Future, as well as each result of a TaskPack.
+		template < class R >
+		class FutureValue {
+		public:
+			inline FutureValue();
+			inline ~FutureValue();
+
+			/**
+			 *   @brief Store the result of g(), replacing the stored one.
+			 */
+			template < class G >
+			inline void emplace(G &g);
+
+			/**
+			 *   @brief Move the stored result out.
+			 */
+			inline R take();
+
+			/**
+			 *   @brief Returns the stored result.
+			 */
+			inline const R & value() const;
+
+			/**
+			 *   @brief Destroy the stored result, if any.
+			 */
+			inline void reset();
+
+			/**
+			 *   @brief Returns whether a result is stored.
+			 */
+			inline bool hasValue() const;
+
+		private:
+			typename std::aligned_storage<sizeof(R), alignof(R)>::type  _storage;     ///< Storage for the result.
+			bool                                                        _constructed; ///< Whether the result has been stored.
+		};
+
+		/// The FutureValue class here specializes for void-return tasks.
+		template <>
+		class FutureValue<void> {
+		public:
+			template < class G >
+			inline void emplace(G &g);
+
+			inline void take();
+		};
+
+
+
+		/// The PackedTask class is the callable object set by TaskPack::setTaskAt:
+		/// it runs g as the i-th task of pack, which stores the result and emits
+		/// the completion signal. Being small, it is stored inline into a Task.
+		template < class Pack, class G >
+		class PackedTask {
+		public:
+			/**
+			 *   @brief Constructor.
+			 *   @param pack     The pack the task belongs to.
+			 *   @param i        The index of the task in the pack.
+			 *   @param g        The callable object to run. (move)
+			 */
+			inline PackedTask(Pack &pack, const std::size_t i, G &&g);
+
+			/**
+			 *   @brief Run the task.
+			 */
+			inline void operator()();
+
+		private:
+			Pack        *_pack; ///< The pack the task belongs to.
+			std::size_t  _i;    ///< The index of the task in the pack.
+			G            _g;    ///< The callable object to run.
+		};
+
+		/// The tasks of a pack run rather than being discarded: the pack waits
+		/// for all of them.
+		template < class Pack, class G >
+		struct IsDiscardable<PackedTask<Pack, G>> : std::false_type { };
+
+
+
+		/// The ArenaAllocator class is an allocator taking memory from a
+		/// TaskPackArena, or from the free store if it has none.
+		template < class T >
+		class ArenaAllocator {
+		public:
+			using value_type = T;
+
+			/**
+			 *   @brief Constructor.
+			 *   @param arena    The arena to allocate from, or nullptr for the
+			 *                   free store.
+			 */
+			inline ArenaAllocator(TaskPackArena *arena = nullptr);
+
+			template < class U >
+			inline ArenaAllocator(const ArenaAllocator<U> &other);
+
+			inline T * allocate(const std::size_t n);
+
+			/**
+			 *   @brief Release memory of the free store: memory of an arena is
+			 *          released all at once by the arena.
+			 */
+			inline void deallocate(T *p, const std::size_t n);
+
+			inline TaskPackArena * arena() const;
+
+		private:
+			TaskPackArena  *_arena; ///< The arena, or nullptr for the free store.
+		};
+
+		template < class T, class U >
+		inline bool operator==(const ArenaAllocator<T> &a, const ArenaAllocator<U> &b);
+
+		template < class T, class U >
+		inline bool operator!=(const ArenaAllocator<T> &a, const ArenaAllocator<U> &b);
+
+
+
 		/// The TaskPackBase class exposes the common methods for a TaskPack
 		/// object. It owns a container of SimpleTaskType tasks and gives some
 		/// begin/end methods to access them: use these to bulk enqueue the pack
@@ -545,7 +2818,7 @@ namespace mpmc_tp {
 		class TaskPackBase {
 		protected:
 			template < class T >
-			using Container = std::vector<T>;
+			using Container = std::vector<T, ArenaAllocator<T>>;
 			using SimpleTaskContainer = Container<SimpleTaskType>;
 
 		public:
@@ -565,6 +2838,15 @@ namespace mpmc_tp {
 			 */
 			inline TaskPackBase(const std::size_t size);
 
+			/**
+			 *   @brief Constructor with initial size, taking the memory from an
+			 *          arena.
+			 *   @param size     The size corresponds to the number of packed
+			 *                   tasks.
+			 *   @param arena    The arena to allocate from.
+			 */
+			inline TaskPackBase(const std::size_t size, TaskPackArena &arena);
+
 			/**
 			 *   @brief Copy constructor deleted.
 			 */
@@ -665,10 +2947,31 @@ namespace mpmc_tp {
 			 */
 			inline SimpleTaskType & operator[](const std::size_t i);
 
+			/**
+			 *   @brief Cancel the pack: its tasks which have not started yet
+			 *          are skipped, only signalling their completion, so that
+			 *          waiting for the pack still returns, and its tokens are
+			 *          stopped.
+			 */
+			inline void cancel();
+
+			/**
+			 *   @brief Returns whether the pack has been cancelled.
+			 */
+			inline bool cancelled() const;
+
+			/**
+			 *   @brief Returns a token for polling the cancellation of the pack
+			 *          from its running tasks. The token must not outlive the
+			 *          pack.
+			 */
+			inline StopToken token() const;
+
 			////////////////////////////////////////////////////////////////////
 
 		protected:
-			SimpleTaskContainer  _tasks;  ///< Container of SimpleTaskType tasks.
+			SimpleTaskContainer  _tasks;     ///< Container of SimpleTaskType tasks.
+			std::atomic_bool     _cancelled; ///< Whether the pack has been cancelled.
 		};
 
 	}
@@ -677,6 +2980,102 @@ namespace mpmc_tp {
 
 
 
+	/// The TaskPackArena class is a monotonic memory resource for TaskPack:
+	/// a pack built on an arena takes the storage of its tasks and results
+	/// from it, and gives nothing back until the arena is released, all at
+	/// once. Releasing keeps the memory for the next packs, so that packs
+	/// built and destroyed at every frame do not touch the free store once
+	/// the arena has grown enough.
+	/// It is not thread-safe: the packs of an arena must be built by one
+	/// thread at a time.
+	class TaskPackArena {
+	public:
+		////////////////////////////////////////////////////////////////////////
+		// CONSTRUCTORS
+		////////////////////////////////////////////////////////////////////////
+
+		/**
+		 *   @brief Constructor.
+		 *   @param capacity The number of bytes to allocate up front.
+		 */
+		explicit inline TaskPackArena(const std::size_t capacity = 0);
+
+		/**
+		 *   @brief Copy constructor deleted.
+		 */
+		TaskPackArena(const TaskPackArena &) = delete;
+
+		////////////////////////////////////////////////////////////////////////
+
+
+
+		////////////////////////////////////////////////////////////////////////
+		// DESTRUCTOR
+		////////////////////////////////////////////////////////////////////////
+
+		inline ~TaskPackArena();
+
+		////////////////////////////////////////////////////////////////////////
+
+
+
+		////////////////////////////////////////////////////////////////////////
+		// ASSIGNMENT OPERATORS
+		////////////////////////////////////////////////////////////////////////
+
+		/**
+		 *   @brief Copy assignment operator deleted.
+		 */
+		TaskPackArena & operator=(const TaskPackArena &) = delete;
+
+		////////////////////////////////////////////////////////////////////////
+
+
+
+		////////////////////////////////////////////////////////////////////////
+		// MAIN METHODS
+		////////////////////////////////////////////////////////////////////////
+
+		/**
+		 *   @brief Allocate size bytes aligned to alignment, which must be a
+		 *          power of two. When the current block is full, a new one at
+		 *          least as big as all the others is allocated.
+		 */
+		inline void * allocate(const std::size_t size, const std::size_t alignment);
+
+		/**
+		 *   @brief Make all the memory available again. If it is spread over
+		 *          many blocks, they are merged into one.
+		 *   @note All the packs built on the arena must have been destroyed.
+		 */
+		inline void release();
+
+		/**
+		 *   @brief Returns the number of bytes allocated from the free store.
+		 */
+		inline std::size_t capacity() const;
+
+		////////////////////////////////////////////////////////////////////////
+
+	private:
+		/// A block of memory.
+		struct Block {
+			char         *memory; ///< The memory.
+			std::size_t   size;   ///< The size of the memory.
+		};
+
+		/**
+		 *   @brief Allocate a new block, which becomes the current one.
+		 */
+		inline void addBlock(const std::size_t size);
+
+		std::vector<Block>  _blocks;   ///< The blocks; the last one is the current one.
+		std::size_t         _used;     ///< The number of bytes used in the current block.
+		std::size_t         _capacity; ///< The total size of the blocks.
+	};
+
+
+
 	/// The TaskPack class is the most general class for packing tasks.
 	/// It needs two template parameters:
 	/// @param R               is the return type of the tasks to perform
@@ -706,6 +3105,18 @@ namespace mpmc_tp {
 		template < class ...Args >
 		inline TaskPack(const std::size_t size, Args &&...args);
 
+		/**
+		 *   @brief Constructor with initial size and the TaskPackTraits,
+		 *          taking the storage of the tasks and of the results from an
+		 *          arena, which must outlive the pack.
+		 *   @param arena    The arena to allocate from.
+		 *   @param size     The size corresponds to the number of packed tasks.
+		 *   @param args     Other possible parameters the traits constructor
+		 *                   may need.
+		 */
+		template < class ...Args >
+		inline TaskPack(TaskPackArena &arena, const std::size_t size, Args &&...args);
+
 		/**
 		 *   @brief Copy constructor deleted.
 		 */
@@ -756,14 +3167,43 @@ namespace mpmc_tp {
 		 *   @param i        Index of the task result to access.
 		 *   @return The result of the task at position i.
 		 *   @note It is not thread-safe but it is guaranteed to hold the value
-		 *         when a signal for the corresponding task is emitted.
+		 *         when a signal for the corresponding task is emitted. The
+		 *         result must not be accessed before, nor if the task has
+		 *         been skipped by cancel() (see hasResultAt).
 		 */
 		inline const R & resultAt(const std::size_t i) const;
 
+		/**
+		 *   @brief Returns whether the task at position i has stored its
+		 *          result, i.e. it has completed without being skipped by
+		 *          cancel(). The same note of resultAt applies.
+		 *   @param i        Index of the task.
+		 */
+		inline bool hasResultAt(const std::size_t i) const;
+
+		/**
+		 *   @brief Prepare the pack for running again, keeping its storage:
+		 *          the results are destroyed and the completed tasks are
+		 *          zeroed. A cancelled pack is not cancelled any more. The
+		 *          tasks must be set again before being submitted.
+		 *   @note Not thread-safe: call it only once the pack has completed.
+		 *         The traits must provide a 'setTraitsSize' method.
+		 */
+		inline void reset();
+
 		////////////////////////////////////////////////////////////////////////
 
 	private:
-		Container<R>  _results;       ///< Container to store the result of the tasks.
+		template < class Pack, class G >
+		friend class internal::PackedTask;
+
+		/**
+		 *   @brief Run g as the task at position i, storing its result.
+		 */
+		template < class G >
+		inline void runTaskAt(const std::size_t i, G &g);
+
+		internal::PaddedArray<internal::FutureValue<R>>  _results; ///< The results of the tasks, constructed in place, each in its own cache line so that tasks do not false-share.
 	};
 
 
@@ -793,6 +3233,18 @@ namespace mpmc_tp {
 		template < class ...Args >
 		inline TaskPack(const std::size_t size, Args &&...args);
 
+		/**
+		 *   @brief Constructor with initial size and the TaskPackTraits,
+		 *          taking the storage of the tasks and of the results from an
+		 *          arena, which must outlive the pack.
+		 *   @param arena    The arena to allocate from.
+		 *   @param size     The size corresponds to the number of packed tasks.
+		 *   @param args     Other possible parameters the traits constructor
+		 *                   may need.
+		 */
+		template < class ...Args >
+		inline TaskPack(TaskPackArena &arena, const std::size_t size, Args &&...args);
+
 		/**
 		 *   @brief Copy constructor deleted.
 		 */
@@ -838,10 +3290,322 @@ namespace mpmc_tp {
 		template < class F, class ...Args >
 		inline void setTaskAt(const std::size_t i, F &&f, Args &&...args);
 
+		/**
+		 *   @brief Prepare the pack for running again, keeping its storage:
+		 *          the completed tasks are zeroed. A cancelled pack is not
+		 *          cancelled any more. The tasks must be set again before
+		 *          being submitted.
+		 *   @note Not thread-safe: call it only once the pack has completed.
+		 *         The traits must provide a 'setTraitsSize' method.
+		 */
+		inline void reset();
+
+		////////////////////////////////////////////////////////////////////////
+
+	private:
+		template < class Pack, class G >
+		friend class internal::PackedTask;
+
+		/**
+		 *   @brief Run g as the task at position i.
+		 */
+		template < class G >
+		inline void runTaskAt(const std::size_t i, G &g);
+	};
+
+
+
+
+
+
+	////////////////////////////////////////////////////////////////////////////
+	// FUTURES
+	////////////////////////////////////////////////////////////////////////////
+
+	namespace internal {
+
+		/// The FutureState class is the state shared by a Future and the task
+		/// producing its result. It is allocated once, together with its
+		/// reference counter, by std::make_shared. Completion is published
+		/// through an atomic status, so no lock is taken unless a thread
+		/// actually blocks in 'wait'. At most one continuation can be attached:
+		/// it runs right after completion in the thread which completed the
+		/// task, or it is submitted to the pool if the task had already
+		/// completed when the continuation was attached.
+		template < class R >
+		class FutureState {
+		public:
+			/**
+			 *   @brief Constructor.
+			 *   @param pool     The pool running the task.
+			 */
+			explicit inline FutureState(MPMCThreadPool &pool);
+
+			/**
+			 *   @brief Copy constructor deleted.
+			 */
+			FutureState(const FutureState &) = delete;
+
+			/**
+			 *   @brief Copy assignment operator deleted.
+			 */
+			FutureState & operator=(const FutureState &) = delete;
+
+			/**
+			 *   @brief Returns the pool running the task.
+			 */
+			inline MPMCThreadPool & pool() const;
+
+			/**
+			 *   @brief Run g, storing its result or the exception it throws,
+			 *          and complete.
+			 */
+			template < class G >
+			inline void run(G &g);
+
+			/**
+			 *   @brief Store an exception and complete.
+			 */
+			inline void setException(std::exception_ptr e);
+
+			/**
+			 *   @brief Returns whether the state has completed.
+			 */
+			inline bool ready() const;
+
+			/**
+			 *   @brief Block the calling thread until the state has completed,
+			 *          running the pending tasks of its pool meanwhile if it
+			 *          belongs to one.
+			 */
+			inline void wait();
+
+			/**
+			 *   @brief Returns the stored exception, if any. Call it only after
+			 *          the state has completed.
+			 */
+			inline std::exception_ptr exception() const;
+
+			/**
+			 *   @brief Move the result out, or rethrow the stored exception.
+			 *          Call it only after the state has completed.
+			 */
+			inline R take();
+
+			/**
+			 *   @brief Attach the continuation.
+			 *   @param c        The task to run after completion. (move)
+			 */
+			inline void setContinuation(Task &&c);
+
+		private:
+			static const unsigned READY        = 1; ///< Status bit set on completion.
+			static const unsigned CONTINUATION = 2; ///< Status bit set when the continuation is attached.
+
+			/**
+			 *   @brief Publish the completion, wake up the waiting threads and
+			 *          run the continuation, if any.
+			 */
+			inline void complete();
+
+			MPMCThreadPool         *_pool;         ///< The pool running the task.
+			std::atomic<unsigned>   _status;       ///< Combination of READY and CONTINUATION.
+			FutureValue<R>          _value;        ///< The result.
+			std::exception_ptr      _exception;    ///< The exception thrown by the task, if any.
+			EventCount              _eventCount;   ///< Parking lot of the threads waiting for completion.
+			Task                    _continuation; ///< The continuation, if any.
+		};
+
+
+
+		/// The FutureTask class is the task submitted by MPMCThreadPool::submit.
+		/// If it gets destroyed without being run, the future gets a
+		/// std::future_error with std::future_errc::broken_promise.
+		template < class R, class G >
+		class FutureTask {
+		public:
+			inline FutureTask(std::shared_ptr<FutureState<R>> state, G &&g);
+			FutureTask(FutureTask &&) = default;
+			FutureTask(const FutureTask &) = delete;
+			inline ~FutureTask();
+			FutureTask & operator=(const FutureTask &) = delete;
+
+			inline void operator()();
+
+		private:
+			std::shared_ptr<FutureState<R>>  _state; ///< The state to complete, null once run.
+			G                                _g;     ///< The callable object to run.
+		};
+
+
+
+		/// The result type of a continuation F of a Future<R>.
+		template < class R, class F >
+		struct ContinuationResult {
+			using type = InvokeResult<F, R>;
+		};
+
+		template < class F >
+		struct ContinuationResult<void, F> {
+			using type = InvokeResult<F>;
+		};
+
+
+
+		/// The Continuation class is the task attached to a FutureState<R> by
+		/// Future<R>::then: it passes the result to f and stores the result of
+		/// f into the next state, or it forwards the exception.
+		template < class R, class F >
+		class Continuation {
+		public:
+			using Result = typename ContinuationResult<R, F>::type;
+
+			inline Continuation(std::shared_ptr<FutureState<R>> antecedent, std::shared_ptr<FutureState<Result>> next, F f);
+			Continuation(Continuation &&) = default;
+			Continuation(const Continuation &) = delete;
+			Continuation & operator=(const Continuation &) = delete;
+
+			inline void operator()();
+
+		private:
+			/**
+			 *   @brief Invoke f with the result of the antecedent.
+			 */
+			template < class S >
+			inline Result call(FutureState<S> &antecedent);
+
+			inline Result call(FutureState<void> &antecedent);
+
+			std::shared_ptr<FutureState<R>>       _antecedent; ///< The state providing the argument.
+			std::shared_ptr<FutureState<Result>>  _next;       ///< The state to complete.
+			F                                     _f;          ///< The continuation function.
+		};
+
+		/// A continuation runs rather than being discarded: it is the only one
+		/// completing the next state.
+		template < class R, class F >
+		struct IsDiscardable<Continuation<R, F>> : std::false_type { };
+
+	}
+
+	////////////////////////////////////////////////////////////////////////////
+
+
+
+	/// The Future class gives access to the result of a task submitted with
+	/// MPMCThreadPool::submit. It is move-only and it owns a reference to the
+	/// shared state, which is the only allocation made for the result.
+	/// Unlike std::future, no mutex is taken to publish or read the result
+	/// unless a thread blocks waiting for it.
+	template < class R >
+	class Future {
+	public:
+		////////////////////////////////////////////////////////////////////////
+		// CONSTRUCTORS
+		////////////////////////////////////////////////////////////////////////
+
+		/**
+		 *   @brief Default constructor. The future is not valid.
+		 */
+		Future() = default;
+
+		/**
+		 *   @brief Copy constructor deleted.
+		 */
+		Future(const Future &) = delete;
+
+		/**
+		 *   @brief Move constructor. other is left not valid.
+		 */
+		Future(Future &&) = default;
+
+		////////////////////////////////////////////////////////////////////////
+
+
+
+		////////////////////////////////////////////////////////////////////////
+		// ASSIGNMENT OPERATORS
+		////////////////////////////////////////////////////////////////////////
+
+		/**
+		 *   @brief Copy assignment operator deleted.
+		 */
+		Future & operator=(const Future &) = delete;
+
+		/**
+		 *   @brief Move assignment operator. other is left not valid.
+		 */
+		Future & operator=(Future &&) = default;
+
+		////////////////////////////////////////////////////////////////////////
+
+
+
+		////////////////////////////////////////////////////////////////////////
+		// MAIN METHODS
+		////////////////////////////////////////////////////////////////////////
+
+		/**
+		 *   @brief Returns whether the future refers to a shared state, i.e.
+		 *          it has been returned by submit or then and neither get nor
+		 *          then have been called on it.
+		 */
+		inline bool valid() const;
+
+		/**
+		 *   @brief Returns whether the result is available.
+		 */
+		inline bool ready() const;
+
+		/**
+		 *   @brief Block the calling thread until the result is available.
+		 *          Called from a thread of a pool, it runs the pending tasks
+		 *          of the pool meanwhile instead of parking, so that tasks
+		 *          waiting for the results of others cannot block all the
+		 *          threads.
+		 */
+		inline void wait() const;
+
+		/**
+		 *   @brief Wait for the result, as wait() does, and return it, or
+		 *          rethrow the exception thrown by the task. The future is no
+		 *          more valid afterwards.
+		 */
+		inline R get();
+
+		/**
+		 *   @brief Attach a continuation. When the task completes, f is called
+		 *          with its result (no argument for void tasks) by the same
+		 *          thread, without going through the queue of the pool; if the
+		 *          task has already completed, f is submitted to the pool. If
+		 *          the task throws, f is not called and the exception is
+		 *          forwarded. The future is no more valid afterwards.
+		 *   @param f         The continuation function. (move)
+		 *   @return The future holding the result of f.
+		 */
+		template < class F >
+		inline Future<typename internal::ContinuationResult<R, typename std::decay<F>::type>::type> then(F &&f);
+
 		////////////////////////////////////////////////////////////////////////
 
+	private:
+		friend MPMCThreadPool;
+
+		friend class IOExecutor;
+
+		template < class S >
+		friend class Future;
+
+		/**
+		 *   @brief Constructor from the shared state.
+		 */
+		explicit inline Future(std::shared_ptr<internal::FutureState<R>> state);
+
+		std::shared_ptr<internal::FutureState<R>>  _state; ///< The shared state.
 	};
 
+	////////////////////////////////////////////////////////////////////////////
+
 }
 
 #include <MPMCThreadPool/inlines/MPMCThreadPool.inl>
@@ -0,0 +1,185 @@
+// Copyright (c) 2016 Giorgio Marcias
+//
+// This source code is subject to the simplified BSD license.
+//
+// Author: Giorgio Marcias
+// email: marcias.giorgio@gmail.com
+
+#ifndef ParallelAlgorithms_hpp
+#define ParallelAlgorithms_hpp
+
+#include <MPMCThreadPool/MPMCThreadPool.hpp>
+#include <iterator>
+
+namespace mpmc_tp {
+
+	////////////////////////////////////////////////////////////////////////////
+	// INTERNAL STUFF
+	////////////////////////////////////////////////////////////////////////////
+
+	namespace internal {
+
+		/// The ChunkLoop class splits a range of n elements into chunks of
+		/// grain elements and runs a body on each of them, using the calling
+		/// thread and the threads of a pool. Chunks are claimed dynamically
+		/// through an atomic counter, both by the calling thread and by helper
+		/// tasks submitted to the pool, so that uneven chunks balance out and
+		/// the calling thread can complete the whole range by itself if no
+		/// thread of the pool is free (e.g. when called from inside a task).
+		/// The state is shared with the helper tasks, which may run after the
+		/// loop has completed: they find no chunk to claim and quit.
+		class ChunkLoop {
+		public:
+			/**
+			 *   @brief Constructor.
+			 *   @param n        The number of elements.
+			 *   @param grain    The number of elements per chunk (at least 1).
+			 */
+			inline ChunkLoop(const std::size_t n, const std::size_t grain);
+
+			/**
+			 *   @brief Returns the number of chunks.
+			 */
+			inline std::size_t nChunks() const;
+
+			/**
+			 *   @brief Claim and run chunks until none is left. The body is
+			 *          called as 'body(c, begin, end)' where c is the index of
+			 *          the chunk and [begin, end) the range of its elements.
+			 *   @param body     The body to run on each chunk.
+			 */
+			template < class Body >
+			inline void run(Body &body);
+
+			/**
+			 *   @brief Block the calling thread until all chunks have been run,
+			 *          then rethrow the first exception thrown by the body, if
+			 *          any.
+			 */
+			inline void wait();
+
+		private:
+			std::size_t         _n;         ///< The number of elements.
+			std::size_t         _grain;     ///< The number of elements per chunk.
+			std::size_t         _nChunks;   ///< The number of chunks.
+			std::atomic_size_t  _next;      ///< The index of the next chunk to claim.
+			std::atomic_size_t  _nDone;     ///< The number of chunks run so far.
+			std::atomic_bool    _failed;    ///< Set when the body throws: remaining chunks are skipped.
+			std::exception_ptr  _exception; ///< The first exception thrown by the body.
+			EventCount          _eventCount;///< Parking lot of the thread waiting for completion.
+		};
+
+		/**
+		 *   @brief Run body on all chunks of [0, n), using the calling thread
+		 *          and the threads of pool, and wait for completion.
+		 *   @param pool     The pool providing the helper threads.
+		 *   @param n        The number of elements.
+		 *   @param grain    The number of elements per chunk, 0 for automatic.
+		 *   @param body     The body to run on each chunk, see ChunkLoop::run.
+		 *   @return The number of chunks.
+		 */
+		template < class Body >
+		inline std::size_t forEachChunk(MPMCThreadPool &pool, const std::size_t n, const std::size_t grain, Body &body);
+
+		/**
+		 *   @brief Returns grain if it is not 0, otherwise a grain giving a few
+		 *          chunks per thread of pool for n elements.
+		 */
+		inline std::size_t chunkGrain(MPMCThreadPool &pool, const std::size_t n, const std::size_t grain);
+
+
+
+		/// The ChunkHelper class is the task submitted to the pool for helping
+		/// a ChunkLoop.
+		template < class Body >
+		class ChunkHelper {
+		public:
+			inline ChunkHelper(const std::shared_ptr<ChunkLoop> &loop, Body &body);
+
+			inline void operator()();
+
+		private:
+			std::shared_ptr<ChunkLoop>  _loop; ///< The loop to help.
+			Body                       *_body; ///< The body to run on each chunk.
+		};
+
+	}
+
+	////////////////////////////////////////////////////////////////////////////
+
+
+
+	////////////////////////////////////////////////////////////////////////////
+	// PARALLEL ALGORITHMS
+	////////////////////////////////////////////////////////////////////////////
+
+	// All algorithms split the range into chunks of grain elements (0 lets
+	// them choose a grain giving a few chunks per thread) and run them on the
+	// calling thread and on the threads of the pool, returning when all of
+	// them have been processed. If the function throws, the remaining chunks
+	// are skipped and the first exception is rethrown to the caller.
+	// Ranges are given by integral indices or random-access iterators.
+
+	/**
+	 *   @brief Call f(i) for each i in [first, last).
+	 *   @param pool     The pool to use.
+	 *   @param first    The first index or iterator.
+	 *   @param last     The last index or iterator (except).
+	 *   @param grain    The number of elements per chunk, 0 for automatic.
+	 *   @param f        The function to call on each element.
+	 */
+	template < class Index, class F >
+	inline void parallelFor(MPMCThreadPool &pool, Index first, Index last, const std::size_t grain, F &&f);
+
+	/**
+	 *   @brief Reduce f(i), for each i in [first, last), with op.
+	 *   @param pool     The pool to use.
+	 *   @param first    The first index or iterator.
+	 *   @param last     The last index or iterator (except).
+	 *   @param grain    The number of elements per chunk, 0 for automatic.
+	 *   @param identity The identity of op.
+	 *   @param f        The function to call on each element.
+	 *   @param op       The associative reduction operation, called as
+	 *                   'op(T, T)' and returning T. It does not need to be
+	 *                   commutative: results are combined in range order.
+	 *   @return The reduction.
+	 */
+	template < class Index, class T, class F, class Op >
+	inline T parallelReduce(MPMCThreadPool &pool, Index first, Index last, const std::size_t grain, T identity, F &&f, Op &&op);
+
+	/**
+	 *   @brief Store f(*it) into the range beginning at dFirst for each it in
+	 *          [first, last).
+	 *   @param pool     The pool to use.
+	 *   @param first    The first input iterator.
+	 *   @param last     The last input iterator (except).
+	 *   @param dFirst   The first output iterator.
+	 *   @param grain    The number of elements per chunk, 0 for automatic.
+	 *   @param f        The function to call on each element.
+	 *   @return The output iterator past the last element written.
+	 */
+	template < class InputIt, class OutputIt, class F >
+	inline OutputIt parallelTransform(MPMCThreadPool &pool, InputIt first, InputIt last, OutputIt dFirst, const std::size_t grain, F &&f);
+
+	/**
+	 *   @brief Store the inclusive scan of [first, last) with op into the
+	 *          range beginning at dFirst. The input is read twice.
+	 *   @param pool     The pool to use.
+	 *   @param first    The first input iterator.
+	 *   @param last     The last input iterator (except).
+	 *   @param dFirst   The first output iterator.
+	 *   @param grain    The number of elements per chunk, 0 for automatic.
+	 *   @param identity The identity of op.
+	 *   @param op       The associative operation, called as 'op(T, T)'.
+	 *   @return The output iterator past the last element written.
+	 */
+	template < class InputIt, class OutputIt, class T, class Op >
+	inline OutputIt parallelScan(MPMCThreadPool &pool, InputIt first, InputIt last, OutputIt dFirst, const std::size_t grain, T identity, Op &&op);
+
+	////////////////////////////////////////////////////////////////////////////
+
+}
+
+#include <MPMCThreadPool/inlines/ParallelAlgorithms.inl>
+
+#endif /* ParallelAlgorithms_hpp */
@@ -0,0 +1,232 @@
+// Copyright (c) 2016 Giorgio Marcias
+//
+// This source code is subject to the simplified BSD license.
+//
+// Author: Giorgio Marcias
+// email: marcias.giorgio@gmail.com
+
+#ifndef TaskGraph_hpp
+#define TaskGraph_hpp
+
+#include <MPMCThreadPool/MPMCThreadPool.hpp>
+#include <initializer_list>
+#include <stdexcept>
+
+namespace mpmc_tp {
+
+	class TaskGraph;
+
+	////////////////////////////////////////////////////////////////////////////
+	// INTERNAL STUFF
+	////////////////////////////////////////////////////////////////////////////
+
+	namespace internal {
+
+		/// The GraphNodeTask class is the task submitted to the pool for
+		/// running a node of a TaskGraph.
+		class GraphNodeTask {
+		public:
+			inline GraphNodeTask(TaskGraph &graph, const std::size_t node);
+
+			inline void operator()();
+
+		private:
+			TaskGraph   *_graph; ///< The graph owning the node.
+			std::size_t  _node;  ///< The index of the node.
+		};
+
+		/// A node runs rather than being discarded: its successors and the
+		/// threads waiting for the graph wait for it.
+		template < >
+		struct IsDiscardable<GraphNodeTask> : std::false_type { };
+
+	}
+
+	////////////////////////////////////////////////////////////////////////////
+
+
+
+	////////////////////////////////////////////////////////////////////////////
+	// TASK GRAPH
+	////////////////////////////////////////////////////////////////////////////
+
+	/// The TaskGraph class is a directed acyclic graph of tasks to run on a
+	/// MPMCThreadPool. Each node holds a function and runs as soon as all of
+	/// its predecessors have completed: every node has an atomic counter of
+	/// the predecessors still running, and the predecessor bringing it to zero
+	/// submits the node, or runs it right away if it is the first successor it
+	/// releases. So there is no barrier between the stages of a pipeline: the
+	/// pool is idle only if no node is ready.
+	/// A graph is built once and can be run many times: running it only resets
+	/// the counters, without allocating.
+	/// Nodes must not be added, nor dependencies, while the graph runs, and a
+	/// graph must not run again before the previous run has completed.
+	class TaskGraph {
+	public:
+		////////////////////////////////////////////////////////////////////////
+		// CONSTRUCTORS
+		////////////////////////////////////////////////////////////////////////
+
+		/**
+		 *   @brief Default constructor. The graph is empty.
+		 */
+		inline TaskGraph();
+
+		/**
+		 *   @brief Copy constructor deleted.
+		 */
+		TaskGraph(const TaskGraph &) = delete;
+
+		////////////////////////////////////////////////////////////////////////
+
+
+
+		////////////////////////////////////////////////////////////////////////
+		// DESTRUCTOR
+		////////////////////////////////////////////////////////////////////////
+
+		/**
+		 *   @brief Destructor. It waits for the completion of the current run.
+		 */
+		inline ~TaskGraph();
+
+		////////////////////////////////////////////////////////////////////////
+
+
+
+		////////////////////////////////////////////////////////////////////////
+		// ASSIGNMENT OPERATORS
+		////////////////////////////////////////////////////////////////////////
+
+		/**
+		 *   @brief Copy assignment operator deleted.
+		 */
+		TaskGraph & operator=(const TaskGraph &) = delete;
+
+		////////////////////////////////////////////////////////////////////////
+
+
+
+		////////////////////////////////////////////////////////////////////////
+		// BUILDING
+		////////////////////////////////////////////////////////////////////////
+
+		/**
+		 *   @brief Add a node calling f(args...) at each run.
+		 *   @param f        The function to call.
+		 *   @param args     The arguments of f, moved (or copied) into the
+		 *                   node, which can own them even if move-only.
+		 *   @return The index of the node.
+		 */
+		template < class F, class ...Args >
+		inline std::size_t addNode(F &&f, Args &&...args);
+
+		/**
+		 *   @brief Add a node calling f(args...) at each run, after the given
+		 *          predecessors have completed.
+		 *   @param predecessors The indices of the predecessors.
+		 *   @param f        The function to call.
+		 *   @param args     The arguments of f, copied into the node.
+		 *   @return The index of the node.
+		 *   @note Throws std::out_of_range if a predecessor is not valid.
+		 */
+		template < class F, class ...Args >
+		inline std::size_t addNode(std::initializer_list<std::size_t> predecessors, F &&f, Args &&...args);
+
+		/**
+		 *   @brief Make node run after predecessor has completed.
+		 *   @param node        The index of the node.
+		 *   @param predecessor The index of the node to complete first.
+		 *   @note Throws std::out_of_range if an index is not valid.
+		 */
+		inline void addDependency(const std::size_t node, const std::size_t predecessor);
+
+		/**
+		 *   @brief Returns the number of nodes.
+		 */
+		inline std::size_t size() const;
+
+		/**
+		 *   @brief Remove all the nodes.
+		 */
+		inline void clear();
+
+		////////////////////////////////////////////////////////////////////////
+
+
+
+		////////////////////////////////////////////////////////////////////////
+		// RUNNING
+		////////////////////////////////////////////////////////////////////////
+
+		/**
+		 *   @brief Start running the graph on pool, submitting the nodes
+		 *          without predecessors. It returns without waiting.
+		 *   @param pool     The pool to run the nodes.
+		 *   @note Throws std::logic_error if the graph has a cycle or if it
+		 *         is still running.
+		 */
+		inline void run(MPMCThreadPool &pool);
+
+		/**
+		 *   @brief Block the calling thread until all nodes have completed,
+		 *          then rethrow the first exception thrown by a node, if any.
+		 *          Once a node throws, the functions of the nodes not yet
+		 *          started are skipped.
+		 *          Called from a thread of a pool, it runs the pending tasks
+		 *          of the pool while waiting, so that it can be called from
+		 *          inside a task.
+		 */
+		inline void wait();
+
+		/**
+		 *   @brief Returns whether the last run has completed.
+		 */
+		inline bool done() const;
+
+		////////////////////////////////////////////////////////////////////////
+
+	private:
+		friend class internal::GraphNodeTask;
+
+		/// A node of the graph.
+		struct Node {
+			inline explicit Node(Task &&f);
+
+			Task                      function;      ///< The function to call.
+			std::vector<std::size_t>  successors;    ///< The nodes depending on this one.
+			std::size_t               nPredecessors; ///< The number of nodes this one depends on.
+			std::atomic_size_t        nWaiting;      ///< The number of predecessors not yet completed in the current run.
+		};
+
+		/**
+		 *   @brief Check that the graph is acyclic and find the nodes without
+		 *          predecessors, unless already done since the last change.
+		 */
+		inline void validate();
+
+		/**
+		 *   @brief Run node and then, as long as it releases one, the first
+		 *          successor it makes ready, submitting the others.
+		 */
+		inline void runFrom(std::size_t node);
+
+		std::deque<Node>           _nodes;       ///< The nodes.
+		std::vector<std::size_t>   _roots;       ///< The nodes without predecessors.
+		bool                       _validated;   ///< Whether _roots is up to date and the graph is acyclic.
+		std::vector<Task>          _rootTasks;   ///< Buffer for submitting the roots in bulk.
+		MPMCThreadPool            *_pool;        ///< The pool of the current run.
+		std::atomic_size_t         _nDone;       ///< The number of nodes completed in the current run.
+		std::atomic_bool           _finished;    ///< Set when the last node has completed and notified the waiters.
+		std::atomic_bool           _failed;      ///< Set when a node throws: the next ones are skipped.
+		std::exception_ptr         _exception;   ///< The first exception thrown by a node.
+		internal::EventCount       _eventCount;  ///< Parking lot of the threads waiting for completion.
+	};
+
+	////////////////////////////////////////////////////////////////////////////
+
+}
+
+#include <MPMCThreadPool/inlines/TaskGraph.inl>
+
+#endif /* TaskGraph_hpp */
@@ -0,0 +1,168 @@
+// Copyright (c) 2016 Giorgio Marcias
+//
+// This source code is subject to the simplified BSD license.
+//
+// Author: Giorgio Marcias
+// email: marcias.giorgio@gmail.com
+
+#include <MPMCThreadPool/BasicThreadPool.hpp>
+
+namespace mpmc_tp {
+
+	////////////////////////////////////////////////////////////////////////////
+	// BasicThreadPool METHODS
+	////////////////////////////////////////////////////////////////////////////
+
+	template < class T, class Policy >
+	inline std::size_t BasicThreadPool<T, Policy>::DEFAULT_SIZE()
+	{
+		return std::thread::hardware_concurrency();
+	}
+
+	template < class T, class Policy >
+	inline std::size_t BasicThreadPool<T, Policy>::DEFAULT_MAX_SPINS()
+	{
+		return 1024;
+	}
+
+	template < class T, class Policy >
+	inline BasicThreadPool<T, Policy>::BasicThreadPool() : BasicThreadPool(BasicThreadPool::DEFAULT_SIZE())
+	{ }
+
+	template < class T, class Policy >
+	inline BasicThreadPool<T, Policy>::BasicThreadPool(const std::size_t size) : _active(true), _executed(Policy::STATS ? size : 0)
+	{
+		_threads.reserve(size);
+		for (std::size_t i = 0; i < size; ++i)
+			_threads.emplace_back(&BasicThreadPool::threadJob, this, i);
+	}
+
+	template < class T, class Policy >
+	inline BasicThreadPool<T, Policy>::~BasicThreadPool()
+	{
+		_active.store(false, std::memory_order_relaxed);
+		_eventCount.notifyAll();
+		for (std::size_t i = 0; i < _threads.size(); ++i)
+			_threads[i].join();
+	}
+
+	template < class T, class Policy >
+	inline std::size_t BasicThreadPool<T, Policy>::size() const
+	{
+		return _threads.size();
+	}
+
+	template < class T, class Policy >
+	inline void BasicThreadPool<T, Policy>::submitTask(const T &task)
+	{
+		_queue.enqueue(task);
+		notify(1);
+	}
+
+	template < class T, class Policy >
+	inline void BasicThreadPool<T, Policy>::submitTask(T &&task)
+	{
+		_queue.enqueue(std::forward<T>(task));
+		notify(1);
+	}
+
+	template < class T, class Policy >
+	template < class It >
+	inline void BasicThreadPool<T, Policy>::submitTasks(It first, It last)
+	{
+		const std::size_t n = std::distance(first, last);
+		if (n == 0)
+			return;
+		_queue.enqueue_bulk(first, n);
+		notify(n);
+	}
+
+	template < class T, class Policy >
+	inline bool BasicThreadPool<T, Policy>::runPendingTask()
+	{
+		T task;
+		if (!_queue.try_dequeue(task))
+			return false;
+		Policy::run(task);
+		return true;
+	}
+
+	template < class T, class Policy >
+	inline std::size_t BasicThreadPool<T, Policy>::nPendingTasks() const
+	{
+		return _queue.size_approx();
+	}
+
+	template < class T, class Policy >
+	inline std::uint64_t BasicThreadPool<T, Policy>::nExecuted() const
+	{
+		std::uint64_t n = 0;
+		for (std::size_t i = 0; i < _executed.size(); ++i)
+			n += _executed[i].load(std::memory_order_relaxed);
+		return n;
+	}
+
+	template < class T, class Policy >
+	inline void BasicThreadPool<T, Policy>::threadJob(const std::size_t i)
+	{
+		static const std::size_t MIN_SPINS = 16;
+		T task;
+		std::size_t spins = MIN_SPINS;
+		while (_active.load(std::memory_order_relaxed)) {
+			// the policy is a constant: the branches not taken are compiled out
+			if (_queue.try_dequeue(task) || (Policy::IDLE_POLICY != IdlePolicy::Block && spinForTask(task, spins))) {
+				Policy::run(task);
+				if (Policy::STATS)
+					// single writer
+					_executed[i].store(_executed[i].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+			} else if (Policy::IDLE_POLICY != IdlePolicy::BusyPoll) {
+				const std::uint64_t key = _eventCount.prepareWait();
+				if (!_active.load(std::memory_order_relaxed) || _queue.size_approx() > 0)
+					_eventCount.cancelWait();
+				else
+					_eventCount.commitWait(key);
+			}
+		}
+	}
+
+	template < class T, class Policy >
+	inline bool BasicThreadPool<T, Policy>::spinForTask(T &task, std::size_t &spins)
+	{
+		static const std::size_t MIN_SPINS = 16;
+		static const std::size_t N_YIELDS  = 8;
+		const std::size_t maxSpins = BasicThreadPool::DEFAULT_MAX_SPINS();
+		const std::size_t n = Policy::IDLE_POLICY == IdlePolicy::BusyPoll ? maxSpins : std::min(spins, maxSpins);
+		for (std::size_t i = 0; i < n; ++i) {
+			internal::cpuRelax();
+			if (_queue.try_dequeue(task)) {
+				// tasks are arriving within the spin window: spin longer
+				spins = std::min(std::max(spins * 2, MIN_SPINS), maxSpins);
+				return true;
+			}
+			if (!_active.load(std::memory_order_relaxed))
+				return false;
+		}
+		for (std::size_t i = 0; i < N_YIELDS; ++i) {
+			std::this_thread::yield();
+			if (_queue.try_dequeue(task))
+				return true;
+		}
+		// spinning has been wasted: spin less next time
+		spins = std::max(spins / 2, MIN_SPINS);
+		return false;
+	}
+
+	template < class T, class Policy >
+	inline void BasicThreadPool<T, Policy>::notify(const std::size_t n)
+	{
+		if (Policy::IDLE_POLICY == IdlePolicy::BusyPoll)
+			return;
+		if (n > 1)
+			_eventCount.notifyAll();
+		else
+			_eventCount.notifyOne();
+	}
+
+	////////////////////////////////////////////////////////////////////////////
+
+}
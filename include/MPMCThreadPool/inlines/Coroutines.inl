@@ -0,0 +1,339 @@
+// Copyright (c) 2016 Giorgio Marcias
+//
+// This source code is subject to the simplified BSD license.
+//
+// Author: Giorgio Marcias
+// email: marcias.giorgio@gmail.com
+
+#include <MPMCThreadPool/Coroutines.hpp>
+
+namespace mpmc_tp {
+
+	////////////////////////////////////////////////////////////////////////////
+	// SCHEDULING
+	////////////////////////////////////////////////////////////////////////////
+
+	inline ScheduleAwaiter::ScheduleAwaiter(MPMCThreadPool &pool) : _pool(&pool)
+	{ }
+
+	inline bool ScheduleAwaiter::await_ready() const noexcept
+	{
+		return false;
+	}
+
+	inline void ScheduleAwaiter::await_suspend(std::coroutine_handle<> coroutine)
+	{
+		internal::resubmit(*_pool, internal::ResumeTask(coroutine));
+	}
+
+	inline void ScheduleAwaiter::await_resume() const noexcept
+	{ }
+
+	inline ScheduleAwaiter MPMCThreadPool::schedule()
+	{
+		return ScheduleAwaiter(*this);
+	}
+
+	template < class T >
+	inline Future<T> MPMCThreadPool::spawn(CoroTask<T> &&task)
+	{
+		std::shared_ptr<internal::FutureState<T>> state = std::make_shared<internal::FutureState<T>>(*this);
+		internal::runCoroTask(*this, std::move(task), state);
+		return Future<T>(std::move(state));
+	}
+
+	////////////////////////////////////////////////////////////////////////////
+
+
+
+	////////////////////////////////////////////////////////////////////////////
+	// INTERNAL STUFF
+	////////////////////////////////////////////////////////////////////////////
+
+	namespace internal {
+
+		////////////////////////////////////////////////////////////////////////
+		// ResumeTask METHODS
+		////////////////////////////////////////////////////////////////////////
+
+		inline ResumeTask::ResumeTask(std::coroutine_handle<> coroutine) : _coroutine(coroutine)
+		{ }
+
+		inline void ResumeTask::operator()()
+		{
+			_coroutine.resume();
+		}
+
+		////////////////////////////////////////////////////////////////////////
+
+
+
+		////////////////////////////////////////////////////////////////////////
+		// CoroPromiseBase METHODS
+		////////////////////////////////////////////////////////////////////////
+
+		inline bool CoroPromiseBase::FinalAwaiter::await_ready() const noexcept
+		{
+			return false;
+		}
+
+		template < class Promise >
+		inline std::coroutine_handle<> CoroPromiseBase::FinalAwaiter::await_suspend(std::coroutine_handle<Promise> coroutine) noexcept
+		{
+			std::coroutine_handle<> continuation = coroutine.promise()._continuation;
+			return continuation ? continuation : std::noop_coroutine();
+		}
+
+		inline void CoroPromiseBase::FinalAwaiter::await_resume() const noexcept
+		{ }
+
+		inline std::suspend_always CoroPromiseBase::initial_suspend() const noexcept
+		{
+			return std::suspend_always();
+		}
+
+		inline CoroPromiseBase::FinalAwaiter CoroPromiseBase::final_suspend() const noexcept
+		{
+			return FinalAwaiter();
+		}
+
+		inline void CoroPromiseBase::unhandled_exception() noexcept
+		{
+			_exception = std::current_exception();
+		}
+
+		inline void CoroPromiseBase::setContinuation(std::coroutine_handle<> continuation) noexcept
+		{
+			_continuation = continuation;
+		}
+
+		////////////////////////////////////////////////////////////////////////
+
+
+
+		////////////////////////////////////////////////////////////////////////
+		// CoroPromise METHODS
+		////////////////////////////////////////////////////////////////////////
+
+		template < class T >
+		inline CoroTask<T> CoroPromise<T>::get_return_object() noexcept
+		{
+			return CoroTask<T>(std::coroutine_handle<CoroPromise>::from_promise(*this));
+		}
+
+		template < class T > template < class U >
+		inline void CoroPromise<T>::return_value(U &&value)
+		{
+			_value.emplace(std::forward<U>(value));
+		}
+
+		template < class T >
+		inline T CoroPromise<T>::result()
+		{
+			if (_exception)
+				std::rethrow_exception(_exception);
+			return std::move(*_value);
+		}
+
+		inline CoroTask<void> CoroPromise<void>::get_return_object() noexcept
+		{
+			return CoroTask<void>(std::coroutine_handle<CoroPromise>::from_promise(*this));
+		}
+
+		inline void CoroPromise<void>::return_void() const noexcept
+		{ }
+
+		inline void CoroPromise<void>::result()
+		{
+			if (_exception)
+				std::rethrow_exception(_exception);
+		}
+
+		////////////////////////////////////////////////////////////////////////
+
+
+
+		////////////////////////////////////////////////////////////////////////
+		// DetachedCoroutine METHODS
+		////////////////////////////////////////////////////////////////////////
+
+		inline DetachedCoroutine DetachedCoroutine::promise_type::get_return_object() const noexcept
+		{
+			return DetachedCoroutine();
+		}
+
+		inline std::suspend_never DetachedCoroutine::promise_type::initial_suspend() const noexcept
+		{
+			return std::suspend_never();
+		}
+
+		inline std::suspend_never DetachedCoroutine::promise_type::final_suspend() const noexcept
+		{
+			return std::suspend_never();
+		}
+
+		inline void DetachedCoroutine::promise_type::return_void() const noexcept
+		{ }
+
+		inline void DetachedCoroutine::promise_type::unhandled_exception() const noexcept
+		{
+			std::terminate();
+		}
+
+		template < class T >
+		inline DetachedCoroutine runCoroTask(MPMCThreadPool &pool, CoroTask<T> task, std::shared_ptr<FutureState<T>> state)
+		{
+			co_await pool.schedule();
+			try {
+				if constexpr (std::is_void<T>::value) {
+					co_await std::move(task);
+					auto g = [](){ };
+					state->run(g);
+				} else {
+					T value = co_await std::move(task);
+					auto g = [&value](){ return std::move(value); };
+					state->run(g);
+				}
+			} catch (...) {
+				state->setException(std::current_exception());
+			}
+		}
+
+		////////////////////////////////////////////////////////////////////////
+
+	}
+
+	////////////////////////////////////////////////////////////////////////////
+
+
+
+	////////////////////////////////////////////////////////////////////////////
+	// CoroTask METHODS
+	////////////////////////////////////////////////////////////////////////////
+
+	template < class T >
+	inline CoroTask<T>::Awaiter::Awaiter(std::coroutine_handle<promise_type> coroutine) noexcept : _coroutine(coroutine)
+	{ }
+
+	template < class T >
+	inline bool CoroTask<T>::Awaiter::await_ready() const noexcept
+	{
+		return !_coroutine || _coroutine.done();
+	}
+
+	template < class T >
+	inline std::coroutine_handle<> CoroTask<T>::Awaiter::await_suspend(std::coroutine_handle<> awaiting) noexcept
+	{
+		_coroutine.promise().setContinuation(awaiting);
+		return _coroutine;
+	}
+
+	template < class T >
+	inline T CoroTask<T>::Awaiter::await_resume()
+	{
+		if (!_coroutine)
+			throw std::future_error(std::future_errc::no_state);
+		return _coroutine.promise().result();
+	}
+
+	template < class T >
+	inline CoroTask<T>::CoroTask() noexcept
+	{ }
+
+	template < class T >
+	inline CoroTask<T>::CoroTask(std::coroutine_handle<promise_type> coroutine) noexcept : _coroutine(coroutine)
+	{ }
+
+	template < class T >
+	inline CoroTask<T>::CoroTask(CoroTask &&other) noexcept : _coroutine(other._coroutine)
+	{
+		other._coroutine = nullptr;
+	}
+
+	template < class T >
+	inline CoroTask<T>::~CoroTask()
+	{
+		if (_coroutine)
+			_coroutine.destroy();
+	}
+
+	template < class T >
+	inline CoroTask<T> & CoroTask<T>::operator=(CoroTask &&other) noexcept
+	{
+		if (this != &other) {
+			if (_coroutine)
+				_coroutine.destroy();
+			_coroutine = other._coroutine;
+			other._coroutine = nullptr;
+		}
+		return *this;
+	}
+
+	template < class T >
+	inline bool CoroTask<T>::valid() const noexcept
+	{
+		return static_cast<bool>(_coroutine);
+	}
+
+	template < class T >
+	inline typename CoroTask<T>::Awaiter CoroTask<T>::operator co_await() && noexcept
+	{
+		return Awaiter(_coroutine);
+	}
+
+	////////////////////////////////////////////////////////////////////////////
+
+
+
+	////////////////////////////////////////////////////////////////////////////
+	// TaskPackTraitsAwaitable METHODS
+	////////////////////////////////////////////////////////////////////////////
+
+	inline TaskPackTraitsAwaitable::Awaiter::Awaiter(const TaskPackTraitsAwaitable &traits) noexcept : _traits(&traits)
+	{ }
+
+	inline bool TaskPackTraitsAwaitable::Awaiter::await_ready() const noexcept
+	{
+		return _traits->_completion.complete();
+	}
+
+	inline bool TaskPackTraitsAwaitable::Awaiter::await_suspend(std::coroutine_handle<> coroutine) noexcept
+	{
+		// if the last task has already completed, _waiter is not null and the
+		// coroutine goes on without suspending
+		void *expected = nullptr;
+		return _traits->_waiter.compare_exchange_strong(expected, coroutine.address(), std::memory_order_acq_rel);
+	}
+
+	inline void TaskPackTraitsAwaitable::Awaiter::await_resume() const noexcept
+	{ }
+
+	inline TaskPackTraitsAwaitable::TaskPackTraitsAwaitable(const std::size_t size) : TaskPackTraitsLockFree(size), _waiter(nullptr)
+	{ }
+
+	inline void TaskPackTraitsAwaitable::setTraitsSize(const std::size_t size)
+	{
+		TaskPackTraitsLockFree::setTraitsSize(size);
+		_waiter.store(nullptr, std::memory_order_relaxed);
+	}
+
+	inline void TaskPackTraitsAwaitable::signalTaskComplete(const std::size_t i)
+	{
+		if (_callback)
+			_callback(i);
+		if (_completion.signal(i)) {
+			// the resumed coroutine may destroy the pack: do not touch it after
+			void *waiter = _waiter.exchange(this, std::memory_order_acq_rel);
+			if (waiter != nullptr)
+				std::coroutine_handle<>::from_address(waiter).resume();
+		}
+	}
+
+	inline TaskPackTraitsAwaitable::Awaiter TaskPackTraitsAwaitable::operator co_await() const noexcept
+	{
+		return Awaiter(*this);
+	}
+
+	////////////////////////////////////////////////////////////////////////////
+
+}
@@ -0,0 +1,408 @@
+// Copyright (c) 2016 Giorgio Marcias
+//
+// This source code is subject to the simplified BSD license.
+//
+// Author: Giorgio Marcias
+// email: marcias.giorgio@gmail.com
+
+#include <MPMCThreadPool/IOExecutor.hpp>
+
+namespace mpmc_tp {
+
+	////////////////////////////////////////////////////////////////////////////
+	// INTERNAL STUFF
+	////////////////////////////////////////////////////////////////////////////
+
+	namespace internal {
+
+		////////////////////////////////////////////////////////////////////////
+		// IOOperation METHODS
+		////////////////////////////////////////////////////////////////////////
+
+		inline IOOperation::IOOperation(const bool write, const int fd, void *buffer, const std::size_t size, const std::int64_t offset) : write(write), fd(fd), buffer(buffer), size(size), offset(offset)
+		{ }
+
+		////////////////////////////////////////////////////////////////////////
+
+
+
+		////////////////////////////////////////////////////////////////////////
+		// IOCallback METHODS
+		////////////////////////////////////////////////////////////////////////
+
+		template < class F > template < class G >
+		inline IOCallback<F>::IOCallback(const bool write, const int fd, void *buffer, const std::size_t size, const std::int64_t offset, G &&g) : IOOperation(write, fd, buffer, size, offset), _f(std::forward<G>(g))
+		{ }
+
+		template < class F >
+		inline void IOCallback<F>::complete(MPMCThreadPool &pool, const std::ptrdiff_t result)
+		{
+			resubmit(pool, IOCompletion<F>(std::move(_f), result));
+		}
+
+		////////////////////////////////////////////////////////////////////////
+
+
+
+		////////////////////////////////////////////////////////////////////////
+		// IOCompletion METHODS
+		////////////////////////////////////////////////////////////////////////
+
+		template < class F > template < class G >
+		inline IOCompletion<F>::IOCompletion(G &&g, const std::ptrdiff_t result) : _f(std::forward<G>(g)), _result(result)
+		{ }
+
+		template < class F >
+		inline void IOCompletion<F>::operator()()
+		{
+			_f(_result);
+		}
+
+		////////////////////////////////////////////////////////////////////////
+
+
+
+		////////////////////////////////////////////////////////////////////////
+		// IOResult METHODS
+		////////////////////////////////////////////////////////////////////////
+
+		inline IOResult::IOResult(const std::ptrdiff_t result) : _result(result)
+		{ }
+
+		inline std::ptrdiff_t IOResult::operator()() const
+		{
+			if (_result < 0)
+				throw std::system_error(static_cast<int>(-_result), std::generic_category());
+			return _result;
+		}
+
+		////////////////////////////////////////////////////////////////////////
+
+
+
+		////////////////////////////////////////////////////////////////////////
+		// IOPromise METHODS
+		////////////////////////////////////////////////////////////////////////
+
+		inline IOPromise::IOPromise(const bool write, const int fd, void *buffer, const std::size_t size, const std::int64_t offset, std::shared_ptr<FutureState<std::ptrdiff_t>> state) : IOOperation(write, fd, buffer, size, offset), _state(std::move(state))
+		{ }
+
+		inline void IOPromise::complete(MPMCThreadPool &pool, const std::ptrdiff_t result)
+		{
+			resubmit(pool, FutureTask<std::ptrdiff_t, IOResult>(std::move(_state), IOResult(result)));
+		}
+
+		////////////////////////////////////////////////////////////////////////
+
+
+
+		////////////////////////////////////////////////////////////////////////
+		// BlockingIOTask METHODS
+		////////////////////////////////////////////////////////////////////////
+
+		inline BlockingIOTask::BlockingIOTask(IOExecutor &executor, std::unique_ptr<IOOperation> &&op) : _executor(&executor), _op(std::move(op))
+		{ }
+
+		inline void BlockingIOTask::operator()()
+		{
+			std::ptrdiff_t result;
+			if (_op->write)
+				result = ::pwrite(_op->fd, _op->buffer, _op->size, static_cast<off_t>(_op->offset));
+			else
+				result = ::pread(_op->fd, _op->buffer, _op->size, static_cast<off_t>(_op->offset));
+			if (result < 0)
+				result = -errno;
+			_executor->finish(std::move(_op), result);
+		}
+
+		////////////////////////////////////////////////////////////////////////
+
+
+
+#if MPMC_TP_HAS_IO_URING
+		////////////////////////////////////////////////////////////////////////
+		// IORing METHODS
+		////////////////////////////////////////////////////////////////////////
+
+		inline IORing::IORing() : _fd(-1), _sqRing(MAP_FAILED), _sqRingSize(0), _cqRing(MAP_FAILED), _cqRingSize(0), _sqes(nullptr), _sqesSize(0), _sqHead(nullptr), _sqTail(nullptr), _sqArray(nullptr), _sqMask(0), _sqEntries(0), _cqHead(nullptr), _cqTail(nullptr), _cqes(nullptr), _cqMask(0), _pending(false), _submitting(false)
+		{ }
+
+		inline IORing::~IORing()
+		{
+			if (_sqes != nullptr)
+				::munmap(_sqes, _sqesSize);
+			if (_cqRing != MAP_FAILED && _cqRing != _sqRing)
+				::munmap(_cqRing, _cqRingSize);
+			if (_sqRing != MAP_FAILED)
+				::munmap(_sqRing, _sqRingSize);
+			if (_fd >= 0)
+				::close(_fd);
+		}
+
+		inline bool IORing::open(const unsigned entries)
+		{
+			io_uring_params params;
+			std::memset(&params, 0, sizeof(params));
+			const long fd = ::syscall(__NR_io_uring_setup, entries, &params);
+			if (fd < 0)
+				return false;
+			// IORING_OP_READ and IORING_OP_WRITE come with the same kernel
+			// (5.7) as IORING_FEAT_FAST_POLL
+			if (!(params.features & IORING_FEAT_FAST_POLL)) {
+				::close(static_cast<int>(fd));
+				return false;
+			}
+			_fd = static_cast<int>(fd);
+			_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+			_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+			if (params.features & IORING_FEAT_SINGLE_MMAP)
+				_sqRingSize = _cqRingSize = std::max(_sqRingSize, _cqRingSize);
+			_sqRing = ::mmap(nullptr, _sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQ_RING);
+			if (_sqRing == MAP_FAILED)
+				return false;
+			if (params.features & IORING_FEAT_SINGLE_MMAP)
+				_cqRing = _sqRing;
+			else
+				_cqRing = ::mmap(nullptr, _cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_CQ_RING);
+			if (_cqRing == MAP_FAILED)
+				return false;
+			_sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+			void *sqes = ::mmap(nullptr, _sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQES);
+			if (sqes == MAP_FAILED)
+				return false;
+			_sqes = static_cast<io_uring_sqe *>(sqes);
+			unsigned char *sq = static_cast<unsigned char *>(_sqRing);
+			unsigned char *cq = static_cast<unsigned char *>(_cqRing);
+			_sqHead = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+			_sqTail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+			_sqArray = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+			_sqMask = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+			_sqEntries = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_entries);
+			_cqHead = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+			_cqTail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+			_cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+			_cqMask = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+			return true;
+		}
+
+		inline bool IORing::isOpen() const
+		{
+			return _sqes != nullptr;
+		}
+
+		inline void IORing::push(const std::uint8_t opcode, const int fd, void *buffer, const std::size_t size, const std::int64_t offset, const std::uint64_t userData)
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			// the tail is written by the producers only, under _mutex
+			const unsigned tail = *_sqTail;
+			while (tail - __atomic_load_n(_sqHead, __ATOMIC_ACQUIRE) == _sqEntries)
+				// the queue is full: hand its entries over to the kernel
+				if (enter(_sqEntries, 0, 0) < 0)
+					std::this_thread::yield();
+			const unsigned index = tail & _sqMask;
+			io_uring_sqe &sqe = _sqes[index];
+			std::memset(&sqe, 0, sizeof(sqe));
+			sqe.opcode = opcode;
+			sqe.fd = fd;
+			sqe.addr = reinterpret_cast<std::uint64_t>(buffer);
+			// no more than Linux transfers at once, as pread and pwrite: the
+			// operation completes short, rather than with a length truncated
+			// to 32 bits or a result overflowing cqe.res
+			static const std::size_t MAX_LEN = 0x7ffff000;
+			sqe.len = static_cast<std::uint32_t>(std::min(size, MAX_LEN));
+			sqe.off = static_cast<std::uint64_t>(offset);
+			sqe.user_data = userData;
+			_sqArray[index] = index;
+			__atomic_store_n(_sqTail, tail + 1, __ATOMIC_RELEASE);
+			_pending.store(true, std::memory_order_release);
+		}
+
+		inline void IORing::submit()
+		{
+			// whoever finds pending entries and no submitting thread submits
+			// them all, the ones pushed meanwhile included
+			while (_pending.load(std::memory_order_acquire) && !_submitting.exchange(true, std::memory_order_acquire)) {
+				while (_pending.exchange(false, std::memory_order_acq_rel))
+					// the kernel takes all the entries up to the tail
+					while (enter(_sqEntries, 0, 0) < 0 && (errno == EINTR || errno == EAGAIN || errno == EBUSY))
+						std::this_thread::yield();
+				_submitting.store(false, std::memory_order_release);
+			}
+		}
+
+		template < class F >
+		inline void IORing::reap(F &&f)
+		{
+			unsigned head = *_cqHead;
+			unsigned tail = __atomic_load_n(_cqTail, __ATOMIC_ACQUIRE);
+			if (head == tail) {
+				enter(0, 1, IORING_ENTER_GETEVENTS);
+				tail = __atomic_load_n(_cqTail, __ATOMIC_ACQUIRE);
+			}
+			// the completed entries were published by the release stores of
+			// the submission tail in push (ordered among producers by
+			// _mutex): acquiring it orders the accesses to their user data
+			// before these completions, which the kernel orders but the
+			// language does not see through the rings
+			if (head != tail)
+				__atomic_load_n(_sqTail, __ATOMIC_ACQUIRE);
+			for (; head != tail; ++head) {
+				const io_uring_cqe &cqe = _cqes[head & _cqMask];
+				f(cqe.user_data, static_cast<std::ptrdiff_t>(cqe.res));
+			}
+			__atomic_store_n(_cqHead, head, __ATOMIC_RELEASE);
+		}
+
+		inline int IORing::enter(const unsigned toSubmit, const unsigned minComplete, const unsigned flags)
+		{
+			return static_cast<int>(::syscall(__NR_io_uring_enter, _fd, toSubmit, minComplete, flags, nullptr, 0));
+		}
+
+		////////////////////////////////////////////////////////////////////////
+#endif
+
+	}
+
+	////////////////////////////////////////////////////////////////////////////
+
+
+
+	////////////////////////////////////////////////////////////////////////////
+	// IOExecutor METHODS
+	////////////////////////////////////////////////////////////////////////////
+
+	inline std::size_t IOExecutor::DEFAULT_QUEUE_DEPTH()
+	{
+		return 256;
+	}
+
+	inline IOExecutor::IOExecutor(MPMCThreadPool &pool, const std::size_t queueDepth) : _pool(&pool), _inFlight(0)
+	{
+#if MPMC_TP_HAS_IO_URING
+		if (_ring.open(static_cast<unsigned>(std::max(queueDepth, std::size_t(1)))))
+			_reaper = std::thread(&IOExecutor::reap, this);
+#else
+		(void)queueDepth;
+#endif
+	}
+
+	inline IOExecutor::~IOExecutor()
+	{
+		wait();
+#if MPMC_TP_HAS_IO_URING
+		if (_reaper.joinable()) {
+			// a no-op without operation stops the reaper
+			_ring.push(IORING_OP_NOP, -1, nullptr, 0, 0, 0);
+			_ring.submit();
+			_reaper.join();
+		}
+#endif
+	}
+
+	template < class F >
+	inline void IOExecutor::read(const int fd, void *buffer, const std::size_t size, const std::int64_t offset, F &&f)
+	{
+		start(std::unique_ptr<internal::IOOperation>(new internal::IOCallback<typename std::decay<F>::type>(false, fd, buffer, size, offset, std::forward<F>(f))));
+	}
+
+	template < class F >
+	inline void IOExecutor::write(const int fd, const void *buffer, const std::size_t size, const std::int64_t offset, F &&f)
+	{
+		start(std::unique_ptr<internal::IOOperation>(new internal::IOCallback<typename std::decay<F>::type>(true, fd, const_cast<void *>(buffer), size, offset, std::forward<F>(f))));
+	}
+
+	inline Future<std::ptrdiff_t> IOExecutor::read(const int fd, void *buffer, const std::size_t size, const std::int64_t offset)
+	{
+		std::shared_ptr<internal::FutureState<std::ptrdiff_t>> state = std::make_shared<internal::FutureState<std::ptrdiff_t>>(*_pool);
+		start(std::unique_ptr<internal::IOOperation>(new internal::IOPromise(false, fd, buffer, size, offset, state)));
+		return Future<std::ptrdiff_t>(std::move(state));
+	}
+
+	inline Future<std::ptrdiff_t> IOExecutor::write(const int fd, const void *buffer, const std::size_t size, const std::int64_t offset)
+	{
+		std::shared_ptr<internal::FutureState<std::ptrdiff_t>> state = std::make_shared<internal::FutureState<std::ptrdiff_t>>(*_pool);
+		start(std::unique_ptr<internal::IOOperation>(new internal::IOPromise(true, fd, const_cast<void *>(buffer), size, offset, state)));
+		return Future<std::ptrdiff_t>(std::move(state));
+	}
+
+	inline void IOExecutor::wait()
+	{
+		const bool helping = internal::currentWorker() != nullptr;
+		while (_inFlight.load(std::memory_order_acquire) > 0) {
+			if (helping) {
+				// a thread of a pool runs the pending tasks meanwhile
+				if (!internal::helpCurrentPool())
+					std::this_thread::yield();
+			} else {
+				const std::uint64_t key = _eventCount.prepareWait();
+				if (_inFlight.load(std::memory_order_acquire) > 0)
+					_eventCount.commitWait(key);
+				else
+					_eventCount.cancelWait();
+			}
+		}
+	}
+
+	inline std::size_t IOExecutor::inFlight() const
+	{
+		return _inFlight.load(std::memory_order_relaxed);
+	}
+
+	inline bool IOExecutor::usesIOUring() const
+	{
+#if MPMC_TP_HAS_IO_URING
+		return _ring.isOpen();
+#else
+		return false;
+#endif
+	}
+
+	inline void IOExecutor::start(std::unique_ptr<internal::IOOperation> &&op)
+	{
+#if MPMC_TP_HAS_IO_URING
+		if (_ring.isOpen()) {
+			const std::uint8_t opcode = op->write ? IORING_OP_WRITE : IORING_OP_READ;
+			const int fd = op->fd;
+			void *buffer = op->buffer;
+			const std::size_t size = op->size;
+			const std::int64_t offset = op->offset;
+			internal::IOOperation *o = op.release();
+			// o is not accessed from now on but by the reaper: push publishes
+			// it with the release store of the submission tail, which reap
+			// acquires
+			_inFlight.fetch_add(1, std::memory_order_relaxed);
+			_ring.push(opcode, fd, buffer, size, offset, reinterpret_cast<std::uint64_t>(o));
+			_ring.submit();
+			return;
+		}
+#endif
+		_inFlight.fetch_add(1, std::memory_order_relaxed);
+		_pool->submitBlocking(internal::BlockingIOTask(*this, std::move(op)));
+	}
+
+	inline void IOExecutor::finish(std::unique_ptr<internal::IOOperation> &&op, const std::ptrdiff_t result)
+	{
+		op->complete(*_pool, result);
+		op.reset();
+		if (_inFlight.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			_eventCount.notifyAll();
+	}
+
+	inline void IOExecutor::reap()
+	{
+#if MPMC_TP_HAS_IO_URING
+		bool stop = false;
+		while (!stop)
+			_ring.reap([this, &stop](const std::uint64_t userData, const std::ptrdiff_t result) {
+				if (userData == 0) {
+					stop = true;
+					return;
+				}
+				finish(std::unique_ptr<internal::IOOperation>(reinterpret_cast<internal::IOOperation *>(userData)), result);
+			});
+#endif
+	}
+
+	////////////////////////////////////////////////////////////////////////////
+
+}
@@ -6,331 +6,415 @@
 // email: marcias.giorgio@gmail.com
 
 #include <MPMCThreadPool/MPMCThreadPool.hpp>
-#include <future>
 
 namespace mpmc_tp {
 
 	////////////////////////////////////////////////////////////////////////////
-	// MPMCThreadPool METHODS
+	// BasicTask METHODS
 	////////////////////////////////////////////////////////////////////////////
 
-	inline std::size_t MPMCThreadPool::DEFAULT_SIZE()
-	{
-		return std::thread::hardware_concurrency();
-	}
+	namespace internal {
 
-	inline MPMCThreadPool::MPMCThreadPool() : _threads(MPMCThreadPool::DEFAULT_SIZE()), _actives(MPMCThreadPool::DEFAULT_SIZE()), _nActives(0), _active(true)
-	{
-		_flag.clear();
-		for (std::size_t i = 0; i < _actives.size(); ++i)
-			_actives.at(i).store(true, std::memory_order::memory_order_relaxed);
-		for (std::size_t i = 0; i < _threads.size(); ++i)
-			_threads.at(i) = std::thread(&MPMCThreadPool::threadJob, this, std::ref(_actives.at(i)));
-	}
+		template < class F >
+		inline bool isNullCallable(const F &)
+		{
+			return false;
+		}
 
-	inline MPMCThreadPool::MPMCThreadPool(const std::size_t size) : _threads(size), _actives(size), _nActives(0), _active(true)
-	{
-		_flag.clear();
-		for (std::size_t i = 0; i < _actives.size(); ++i)
-			_actives.at(i).store(true, std::memory_order::memory_order_relaxed);
-		for (std::size_t i = 0; i < _threads.size(); ++i)
-			_threads.at(i) = std::thread(&MPMCThreadPool::threadJob, this, std::ref(_actives.at(i)));
-	}
+		template < class F >
+		inline bool isNullCallable(F *f)
+		{
+			return f == nullptr;
+		}
 
-	inline MPMCThreadPool::~MPMCThreadPool()
-	{
-		while (_flag.test_and_set())
-			;
-		_active.store(false, std::memory_order::memory_order_relaxed);
-		while (_nActives.load(std::memory_order::memory_order_relaxed) > std::size_t(0))
-			_condVar.notify_all();
-		for (std::size_t i = 0; i < _threads.size(); ++i)
-			if (_threads.at(i).joinable())
-				_threads.at(i).join();
-		_flag.clear();
-	}
+		template < class S >
+		inline bool isNullCallable(const std::function<S> &f)
+		{
+			return !f;
+		}
 
-	inline std::size_t MPMCThreadPool::size() const
-	{
-		while (_flag.test_and_set())
-			;
-		std::size_t size = _threads.size();
-		_flag.clear();
-		return size;
 	}
 
-	inline void MPMCThreadPool::expand(const std::size_t n)
+	template < std::size_t BufferSize > template < class F >
+	inline void BasicTask<BufferSize>::InlineManager<F>::invoke(void *p)
 	{
-		while (_flag.test_and_set())
-			;
-		std::size_t oldSize = _threads.size();
-		_threads.resize(oldSize + n);
-		_actives.resize(oldSize + n);
-		for (std::size_t i = 0; i < n; ++i)
-			_actives.at(oldSize + i).store(true, std::memory_order::memory_order_relaxed);
-		for (std::size_t i = 0; i < n; ++i)
-			_threads.at(oldSize + i) = std::thread(&MPMCThreadPool::threadJob, this, std::ref(_actives.at(oldSize + i)));
-		_flag.clear();
+		(*static_cast<F *>(p))();
 	}
 
-	inline void MPMCThreadPool::shrink(const std::size_t n)
+	template < std::size_t BufferSize > template < class F >
+	inline void BasicTask<BufferSize>::InlineManager<F>::move(void *dst, void *src)
 	{
-		while (_flag.test_and_set())
-			;
-		std::size_t newSize = _threads.size() - std::min(_threads.size(), n);
-		for (std::size_t i = newSize; i < _actives.size(); ++i)
-			_actives.at(i).store(false, std::memory_order::memory_order_release);
-		while (_nActives.load(std::memory_order::memory_order_relaxed) > newSize)
-			_condVar.notify_all();
-		for (std::size_t i = newSize; i < _threads.size(); ++i)
-			if (_threads.at(i).joinable())
-				_threads.at(i).join();
-		_threads.resize(newSize);
-		_actives.resize(newSize);
-		_flag.clear();
+		::new (dst) F(std::move(*static_cast<F *>(src)));
+		static_cast<F *>(src)->~F();
 	}
 
-	inline ProducerToken MPMCThreadPool::newProducerToken()
+	template < std::size_t BufferSize > template < class F >
+	inline void BasicTask<BufferSize>::InlineManager<F>::destroy(void *p)
 	{
-		return ProducerToken(_taskQueue);
+		static_cast<F *>(p)->~F();
 	}
 
-	inline void MPMCThreadPool::submitTask(const SimpleTaskType &task)
+	template < std::size_t BufferSize > template < class F >
+	const typename BasicTask<BufferSize>::Manager BasicTask<BufferSize>::InlineManager<F>::MANAGER = { &InlineManager<F>::invoke, &InlineManager<F>::move, &InlineManager<F>::destroy, internal::IsDiscardable<F>::value };
+
+	template < std::size_t BufferSize > template < class F >
+	inline void BasicTask<BufferSize>::HeapManager<F>::invoke(void *p)
 	{
-		_taskQueue.enqueue(task);
-		std::unique_lock<std::mutex> lock(_mutex);
-		_condVar.notify_one();
+		(**static_cast<F **>(p))();
 	}
 
-	inline void MPMCThreadPool::submitTask(SimpleTaskType &&task)
+	template < std::size_t BufferSize > template < class F >
+	inline void BasicTask<BufferSize>::HeapManager<F>::move(void *dst, void *src)
 	{
-		_taskQueue.enqueue(std::forward<SimpleTaskType>(task));
-		std::unique_lock<std::mutex> lock(_mutex);
-		_condVar.notify_one();
+		*static_cast<F **>(dst) = *static_cast<F **>(src);
 	}
 
-	inline void MPMCThreadPool::submitTask(const ProducerToken &token, const SimpleTaskType &task)
+	template < std::size_t BufferSize > template < class F >
+	inline void BasicTask<BufferSize>::HeapManager<F>::destroy(void *p)
 	{
-		_taskQueue.enqueue(token, task);
-		std::unique_lock<std::mutex> lock(_mutex);
-		_condVar.notify_one();
+		delete *static_cast<F **>(p);
 	}
 
-	inline void MPMCThreadPool::submitTask(const ProducerToken &token, SimpleTaskType &&task)
+	template < std::size_t BufferSize > template < class F >
+	const typename BasicTask<BufferSize>::Manager BasicTask<BufferSize>::HeapManager<F>::MANAGER = { &HeapManager<F>::invoke, &HeapManager<F>::move, &HeapManager<F>::destroy, internal::IsDiscardable<F>::value };
+
+	template < std::size_t BufferSize >
+	inline BasicTask<BufferSize>::BasicTask() noexcept : _manager(nullptr)
+	{ }
+
+	template < std::size_t BufferSize >
+	inline BasicTask<BufferSize>::BasicTask(std::nullptr_t) noexcept : _manager(nullptr)
+	{ }
+
+	template < std::size_t BufferSize > template < class F, class >
+	inline BasicTask<BufferSize>::BasicTask(F &&f) : _manager(nullptr)
 	{
-		_taskQueue.enqueue(token, std::forward<SimpleTaskType>(task));
-		std::unique_lock<std::mutex> lock(_mutex);
-		_condVar.notify_one();
+		if (!internal::isNullCallable(f))
+			store(std::forward<F>(f), FitsInline<typename std::decay<F>::type>());
 	}
 
-	template < class It >
-	inline void MPMCThreadPool::submitTasks(It first, It last)
+	template < std::size_t BufferSize >
+	inline BasicTask<BufferSize>::BasicTask(BasicTask &&other) noexcept : _manager(other._manager)
+#if MPMC_TP_STATS
+	, _submitTime(other._submitTime)
+#endif
 	{
-		std::size_t n = std::distance(first, last);
-		if (n == 0)
-			return;
-		_taskQueue.enqueue_bulk(std::forward<It>(first), n);
-		std::unique_lock<std::mutex> lock(_mutex);
-		if (n > 1)
-			_condVar.notify_all();
-		else
-			_condVar.notify_one();
+		if (_manager != nullptr) {
+			_manager->move(&_buffer, &other._buffer);
+			other._manager = nullptr;
+		}
 	}
 
-	template < class It >
-	inline void MPMCThreadPool::submitTasks(const ProducerToken &token, It first, It last)
+	template < std::size_t BufferSize >
+	inline BasicTask<BufferSize>::~BasicTask()
 	{
-		std::size_t n = std::distance(first, last);
-		if (n == 0)
-			return;
-		_taskQueue.enqueue_bulk(token, std::forward<It>(first), n);
-		std::unique_lock<std::mutex> lock(_mutex);
-		if (n > 1)
-			_condVar.notify_all();
-		else
-			_condVar.notify_one();
+		if (_manager != nullptr)
+			_manager->destroy(&_buffer);
 	}
 
-	inline void MPMCThreadPool::threadJob(std::atomic_bool &active)
+	template < std::size_t BufferSize >
+	inline BasicTask<BufferSize> & BasicTask<BufferSize>::operator=(BasicTask &&other) noexcept
 	{
-		SimpleTaskType task;
-		_nActives.fetch_add(1, std::memory_order::memory_order_relaxed);
-		while (_active.load(std::memory_order::memory_order_relaxed) && active.load(std::memory_order::memory_order_relaxed)) {
-			if (_taskQueue.try_dequeue(task)) {
-				if (task)
-					task();
-			} else {
-				std::unique_lock<std::mutex> lock(_mutex);
-				_condVar.wait(lock, [this, &active]()->bool{
-					return !_active.load(std::memory_order::memory_order_relaxed) || !active.load(std::memory_order::memory_order_relaxed) || _taskQueue.size_approx() > 0;
-				});
+		if (this != &other) {
+			if (_manager != nullptr)
+				_manager->destroy(&_buffer);
+			_manager = other._manager;
+			if (_manager != nullptr) {
+				_manager->move(&_buffer, &other._buffer);
+				other._manager = nullptr;
 			}
+#if MPMC_TP_STATS
+			_submitTime = other._submitTime;
+#endif
 		}
-		_nActives.fetch_sub(1, std::memory_order::memory_order_relaxed);
+		return *this;
 	}
 
-	////////////////////////////////////////////////////////////////////////////
-
-
-
-
-
-
-	////////////////////////////////////////////////////////////////////////////
-	// TRAITS
-	////////////////////////////////////////////////////////////////////////////
-
-	////////////////////////////////////////////////////////////////////////
-	// TaskPackTraitsLockFree METHODS
-	////////////////////////////////////////////////////////////////////////
-
-	inline TaskPackTraitsLockFree::TaskPackTraitsLockFree(const std::size_t size) : _size(size), _nCompletedTasks(0), _interval(0)
-	{ }
-
-	template < class Rep, class Period >
-	inline TaskPackTraitsLockFree::TaskPackTraitsLockFree(const std::size_t size, const std::chrono::duration<Rep, Period> &interval) : _size(size), _nCompletedTasks(0), _interval(interval)
-	{ }
-
-	template < class Rep, class Period >
-	inline TaskPackTraitsLockFree::TaskPackTraitsLockFree(const std::size_t size, std::chrono::duration<Rep, Period> &&interval) : _size(size), _nCompletedTasks(0), _interval(std::forward<std::chrono::duration<Rep, Period>>(interval))
-	{ }
-
-	inline void TaskPackTraitsLockFree::setTraitsSize(const std::size_t size)
+	template < std::size_t BufferSize >
+	inline BasicTask<BufferSize> & BasicTask<BufferSize>::operator=(std::nullptr_t) noexcept
 	{
-		_size = size;
+		if (_manager != nullptr)
+			_manager->destroy(&_buffer);
+		_manager = nullptr;
+		return *this;
 	}
 
-	template < class Rep, class Period >
-	inline void TaskPackTraitsLockFree::setInterval(const std::chrono::duration<Rep, Period> &interval)
+	template < std::size_t BufferSize >
+	inline BasicTask<BufferSize>::operator bool() const noexcept
 	{
-		_interval = interval;
+		return _manager != nullptr;
 	}
 
-	template < class Rep, class Period >
-	inline void TaskPackTraitsLockFree::setInterval(std::chrono::duration<Rep, Period> &&interval)
+	template < std::size_t BufferSize >
+	inline void BasicTask<BufferSize>::operator()()
 	{
-		_interval = std::forward<std::chrono::duration<Rep, Period>>(interval);
+		if (_manager == nullptr)
+			throw std::bad_function_call();
+		_manager->invoke(&_buffer);
 	}
 
-	template < class C, class ...Args >
-	inline void TaskPackTraitsLockFree::setCallback(C &&c, Args &&...args)
+	template < std::size_t BufferSize >
+	inline bool BasicTask<BufferSize>::discardable() const noexcept
 	{
-		_callback = std::bind(std::forward<C>(c), std::placeholders::_1, std::forward<Args>(args)...);
+		return _manager == nullptr || _manager->discardable;
 	}
 
-	inline void TaskPackTraitsLockFree::signalTaskComplete(const std::size_t i)
+#if MPMC_TP_STATS
+	template < std::size_t BufferSize >
+	inline void BasicTask<BufferSize>::setSubmitTime(const std::chrono::steady_clock::time_point time) noexcept
 	{
-		_nCompletedTasks.fetch_add(1, std::memory_order::memory_order_relaxed);
-		if (_callback)
-			_callback(i);
+		_submitTime = time;
 	}
 
-	inline std::size_t TaskPackTraitsLockFree::nCompletedTasks() const
+	template < std::size_t BufferSize >
+	inline std::chrono::steady_clock::time_point BasicTask<BufferSize>::submitTime() const noexcept
 	{
-		return _nCompletedTasks.load(std::memory_order::memory_order_relaxed);
+		return _submitTime;
 	}
+#endif
 
-	inline void TaskPackTraitsLockFree::wait() const
+	template < std::size_t BufferSize > template < class F >
+	inline void BasicTask<BufferSize>::store(F &&f, std::true_type)
 	{
-		waitComplete();
+		using Callable = typename std::decay<F>::type;
+		::new (&_buffer) Callable(std::forward<F>(f));
+		_manager = &InlineManager<Callable>::MANAGER;
 	}
 
-	inline void TaskPackTraitsLockFree::waitComplete() const
+	template < std::size_t BufferSize > template < class F >
+	inline void BasicTask<BufferSize>::store(F &&f, std::false_type)
 	{
-		while (_nCompletedTasks.load(std::memory_order::memory_order_relaxed) < _size)
-			if (_interval.count() > 0)
-				std::this_thread::sleep_for(_interval);
+		using Callable = typename std::decay<F>::type;
+		::new (&_buffer) Callable *(new Callable(std::forward<F>(f)));
+		_manager = &HeapManager<Callable>::MANAGER;
 	}
 
-	////////////////////////////////////////////////////////////////////////
+	////////////////////////////////////////////////////////////////////////////
 
 
 
-	////////////////////////////////////////////////////////////////////////
-	// TaskPackTraitsBlocking METHODS
-	////////////////////////////////////////////////////////////////////////
+	////////////////////////////////////////////////////////////////////////////
+	// EventCount METHODS
+	////////////////////////////////////////////////////////////////////////////
 
-	inline TaskPackTraitsBlocking::TaskPackTraitsBlocking(const std::size_t size) : TaskPackTraitsLockFree(size), _waitWoken(false)
-	{ }
+	namespace internal {
 
-	template < class Rep, class Period >
-	inline TaskPackTraitsBlocking::TaskPackTraitsBlocking(const std::size_t size, const std::chrono::duration<Rep, Period> &interval) : TaskPackTraitsLockFree(size, interval), _waitWoken(false)
-	{ }
+		inline void cpuRelax()
+		{
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+			_mm_pause();
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__i386__) || defined(__x86_64__))
+			__builtin_ia32_pause();
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__aarch64__) || defined(__arm__))
+			__asm__ __volatile__("yield");
+#endif
+		}
 
-	template < class Rep, class Period >
-	inline TaskPackTraitsBlocking::TaskPackTraitsBlocking(const std::size_t size, std::chrono::duration<Rep, Period> &&interval) : TaskPackTraitsLockFree(size, std::forward<std::chrono::duration<Rep, Period>>(interval)), _waitWoken(false)
-	{ }
+		inline EventCount::EventCount() : _state(0)
+		{ }
 
-	inline void TaskPackTraitsBlocking::signalTaskComplete(const std::size_t i)
-	{
-		TaskPackTraitsLockFree::signalTaskComplete(i);
-		while (_nCompletedTasks.load(std::memory_order::memory_order_relaxed) >= _size && !_waitWoken.load(std::memory_order::memory_order_relaxed))
-			_waitCondVar.notify_all();
-	}
+		inline std::uint64_t EventCount::prepareWait()
+		{
+			std::uint64_t key = _state.fetch_add(1, std::memory_order_seq_cst);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			return key;
+		}
 
-	inline void TaskPackTraitsBlocking::wait() const
-	{
-		std::unique_lock<std::mutex> lock(_waitMutex);
-		_waitCondVar.wait(lock, [this]()->bool{ return _nCompletedTasks.load(std::memory_order::memory_order_relaxed) >= _size; });
-		_waitWoken.store(true, std::memory_order::memory_order_relaxed);
-	}
+		inline void EventCount::cancelWait()
+		{
+			_state.fetch_sub(1, std::memory_order_relaxed);
+		}
 
-	////////////////////////////////////////////////////////////////////////////
+		inline void EventCount::commitWait(const std::uint64_t key)
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			while ((_state.load(std::memory_order_acquire) & ~WAITERS_MASK) == (key & ~WAITERS_MASK))
+				_condVar.wait(lock);
+			lock.unlock();
+			_state.fetch_sub(1, std::memory_order_relaxed);
+		}
 
+		inline void EventCount::notifyOne()
+		{
+			if (advance())
+				_condVar.notify_one();
+		}
+
+		inline void EventCount::notifyAll()
+		{
+			if (advance())
+				_condVar.notify_all();
+		}
+
+		inline std::size_t EventCount::nWaiters() const
+		{
+			return static_cast<std::size_t>(_state.load(std::memory_order_relaxed) & WAITERS_MASK);
+		}
 
+		inline bool EventCount::advance()
+		{
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if ((_state.load(std::memory_order_relaxed) & WAITERS_MASK) == 0)
+				return false;
+			_state.fetch_add(EPOCH_ONE, std::memory_order_release);
+			// waiters check the epoch while holding the mutex: taking it here
+			// ensures they either see the new epoch or are already waiting
+			std::lock_guard<std::mutex> lock(_mutex);
+			return true;
+		}
+
+	}
 
+	////////////////////////////////////////////////////////////////////////////
 
 
 
 	////////////////////////////////////////////////////////////////////////////
-	// INTERNAL STUFF
+	// PaddedArray METHODS
 	////////////////////////////////////////////////////////////////////////////
 
 	namespace internal {
 
-		////////////////////////////////////////////////////////////////////////
-		// TaskPackBase METHODS
-		////////////////////////////////////////////////////////////////////////
+		template < class T >
+		inline PaddedArray<T>::PaddedArray(const std::size_t size) : _size(size), _memory(new char[size * STRIDE + CACHE_LINE_SIZE - 1])
+		{
+			_data = _memory + (CACHE_LINE_SIZE - reinterpret_cast<std::uintptr_t>(_memory) % CACHE_LINE_SIZE) % CACHE_LINE_SIZE;
+			construct();
+		}
 
-		inline TaskPackBase::TaskPackBase(const std::size_t size) : _tasks(size)
-		{ }
+		template < class T >
+		inline PaddedArray<T>::PaddedArray(const std::size_t size, TaskPackArena &arena) : _size(size), _memory(nullptr), _data(static_cast<char *>(arena.allocate(size * STRIDE, CACHE_LINE_SIZE)))
+		{
+			construct();
+		}
 
-		inline std::size_t TaskPackBase::size() const
+		template < class T >
+		inline PaddedArray<T>::~PaddedArray()
 		{
-			return _tasks.size();
+			for (std::size_t i = 0; i < _size; ++i)
+				(*this)[i].~T();
+			delete[] _memory;
 		}
 
-		inline TaskPackBase::iterator TaskPackBase::begin()
+		template < class T >
+		inline void PaddedArray<T>::construct()
 		{
-			return _tasks.begin();
+			std::size_t i = 0;
+			try {
+				for (; i < _size; ++i)
+					::new (_data + i * STRIDE) T();
+			} catch (...) {
+				while (i > 0)
+					(*this)[--i].~T();
+				delete[] _memory;
+				throw;
+			}
 		}
 
-		inline TaskPackBase::const_iterator TaskPackBase::begin() const
+		template < class T >
+		inline std::size_t PaddedArray<T>::size() const
 		{
-			return _tasks.begin();
+			return _size;
 		}
 
-		inline TaskPackBase::move_iterator TaskPackBase::moveBegin()
+		template < class T >
+		inline T & PaddedArray<T>::operator[](const std::size_t i)
 		{
-			return std::make_move_iterator(_tasks.begin());
+			return *reinterpret_cast<T *>(_data + i * STRIDE);
 		}
 
-		inline TaskPackBase::iterator TaskPackBase::end()
+		template < class T >
+		inline const T & PaddedArray<T>::operator[](const std::size_t i) const
 		{
-			return _tasks.end();
+			return *reinterpret_cast<const T *>(_data + i * STRIDE);
 		}
 
-		inline TaskPackBase::const_iterator TaskPackBase::end() const
+		template < class T >
+		inline T & PaddedArray<T>::at(const std::size_t i)
 		{
-			return _tasks.end();
+			if (i >= _size)
+				throw std::out_of_range("PaddedArray::at: index out of range");
+			return (*this)[i];
 		}
 
-		inline TaskPackBase::move_iterator TaskPackBase::moveEnd()
+		template < class T >
+		inline const T & PaddedArray<T>::at(const std::size_t i) const
 		{
-			return std::make_move_iterator(_tasks.end());
+			if (i >= _size)
+				throw std::out_of_range("PaddedArray::at: index out of range");
+			return (*this)[i];
 		}
 
-		////////////////////////////////////////////////////////////////////////
+	}
+
+	////////////////////////////////////////////////////////////////////////////
+
+
+
+	////////////////////////////////////////////////////////////////////////////
+	// CompletionCounter METHODS
+	////////////////////////////////////////////////////////////////////////////
+
+	namespace internal {
+
+		inline CompletionCounter::CompletionCounter(const std::size_t size) : _top(0)
+		{
+			reset(size);
+		}
+
+		inline void CompletionCounter::reset(const std::size_t size)
+		{
+			const std::size_t n = nStripes(size);
+			if (n == 1)
+				_stripes.reset();
+			else if (!_stripes || _stripes->size() != n)
+				_stripes.reset(new PaddedArray<std::atomic_size_t>(n));
+			else
+				for (std::size_t s = 0; s < n; ++s)
+					(*_stripes)[s].store(0, std::memory_order_relaxed);
+			_size = size;
+			_nStripes = n;
+			_target = n == 1 ? size : n;
+			_top.store(0, std::memory_order_relaxed);
+		}
+
+		inline bool CompletionCounter::signal(const std::size_t i)
+		{
+			// once the top-level counter reaches its target the pack may be
+			// destroyed: read everything needed before
+			const std::size_t target = _target;
+			if (_stripes) {
+				const std::size_t s = i % _nStripes;
+				// the tasks of stripe s are s, s + _nStripes, s + 2 * _nStripes, ...
+				const std::size_t stripeSize = _size / _nStripes + (s < _size % _nStripes ? 1 : 0);
+				if ((*_stripes)[s].fetch_add(1, std::memory_order_acq_rel) + 1 < stripeSize)
+					return false;
+			}
+			return _top.fetch_add(1, std::memory_order_acq_rel) + 1 == target;
+		}
+
+		inline bool CompletionCounter::complete() const
+		{
+			return _top.load(std::memory_order_acquire) >= _target;
+		}
+
+		inline std::size_t CompletionCounter::count() const
+		{
+			if (!_stripes)
+				return _top.load(std::memory_order_relaxed);
+			std::size_t count = 0;
+			for (std::size_t s = 0; s < _nStripes; ++s)
+				count += (*_stripes)[s].load(std::memory_order_relaxed);
+			return count;
+		}
+
+		inline std::size_t CompletionCounter::nStripes(const std::size_t size)
+		{
+			// below this number of tasks per stripe, striping does not pay
+			static const std::size_t MIN_STRIPE_SIZE = 64;
+			static const std::size_t MAX_STRIPES = std::max(std::thread::hardware_concurrency(), 1u);
+			return std::min(std::max(size / MIN_STRIPE_SIZE, std::size_t(1)), MAX_STRIPES);
+		}
 
 	}
 
@@ -339,47 +423,2674 @@ namespace mpmc_tp {
 
 
 	////////////////////////////////////////////////////////////////////////////
-	// TaskPack METHODS
+	// STATISTICS METHODS
 	////////////////////////////////////////////////////////////////////////////
 
-	template < class R, class TaskPackTraits > template < class ...Args >
-	inline TaskPack<R, TaskPackTraits>::TaskPack(const std::size_t size, Args &&...args) : internal::TaskPackBase(size), TaskPackTraits(size, std::forward<Args>(args)...), _results(size, R())
+	inline WorkerStats::WorkerStats() : tasksExecuted(0), tasksStolen(0), wakeups(0), busyTime(0), parkedTime(0), localTasks(0)
+	{
+		latency.fill(0);
+	}
+
+	inline WorkerStats & WorkerStats::operator+=(const WorkerStats &other)
+	{
+		tasksExecuted += other.tasksExecuted;
+		tasksStolen += other.tasksStolen;
+		wakeups += other.wakeups;
+		busyTime += other.busyTime;
+		parkedTime += other.parkedTime;
+		localTasks += other.localTasks;
+		for (std::size_t i = 0; i < N_LATENCY_BUCKETS; ++i)
+			latency[i] += other.latency[i];
+		return *this;
+	}
+
+	inline PoolStats::PoolStats() : queuedTasks(0), localTasks(0), parkedThreads(0), droppedTasks(0)
 	{ }
 
-	template < class R, class TaskPackTraits > template < class F, class ...Args >
-	inline void TaskPack<R, TaskPackTraits>::setTaskAt(const std::size_t i, F &&f, Args &&...args)
+	inline ElasticPolicy::ElasticPolicy() : minSize(1), maxSize(std::max(std::thread::hardware_concurrency(), 1u)), maxQueueDepth(64), maxLatency(1000), idleTimeout(5000), period(10)
+	{ }
+
+	////////////////////////////////////////////////////////////////////////////
+
+
+
+	////////////////////////////////////////////////////////////////////////////
+	// DefaultPoolPolicy METHODS
+	////////////////////////////////////////////////////////////////////////////
+
+	template < class T >
+	inline void DefaultPoolPolicy::run(T &task)
 	{
-		static_assert(std::is_convertible<typename std::result_of<F(Args...)>::type, R>::value, "Result type of callable object must be same of TaskPack template parameter.");
-		static_assert(std::is_void<decltype(std::declval<TaskPack<R, TaskPackTraits>>().signalTaskComplete(std::declval<std::size_t>()))>::value, "TaskPackTraits template parameter must have a 'void signalTaskComplete(std::size_t)' method.");
-		auto g = std::bind(std::forward<F>(f), std::forward<Args>(args)...);
-		_tasks.at(i) = [i, g, this](){
-			_results.at(i) = g();
-			this->signalTaskComplete(i);
-		};
+		task();
 	}
 
-	template < class R, class TaskPackTraits >
-	inline const R & TaskPack<R, TaskPackTraits>::resultAt(const std::size_t i) const
+	////////////////////////////////////////////////////////////////////////////
+
+
+
+	////////////////////////////////////////////////////////////////////////////
+	// MPMCThreadPool METHODS
+	////////////////////////////////////////////////////////////////////////////
+
+	inline std::size_t MPMCThreadPool::DEFAULT_SIZE()
 	{
-		return _results.at(i);
+		return std::thread::hardware_concurrency();
 	}
 
+	inline std::size_t MPMCThreadPool::DEFAULT_MAX_SPINS()
+	{
+		return 1024;
+	}
 
+	inline std::size_t MPMCThreadPool::DEFAULT_AGING_PERIOD()
+	{
+		return 32;
+	}
 
-	template < class TaskPackTraits > template < class ...Args >
-	inline TaskPack<void, TaskPackTraits>::TaskPack(const std::size_t size, Args &&...args) : internal::TaskPackBase(size), TaskPackTraits(size, std::forward<Args>(args)...)
-	{ }
+	inline std::size_t MPMCThreadPool::DEFAULT_MAX_BATCH_SIZE()
+	{
+		return 16;
+	}
 
-	template < class TaskPackTraits > template < class F, class ...Args >
-	inline void TaskPack<void, TaskPackTraits>::setTaskAt(const std::size_t i, F &&f, Args &&...args)
+	inline std::size_t MPMCThreadPool::DEFAULT_BLOCKING_SIZE()
 	{
-		static_assert(std::is_void<typename std::result_of<F(Args...)>::type>::value, "Result type of callable object must be same of TaskPack template parameter.");
-		static_assert(std::is_void<decltype(std::declval<TaskPack<void, TaskPackTraits>>().signalTaskComplete(std::declval<std::size_t>()))>::value, "TaskPackTraits template parameter must have a 'void signalTaskComplete(std::size_t)' method.");
-		auto g = std::bind(std::forward<F>(f), std::forward<Args>(args)...);
-		_tasks.at(i) = [i, g, this](){
-			g();
-			this->signalTaskComplete(i);
-		};
+		return MPMCThreadPool::DEFAULT_SIZE();
+	}
+
+	inline std::size_t MPMCThreadPool::DEFAULT_QUEUE_CAPACITY()
+	{
+		return 32 * ConcurrentQueue<SimpleTaskType>::BLOCK_SIZE;
+	}
+
+	inline MPMCThreadPool::BasicThreadPool() : MPMCThreadPool(MPMCThreadPool::DEFAULT_SIZE())
+	{ }
+
+	inline MPMCThreadPool::BasicThreadPool(const std::size_t size) : MPMCThreadPool(size, 1)
+	{ }
+
+	inline MPMCThreadPool::BasicThreadPool(const std::size_t size, const std::size_t nPriorities) : MPMCThreadPool(size, nPriorities, MPMCThreadPool::DEFAULT_QUEUE_CAPACITY())
+	{ }
+
+	inline MPMCThreadPool::BasicThreadPool(const std::size_t size, const std::size_t nPriorities, const std::size_t queueCapacity) : _workers(std::make_shared<WorkerList>()), _workersVersion(0), _nActives(0), _nodeQueues(internal::Topology::instance().nNodes() > 1 ? internal::Topology::instance().nNodes() : 0), _pinned(false), _active(true), _workStealing(false), _idlePolicy(DefaultPoolPolicy::IDLE_POLICY), _maxSpins(MPMCThreadPool::DEFAULT_MAX_SPINS()), _agingPeriod(MPMCThreadPool::DEFAULT_AGING_PERIOD()), _maxBatchSize(MPMCThreadPool::DEFAULT_MAX_BATCH_SIZE()), _elastic(false), _probeSubmitted(0), _probeLatency(0), _supervising(false), _blockingPool(nullptr), _blockingSize(MPMCThreadPool::DEFAULT_BLOCKING_SIZE()), _compensate(true), _timers(*this), _capacity(0), _overflowPolicy(OverflowPolicy::Block), _nPending(0), _nDropped(0), _nInFlight(0)
+	{
+		_flag.clear();
+		for (std::size_t p = 0; p < std::max(nPriorities, std::size_t(1)); ++p)
+			_taskQueues.emplace_back(queueCapacity);
+		_producerTokens = std::make_shared<internal::TokenRegistry>(_taskQueues.front());
+		expand(size);
+	}
+
+	inline MPMCThreadPool::~MPMCThreadPool()
+	{
+		_timers.stop();
+		stopSupervisor();
+		// _flag is not held meanwhile: retiring threads may need it
+		_active.store(false, std::memory_order_relaxed);
+		while (_nActives.load(std::memory_order_relaxed) > std::size_t(0))
+			_eventCount.notifyAll();
+		while (_flag.test_and_set())
+			;
+		for (std::size_t i = 0; i < _workers->size(); ++i)
+			if (_workers->at(i)->thread.joinable())
+				_workers->at(i)->thread.join();
+		for (std::size_t i = 0; i < _retired.size(); ++i)
+			if (_retired[i]->thread.joinable())
+				_retired[i]->thread.join();
+		_flag.clear();
+		// after the threads, which may still submit to the lane
+		delete _blockingPool.load(std::memory_order_acquire);
+		// before the queue
+		_producerTokens->close();
+	}
+
+	inline std::size_t MPMCThreadPool::size() const
+	{
+		while (_flag.test_and_set())
+			;
+		std::size_t size = _workers->size();
+		_flag.clear();
+		return size;
+	}
+
+	inline void MPMCThreadPool::expand(const std::size_t n)
+	{
+		while (_flag.test_and_set())
+			;
+		reapRetired();
+		std::size_t oldSize = _workers->size();
+		std::shared_ptr<WorkerList> workers = std::make_shared<WorkerList>(*_workers);
+		for (std::size_t i = 0; i < n; ++i)
+			workers->push_back(std::make_shared<internal::Worker>(*this, _taskQueues.front(), oldSize + i));
+		std::atomic_store(&_workers, std::shared_ptr<const WorkerList>(workers));
+		_workersVersion.fetch_add(1, std::memory_order_release);
+		for (std::size_t i = 0; i < n; ++i) {
+			workers->at(oldSize + i)->thread = std::thread(&MPMCThreadPool::threadJob, this, std::ref(*workers->at(oldSize + i)));
+			applyAffinity(*workers->at(oldSize + i), oldSize + i);
+		}
+		_flag.clear();
+	}
+
+	inline void MPMCThreadPool::shrink(const std::size_t n)
+	{
+		while (_flag.test_and_set())
+			;
+		reapRetired();
+		std::size_t newSize = _workers->size() - std::min(_workers->size(), n);
+		for (std::size_t i = newSize; i < _workers->size(); ++i) {
+			_workers->at(i)->active.store(false, std::memory_order_release);
+			_retired.push_back(_workers->at(i));
+		}
+		std::shared_ptr<WorkerList> workers = std::make_shared<WorkerList>(_workers->begin(), _workers->begin() + newSize);
+		std::atomic_store(&_workers, std::shared_ptr<const WorkerList>(workers));
+		_workersVersion.fetch_add(1, std::memory_order_release);
+		_flag.clear();
+		// the removed threads exit on their own, and are joined later
+		_eventCount.notifyAll();
+	}
+
+	inline void MPMCThreadPool::setElastic(const ElasticPolicy &policy)
+	{
+		if (policy.minSize > policy.maxSize)
+			throw std::invalid_argument("MPMCThreadPool::setElastic: minSize is greater than maxSize");
+		while (_flag.test_and_set())
+			;
+		_elasticPolicy = policy;
+		_elastic.store(true, std::memory_order_relaxed);
+		const std::size_t size = _workers->size();
+		_flag.clear();
+		if (size < policy.minSize)
+			expand(policy.minSize - size);
+		else if (size > policy.maxSize)
+			shrink(size - policy.maxSize);
+		std::lock_guard<std::mutex> lock(_supervisorMutex);
+		if (!_supervising) {
+			_supervising = true;
+			_supervisor = std::thread(&MPMCThreadPool::supervise, this);
+		}
+	}
+
+	inline void MPMCThreadPool::disableElastic()
+	{
+		_elastic.store(false, std::memory_order_relaxed);
+		stopSupervisor();
+	}
+
+	inline bool MPMCThreadPool::elastic() const
+	{
+		return _elastic.load(std::memory_order_relaxed);
+	}
+
+	inline MPMCThreadPool & MPMCThreadPool::blockingPool()
+	{
+		MPMCThreadPool *pool = _blockingPool.load(std::memory_order_acquire);
+		if (pool != nullptr)
+			return *pool;
+		while (_flag.test_and_set())
+			;
+		pool = _blockingPool.load(std::memory_order_relaxed);
+		if (pool == nullptr) {
+			pool = new MPMCThreadPool(_blockingSize);
+			// a blocking lane is meant to block: no compensation there
+			pool->_compensate = false;
+			_blockingPool.store(pool, std::memory_order_release);
+		}
+		_flag.clear();
+		return *pool;
+	}
+
+	inline void MPMCThreadPool::submitBlocking(SimpleTaskType &&task)
+	{
+		blockingPool().submitTask(std::forward<SimpleTaskType>(task));
+	}
+
+	inline void MPMCThreadPool::setBlockingSize(const std::size_t n)
+	{
+		while (_flag.test_and_set())
+			;
+		_blockingSize = n;
+		MPMCThreadPool *pool = _blockingPool.load(std::memory_order_relaxed);
+		if (pool != nullptr) {
+			const std::size_t size = pool->size();
+			if (size < n)
+				pool->expand(n - size);
+			else if (size > n)
+				pool->shrink(size - n);
+		}
+		_flag.clear();
+	}
+
+	inline std::size_t MPMCThreadPool::blockingSize() const
+	{
+		while (_flag.test_and_set())
+			;
+		std::size_t size = _blockingSize;
+		_flag.clear();
+		return size;
+	}
+
+	inline void MPMCThreadPool::setWorkStealing(const bool enabled)
+	{
+		_workStealing.store(enabled, std::memory_order_relaxed);
+	}
+
+	inline bool MPMCThreadPool::workStealing() const
+	{
+		return _workStealing.load(std::memory_order_relaxed);
+	}
+
+	inline void MPMCThreadPool::setIdlePolicy(const IdlePolicy policy)
+	{
+		_idlePolicy.store(policy, std::memory_order_relaxed);
+		// parked threads must notice they have to spin now
+		_eventCount.notifyAll();
+	}
+
+	inline IdlePolicy MPMCThreadPool::idlePolicy() const
+	{
+		return _idlePolicy.load(std::memory_order_relaxed);
+	}
+
+	inline void MPMCThreadPool::setMaxSpins(const std::size_t n)
+	{
+		_maxSpins.store(n, std::memory_order_relaxed);
+	}
+
+	inline std::size_t MPMCThreadPool::maxSpins() const
+	{
+		return _maxSpins.load(std::memory_order_relaxed);
+	}
+
+	inline std::size_t MPMCThreadPool::nPriorities() const
+	{
+		return _taskQueues.size();
+	}
+
+	inline bool MPMCThreadPool::setAffinity(const AffinityPolicy policy)
+	{
+		if (policy == AffinityPolicy::None)
+			return setAffinity(std::vector<std::size_t>());
+		return setAffinity(internal::Topology::instance().cpus(policy));
+	}
+
+	inline bool MPMCThreadPool::setAffinity(const std::vector<std::size_t> &cpus)
+	{
+		while (_flag.test_and_set())
+			;
+		_cpus = cpus;
+		bool pinned = true;
+		for (std::size_t i = 0; i < _workers->size(); ++i)
+			pinned = applyAffinity(*_workers->at(i), i) && pinned;
+		if (!_cpus.empty())
+			_pinned = true;
+		_flag.clear();
+		return pinned;
+	}
+
+	inline std::size_t MPMCThreadPool::nNodes() const
+	{
+		return internal::Topology::instance().nNodes();
+	}
+
+	inline PoolStats MPMCThreadPool::stats() const
+	{
+		PoolStats stats;
+		for (std::size_t p = 0; p < _taskQueues.size(); ++p)
+			stats.queuedTasks += _taskQueues[p].size_approx();
+		for (std::size_t i = 0; i < _nodeQueues.size(); ++i)
+			stats.queuedTasks += _nodeQueues[i].size_approx();
+		stats.parkedThreads = _eventCount.nWaiters();
+		stats.droppedTasks = _nDropped.load(std::memory_order_relaxed);
+		while (_flag.test_and_set())
+			;
+		stats.workers.resize(_workers->size());
+		for (std::size_t i = 0; i < _workers->size(); ++i) {
+#if MPMC_TP_STATS
+			_workers->at(i)->counters.snapshot(stats.workers[i]);
+#endif
+			stats.workers[i].localTasks = _workers->at(i)->localQueue.sizeApprox();
+			stats.total += stats.workers[i];
+		}
+#if MPMC_TP_STATS
+		for (std::size_t i = 0; i < _retired.size(); ++i)
+			_retired[i]->counters.snapshot(stats.total);
+		stats.total += _retiredStats;
+#endif
+		_flag.clear();
+		stats.localTasks = stats.total.localTasks;
+		return stats;
+	}
+
+	inline void MPMCThreadPool::resetStats()
+	{
+#if MPMC_TP_STATS
+		while (_flag.test_and_set())
+			;
+		for (std::size_t i = 0; i < _workers->size(); ++i)
+			_workers->at(i)->counters.reset();
+		for (std::size_t i = 0; i < _retired.size(); ++i)
+			_retired[i]->counters.reset();
+		_retiredStats = WorkerStats();
+		_flag.clear();
+#endif
+	}
+
+	inline void MPMCThreadPool::setAgingPeriod(const std::size_t n)
+	{
+		_agingPeriod.store(n, std::memory_order_relaxed);
+	}
+
+	inline std::size_t MPMCThreadPool::agingPeriod() const
+	{
+		return _agingPeriod.load(std::memory_order_relaxed);
+	}
+
+	inline void MPMCThreadPool::setMaxBatchSize(const std::size_t n)
+	{
+		_maxBatchSize.store(std::max(n, std::size_t(1)), std::memory_order_relaxed);
+	}
+
+	inline std::size_t MPMCThreadPool::maxBatchSize() const
+	{
+		return _maxBatchSize.load(std::memory_order_relaxed);
+	}
+
+	inline void MPMCThreadPool::setCapacity(const std::size_t capacity, const OverflowPolicy policy)
+	{
+		if (_capacity.load(std::memory_order_relaxed) == 0)
+			// start counting from now
+			_nPending.store(0, std::memory_order_relaxed);
+		_overflowPolicy.store(policy, std::memory_order_relaxed);
+		_capacity.store(capacity, std::memory_order_relaxed);
+		// the producers waiting check the new setting
+		_roomEventCount.notifyAll();
+	}
+
+	inline std::size_t MPMCThreadPool::capacity() const
+	{
+		return _capacity.load(std::memory_order_relaxed);
+	}
+
+	inline OverflowPolicy MPMCThreadPool::overflowPolicy() const
+	{
+		return _overflowPolicy.load(std::memory_order_relaxed);
+	}
+
+	inline ProducerToken MPMCThreadPool::newProducerToken()
+	{
+		return ProducerToken(_taskQueues.front());
+	}
+
+	inline void MPMCThreadPool::submitTask(SimpleTaskType &&task)
+	{
+		if (admit(1) == 0) {
+			task();
+			return;
+		}
+		markSubmitted(task);
+		if (internal::Worker *worker = localWorker())
+			worker->localQueue.push(std::forward<SimpleTaskType>(task));
+		else
+			enqueue(std::forward<SimpleTaskType>(task));
+		_eventCount.notifyOne();
+	}
+
+	inline void MPMCThreadPool::submitTask(const ProducerToken &token, SimpleTaskType &&task)
+	{
+		if (admit(1) == 0) {
+			task();
+			return;
+		}
+		markSubmitted(task);
+		if (internal::Worker *worker = localWorker())
+			worker->localQueue.push(std::forward<SimpleTaskType>(task));
+		else
+			_taskQueues.front().enqueue(token, std::forward<SimpleTaskType>(task));
+		_eventCount.notifyOne();
+	}
+
+	inline void MPMCThreadPool::submitTask(const std::size_t priority, SimpleTaskType &&task)
+	{
+		ConcurrentQueue<SimpleTaskType> &queue = _taskQueues.at(priority);
+		if (admit(1) == 0) {
+			task();
+			return;
+		}
+		markSubmitted(task);
+		internal::Worker *worker = priority == 0 ? localWorker() : nullptr;
+		if (worker != nullptr)
+			worker->localQueue.push(std::forward<SimpleTaskType>(task));
+		else
+			queue.enqueue(std::forward<SimpleTaskType>(task));
+		_eventCount.notifyOne();
+	}
+
+	template < class F >
+	inline void MPMCThreadPool::submitTask(const TaskGroup &group, F &&f)
+	{
+		submitTask(SimpleTaskType(group.wrap(std::forward<F>(f))));
+	}
+
+	template < class It >
+	inline void MPMCThreadPool::submitTasks(It first, It last)
+	{
+		std::size_t n = std::distance(first, last);
+		if (n == 0)
+			return;
+		// the tasks beyond the capacity, if any, are run by the caller
+		const std::size_t m = admit(n);
+		It rest = last;
+		if (m < n) {
+			rest = first;
+			std::advance(rest, m);
+		}
+		markSubmitted(first, rest);
+		if (m > 0) {
+			if (internal::Worker *worker = localWorker())
+				worker->localQueue.pushBulk(first, rest);
+			else
+				enqueueBulk(std::forward<It>(first), m);
+			if (m > 1)
+				_eventCount.notifyAll();
+			else
+				_eventCount.notifyOne();
+		}
+		for (; rest != last; ++rest) {
+			SimpleTaskType task(*rest);
+			task();
+		}
+	}
+
+	template < class It >
+	inline void MPMCThreadPool::submitTasks(const ProducerToken &token, It first, It last)
+	{
+		std::size_t n = std::distance(first, last);
+		if (n == 0)
+			return;
+		// the tasks beyond the capacity, if any, are run by the caller
+		const std::size_t m = admit(n);
+		It rest = last;
+		if (m < n) {
+			rest = first;
+			std::advance(rest, m);
+		}
+		markSubmitted(first, rest);
+		if (m > 0) {
+			if (internal::Worker *worker = localWorker())
+				worker->localQueue.pushBulk(first, rest);
+			else
+				_taskQueues.front().enqueue_bulk(token, std::forward<It>(first), m);
+			if (m > 1)
+				_eventCount.notifyAll();
+			else
+				_eventCount.notifyOne();
+		}
+		for (; rest != last; ++rest) {
+			SimpleTaskType task(*rest);
+			task();
+		}
+	}
+
+	template < class It >
+	inline void MPMCThreadPool::submitTasks(const std::size_t priority, It first, It last)
+	{
+		ConcurrentQueue<SimpleTaskType> &queue = _taskQueues.at(priority);
+		std::size_t n = std::distance(first, last);
+		if (n == 0)
+			return;
+		// the tasks beyond the capacity, if any, are run by the caller
+		const std::size_t m = admit(n);
+		It rest = last;
+		if (m < n) {
+			rest = first;
+			std::advance(rest, m);
+		}
+		markSubmitted(first, rest);
+		if (m > 0) {
+			internal::Worker *worker = priority == 0 ? localWorker() : nullptr;
+			if (worker != nullptr)
+				worker->localQueue.pushBulk(first, rest);
+			else
+				queue.enqueue_bulk(std::forward<It>(first), m);
+			if (m > 1)
+				_eventCount.notifyAll();
+			else
+				_eventCount.notifyOne();
+		}
+		for (; rest != last; ++rest) {
+			SimpleTaskType task(*rest);
+			task();
+		}
+	}
+
+	inline void MPMCThreadPool::submitTaskToNode(const std::size_t node, SimpleTaskType &&task)
+	{
+		if (node >= nNodes())
+			throw std::out_of_range("MPMCThreadPool::submitTaskToNode: invalid node");
+		if (admit(1) == 0) {
+			task();
+			return;
+		}
+		markSubmitted(task);
+		if (_nodeQueues.empty())
+			_taskQueues.front().enqueue(std::forward<SimpleTaskType>(task));
+		else
+			_nodeQueues[node].enqueue(std::forward<SimpleTaskType>(task));
+		_eventCount.notifyOne();
+	}
+
+	template < class It >
+	inline void MPMCThreadPool::submitTasksToNode(const std::size_t node, It first, It last)
+	{
+		if (node >= nNodes())
+			throw std::out_of_range("MPMCThreadPool::submitTasksToNode: invalid node");
+		std::size_t n = std::distance(first, last);
+		if (n == 0)
+			return;
+		// the tasks beyond the capacity, if any, are run by the caller
+		const std::size_t m = admit(n);
+		It rest = last;
+		if (m < n) {
+			rest = first;
+			std::advance(rest, m);
+		}
+		markSubmitted(first, rest);
+		if (m > 0) {
+			if (_nodeQueues.empty())
+				_taskQueues.front().enqueue_bulk(std::forward<It>(first), m);
+			else
+				_nodeQueues.at(node).enqueue_bulk(std::forward<It>(first), m);
+			if (m > 1)
+				_eventCount.notifyAll();
+			else
+				_eventCount.notifyOne();
+		}
+		for (; rest != last; ++rest) {
+			SimpleTaskType task(*rest);
+			task();
+		}
+	}
+
+	template < class F, class ...Args >
+	inline Future<internal::InvokeResult<F, Args...>> MPMCThreadPool::submit(F &&f, Args &&...args)
+	{
+		using R = internal::InvokeResult<F, Args...>;
+		using G = decltype(std::bind(std::forward<F>(f), std::forward<Args>(args)...));
+		std::shared_ptr<internal::FutureState<R>> state = std::make_shared<internal::FutureState<R>>(*this);
+		submitTask(internal::FutureTask<R, G>(state, std::bind(std::forward<F>(f), std::forward<Args>(args)...)));
+		return Future<R>(std::move(state));
+	}
+
+	template < class Duration >
+	inline TimerHandle MPMCThreadPool::submitAt(const std::chrono::time_point<std::chrono::steady_clock, Duration> &time, SimpleTaskType &&task)
+	{
+		return TimerHandle(_timers.schedule(std::chrono::time_point_cast<std::chrono::steady_clock::duration>(time), std::chrono::steady_clock::duration::zero(), std::forward<SimpleTaskType>(task)));
+	}
+
+	template < class Rep, class Period >
+	inline TimerHandle MPMCThreadPool::submitAfter(const std::chrono::duration<Rep, Period> &delay, SimpleTaskType &&task)
+	{
+		return TimerHandle(_timers.schedule(std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(delay), std::chrono::steady_clock::duration::zero(), std::forward<SimpleTaskType>(task)));
+	}
+
+	template < class Rep, class Period >
+	inline TimerHandle MPMCThreadPool::submitEvery(const std::chrono::duration<Rep, Period> &period, SimpleTaskType &&task)
+	{
+		const std::chrono::steady_clock::duration p = std::max(std::chrono::duration_cast<std::chrono::steady_clock::duration>(period), std::chrono::steady_clock::duration(1));
+		return TimerHandle(_timers.schedule(std::chrono::steady_clock::now() + p, p, std::forward<SimpleTaskType>(task)));
+	}
+
+	inline std::size_t MPMCThreadPool::nTimers() const
+	{
+		return _timers.size();
+	}
+
+	inline bool MPMCThreadPool::runPendingTask()
+	{
+		SimpleTaskType task;
+		internal::Worker *worker = internal::currentWorker();
+		if (worker != nullptr && worker->pool == this) {
+			if (!nextTask(*worker, task))
+				return false;
+			runTask(*worker, task);
+			return true;
+		}
+		for (std::size_t p = _taskQueues.size(); p > 0; --p)
+			if (_taskQueues[p - 1].try_dequeue(task)) {
+				release();
+				InFlightScope scope(*this, task);
+				if (task)
+					task();
+				return true;
+			}
+		for (std::size_t i = 0; i < _nodeQueues.size(); ++i)
+			if (_nodeQueues[i].try_dequeue(task)) {
+				release();
+				InFlightScope scope(*this, task);
+				if (task)
+					task();
+				return true;
+			}
+		return false;
+	}
+
+	inline void MPMCThreadPool::drain()
+	{
+		internal::Worker *worker = internal::currentWorker();
+		if (worker != nullptr && worker->pool == this)
+			throw std::logic_error("MPMCThreadPool::drain: called from a thread of the pool");
+		while (runPendingTask())
+			;
+		waitIdle();
+	}
+
+	inline void MPMCThreadPool::waitIdle()
+	{
+		internal::Worker *worker = internal::currentWorker();
+		if (worker != nullptr && worker->pool == this)
+			throw std::logic_error("MPMCThreadPool::waitIdle: called from a thread of the pool");
+		for (;;) {
+			while (_nInFlight.load(std::memory_order_acquire) > 0) {
+				const std::uint64_t key = _idleEventCount.prepareWait();
+				if (_nInFlight.load(std::memory_order_acquire) == 0)
+					_idleEventCount.cancelWait();
+				else
+					_idleEventCount.commitWait(key);
+			}
+			// the tasks of the lane may submit to the pool, and vice versa:
+			// done when both are idle at once
+			MPMCThreadPool *lane = _blockingPool.load(std::memory_order_acquire);
+			if (lane == nullptr || lane->nInFlight() == 0)
+				return;
+			lane->waitIdle();
+		}
+	}
+
+	inline std::size_t MPMCThreadPool::nInFlight() const
+	{
+		return _nInFlight.load(std::memory_order_acquire);
+	}
+
+	inline bool MPMCThreadPool::trySubmit(SimpleTaskType &&task)
+	{
+		const std::size_t capacity = _capacity.load(std::memory_order_relaxed);
+		if (capacity > 0) {
+			std::size_t pending = _nPending.load(std::memory_order_relaxed);
+			do {
+				if (pending >= capacity)
+					return false;
+			} while (!_nPending.compare_exchange_weak(pending, pending + 1, std::memory_order_relaxed));
+		}
+		_nInFlight.fetch_add(1, std::memory_order_relaxed);
+		markSubmitted(task);
+		if (internal::Worker *worker = localWorker())
+			worker->localQueue.push(std::forward<SimpleTaskType>(task));
+		else
+			enqueue(std::forward<SimpleTaskType>(task));
+		_eventCount.notifyOne();
+		return true;
+	}
+
+	inline void MPMCThreadPool::threadJob(internal::Worker &worker)
+	{
+		internal::currentWorker() = &worker;
+		SimpleTaskType task;
+		_nActives.fetch_add(1, std::memory_order_relaxed);
+		while (_active.load(std::memory_order_relaxed) && worker.active.load(std::memory_order_relaxed)) {
+			const IdlePolicy policy = _idlePolicy.load(std::memory_order_relaxed);
+			if (nextTask(worker, task) || (policy != IdlePolicy::Block && spinForTask(worker, task, policy))) {
+				runTask(worker, task);
+			} else if (policy != IdlePolicy::BusyPoll) {
+				const std::uint64_t key = _eventCount.prepareWait();
+				if (!_active.load(std::memory_order_relaxed) || !worker.active.load(std::memory_order_relaxed) || hasPendingTasks(worker)) {
+					_eventCount.cancelWait();
+				} else {
+#if MPMC_TP_STATS
+					const std::chrono::steady_clock::time_point parked = std::chrono::steady_clock::now();
+					_eventCount.commitWait(key);
+					worker.counters.wokenUp(std::chrono::steady_clock::now() - parked);
+#else
+					_eventCount.commitWait(key);
+#endif
+				}
+			}
+		}
+		// a removed thread hands its local tasks over to the others
+		if (_active.load(std::memory_order_relaxed) && worker.localQueue.sizeApprox() > 0) {
+			while (worker.localQueue.pop(task))
+				_taskQueues.front().enqueue(std::move(task));
+			_eventCount.notifyAll();
+		}
+		worker.victims.reset();
+		internal::currentWorker() = nullptr;
+		_nActives.fetch_sub(1, std::memory_order_relaxed);
+		worker.exited.store(true, std::memory_order_release);
+	}
+
+	inline void MPMCThreadPool::runTask(internal::Worker &worker, SimpleTaskType &task)
+	{
+		release();
+		InFlightScope scope(*this, task);
+		if (!task)
+			return;
+#if MPMC_TP_STATS
+		const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		const std::chrono::steady_clock::time_point submitted = task.submitTime();
+		task();
+		worker.counters.taskExecuted(submitted == std::chrono::steady_clock::time_point() ? std::chrono::nanoseconds(-1) : start - submitted, std::chrono::steady_clock::now() - start);
+#else
+		(void)worker;
+		task();
+#endif
+	}
+
+	inline std::size_t MPMCThreadPool::admit(const std::size_t n)
+	{
+		const std::size_t m = reserve(n);
+		_nInFlight.fetch_add(m, std::memory_order_relaxed);
+		return m;
+	}
+
+	inline std::size_t MPMCThreadPool::reserve(const std::size_t n)
+	{
+		std::size_t capacity = _capacity.load(std::memory_order_relaxed);
+		if (capacity == 0)
+			return n;
+		std::size_t pending = _nPending.load(std::memory_order_relaxed);
+		for (;;) {
+			if (capacity == 0)
+				return n;
+			// a batch larger than the capacity goes in whole into an empty pool
+			if (pending + n <= capacity || pending == 0) {
+				if (_nPending.compare_exchange_weak(pending, pending + n, std::memory_order_relaxed))
+					return n;
+				continue;
+			}
+			const OverflowPolicy policy = _overflowPolicy.load(std::memory_order_relaxed);
+			if (policy == OverflowPolicy::Reject)
+				throw std::overflow_error("MPMCThreadPool: the pool is at its capacity");
+			if (policy == OverflowPolicy::CallerRuns) {
+				const std::size_t room = pending < capacity ? capacity - pending : 0;
+				if (room == 0 || _nPending.compare_exchange_weak(pending, pending + room, std::memory_order_relaxed))
+					return room;
+				continue;
+			}
+			if (policy == OverflowPolicy::DropOldest && dropOldest()) {
+				pending = _nPending.load(std::memory_order_relaxed);
+				continue;
+			}
+			// block, also when there is nothing to drop in the shared queues
+			internal::Worker *worker = internal::currentWorker();
+			if (worker != nullptr && worker->pool == this) {
+				// a thread of the pool parking here might wait for itself
+				if (!runPendingTask())
+					std::this_thread::yield();
+			} else {
+				const std::uint64_t key = _roomEventCount.prepareWait();
+				capacity = _capacity.load(std::memory_order_relaxed);
+				pending = _nPending.load(std::memory_order_relaxed);
+				if (capacity == 0 || pending + n <= capacity || pending == 0 || _overflowPolicy.load(std::memory_order_relaxed) != policy)
+					_roomEventCount.cancelWait();
+				else
+					_roomEventCount.commitWait(key);
+			}
+			capacity = _capacity.load(std::memory_order_relaxed);
+			pending = _nPending.load(std::memory_order_relaxed);
+		}
+	}
+
+	inline void MPMCThreadPool::admitInternal(const std::size_t n)
+	{
+		if (_capacity.load(std::memory_order_relaxed) > 0)
+			_nPending.fetch_add(n, std::memory_order_relaxed);
+		_nInFlight.fetch_add(n, std::memory_order_relaxed);
+	}
+
+	inline void MPMCThreadPool::release()
+	{
+		if (_capacity.load(std::memory_order_relaxed) == 0)
+			return;
+		// tasks pending before the capacity was set were not counted
+		std::size_t pending = _nPending.load(std::memory_order_relaxed);
+		while (pending > 0 && !_nPending.compare_exchange_weak(pending, pending - 1, std::memory_order_relaxed))
+			;
+		_roomEventCount.notifyAll();
+	}
+
+	inline void MPMCThreadPool::finish()
+	{
+		if (_nInFlight.fetch_sub(1, std::memory_order_release) == 1)
+			_idleEventCount.notifyAll();
+	}
+
+	inline MPMCThreadPool::InFlightScope::InFlightScope(MPMCThreadPool &pool, SimpleTaskType &task) : _pool(&pool), _task(&task)
+	{ }
+
+	inline MPMCThreadPool::InFlightScope::~InFlightScope()
+	{
+		*_task = nullptr;
+		_pool->finish();
+	}
+
+	inline bool MPMCThreadPool::dropOldest()
+	{
+		SimpleTaskType task;
+		bool dropped = false;
+		for (std::size_t p = 0; p < _taskQueues.size() && !dropped; ++p)
+			dropped = _taskQueues[p].try_dequeue(task);
+		for (std::size_t i = 0; i < _nodeQueues.size() && !dropped; ++i)
+			dropped = _nodeQueues[i].try_dequeue(task);
+		if (!dropped)
+			return false;
+		release();
+		if (!task.discardable()) {
+			InFlightScope scope(*this, task);
+			task();
+			return true;
+		}
+		_nDropped.fetch_add(1, std::memory_order_relaxed);
+		task = nullptr;
+		finish();
+		return true;
+	}
+
+	inline void MPMCThreadPool::enqueue(SimpleTaskType &&task)
+	{
+		if (ProducerToken *token = internal::tokenCache().get(_producerTokens))
+			_taskQueues.front().enqueue(*token, std::forward<SimpleTaskType>(task));
+		else
+			_taskQueues.front().enqueue(std::forward<SimpleTaskType>(task));
+	}
+
+	template < class It >
+	inline void MPMCThreadPool::enqueueBulk(It first, const std::size_t n)
+	{
+		if (ProducerToken *token = internal::tokenCache().get(_producerTokens))
+			_taskQueues.front().enqueue_bulk(*token, std::forward<It>(first), n);
+		else
+			_taskQueues.front().enqueue_bulk(std::forward<It>(first), n);
+	}
+
+	template < class T >
+	inline void MPMCThreadPool::markSubmitted(T &&task)
+	{
+#if MPMC_TP_STATS
+		task.setSubmitTime(std::chrono::steady_clock::now());
+#else
+		(void)task;
+#endif
+	}
+
+	template < class It >
+	inline void MPMCThreadPool::markSubmitted(It first, It last)
+	{
+#if MPMC_TP_STATS
+		markSubmitted(first, last, std::is_same<typename std::iterator_traits<It>::value_type, SimpleTaskType>());
+#else
+		(void)first;
+		(void)last;
+#endif
+	}
+
+	template < class It >
+	inline void MPMCThreadPool::markSubmitted(It first, It last, std::true_type)
+	{
+		const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		for (; first != last; ++first)
+			(*first).setSubmitTime(now);
+	}
+
+	template < class It >
+	inline void MPMCThreadPool::markSubmitted(It first, It last, std::false_type)
+	{
+		(void)first;
+		(void)last;
+	}
+
+	inline bool MPMCThreadPool::nextTask(internal::Worker &worker, SimpleTaskType &task)
+	{
+		const std::size_t nPriorities = _taskQueues.size();
+		if (nPriorities > 1) {
+			const std::size_t agingPeriod = _agingPeriod.load(std::memory_order_relaxed);
+			if (agingPeriod > 0 && ++worker.nPolls % agingPeriod == 0) {
+				// aging: give the lowest priority levels their turn
+				if (worker.localQueue.pop(task) || nodeTask(worker, task, false) || stealTask(worker, task))
+					return true;
+				for (std::size_t p = 0; p < nPriorities; ++p)
+					if (_taskQueues[p].try_dequeue(task))
+						return true;
+				return nodeTask(worker, task, true);
+			}
+			for (std::size_t p = nPriorities - 1; p > 0; --p)
+				if (_taskQueues[p].try_dequeue(task))
+					return true;
+		}
+		return worker.localQueue.pop(task) || nodeTask(worker, task, false) || stealTask(worker, task) || batchTask(worker, task) || nodeTask(worker, task, true);
+	}
+
+	inline bool MPMCThreadPool::nodeTask(internal::Worker &worker, SimpleTaskType &task, const bool others)
+	{
+		const std::size_t nNodes = _nodeQueues.size();
+		if (nNodes == 0)
+			return false;
+		const std::size_t node = worker.node.load(std::memory_order_relaxed) % nNodes;
+		if (!others)
+			return _nodeQueues[node].try_dequeue(task);
+		for (std::size_t i = 1; i < nNodes; ++i)
+			if (_nodeQueues[(node + i) % nNodes].try_dequeue(task))
+				return true;
+		return false;
+	}
+
+	inline bool MPMCThreadPool::batchTask(internal::Worker &worker, SimpleTaskType &task)
+	{
+		// while threads are parked, take one task at a time: the others are
+		// left to the threads woken up for them
+		const std::size_t maxBatchSize = _eventCount.nWaiters() > 0 ? 1 : _maxBatchSize.load(std::memory_order_relaxed);
+		const std::size_t batchSize = std::min(worker.batchSize, maxBatchSize);
+		if (worker.batch.size() < batchSize)
+			worker.batch.resize(batchSize);
+		const std::size_t n = _taskQueues.front().try_dequeue_bulk(worker.consumerToken, worker.batch.begin(), batchSize);
+		// batches grow while they come out full, and shrink to what is found
+		worker.batchSize = n == batchSize ? std::min(batchSize * 2, maxBatchSize) : std::max(n, std::size_t(1));
+		if (n == 0)
+			return false;
+		task = std::move(worker.batch.front());
+		if (n > 1) {
+			// the others go to the local deque, where idle threads can steal
+			// them, in reverse order so that the owner pops them in FIFO order
+			using Reverse = std::vector<SimpleTaskType>::reverse_iterator;
+			worker.localQueue.pushBulk(std::make_move_iterator(Reverse(worker.batch.begin() + n)), std::make_move_iterator(Reverse(worker.batch.begin() + 1)));
+			_eventCount.notifyOne();
+		}
+		return true;
+	}
+
+	inline bool MPMCThreadPool::applyAffinity(internal::Worker &worker, const std::size_t i)
+	{
+		const internal::Topology &topology = internal::Topology::instance();
+		if (_cpus.empty()) {
+			worker.node.store(0, std::memory_order_relaxed);
+			// threads inherit the mask of the process, unless they have been
+			// pinned, or are started by a pinned thread
+			return !_pinned || internal::pinThread(worker.thread, topology.cpus());
+		}
+		const std::size_t cpu = _cpus.at(i % _cpus.size());
+		const bool pinned = internal::pinThread(worker.thread, std::vector<std::size_t>(1, cpu));
+		worker.node.store(pinned ? topology.nodeOf(cpu) : 0, std::memory_order_relaxed);
+		return pinned;
+	}
+
+	inline bool MPMCThreadPool::spinForTask(internal::Worker &worker, SimpleTaskType &task, const IdlePolicy policy)
+	{
+		static const std::size_t MIN_SPINS = 16;
+		static const std::size_t N_YIELDS  = 8;
+		const std::size_t maxSpins = _maxSpins.load(std::memory_order_relaxed);
+		const std::size_t spins = policy == IdlePolicy::BusyPoll ? maxSpins : std::min(worker.spins, maxSpins);
+		for (std::size_t i = 0; i < spins; ++i) {
+			internal::cpuRelax();
+			if (nextTask(worker, task)) {
+				// tasks are arriving within the spin window: spin longer
+				worker.spins = std::min(std::max(worker.spins * 2, MIN_SPINS), maxSpins);
+				return true;
+			}
+			if (!_active.load(std::memory_order_relaxed) || !worker.active.load(std::memory_order_relaxed))
+				return false;
+		}
+		for (std::size_t i = 0; i < N_YIELDS; ++i) {
+			std::this_thread::yield();
+			if (nextTask(worker, task))
+				return true;
+		}
+		// spinning has been wasted: spin less next time
+		worker.spins = std::max(worker.spins / 2, MIN_SPINS);
+		return false;
+	}
+
+	inline internal::Worker * MPMCThreadPool::localWorker() const
+	{
+		if (!_workStealing.load(std::memory_order_relaxed))
+			return nullptr;
+		internal::Worker *worker = internal::currentWorker();
+		return worker != nullptr && worker->pool == this ? worker : nullptr;
+	}
+
+	inline bool MPMCThreadPool::stealTask(internal::Worker &worker, SimpleTaskType &task)
+	{
+		std::size_t version = _workersVersion.load(std::memory_order_acquire);
+		if (!worker.victims || worker.victimsVersion != version) {
+			worker.victims = std::atomic_load(&_workers);
+			worker.victimsVersion = version;
+		}
+		const std::size_t n = worker.victims->size();
+		if (n < 2)
+			return false;
+		const std::size_t first = worker.random() % n;
+		for (std::size_t i = 0; i < n; ++i) {
+			internal::Worker &victim = *worker.victims->at((first + i) % n);
+			if (&victim != &worker && victim.localQueue.sizeApprox() > 0 && victim.localQueue.steal(task)) {
+#if MPMC_TP_STATS
+				worker.counters.taskStolen();
+#endif
+				return true;
+			}
+		}
+		return false;
+	}
+
+	inline std::size_t MPMCThreadPool::queuedTasks() const
+	{
+		std::size_t n = 0;
+		for (std::size_t p = 0; p < _taskQueues.size(); ++p)
+			n += _taskQueues[p].size_approx();
+		for (std::size_t i = 0; i < _nodeQueues.size(); ++i)
+			n += _nodeQueues[i].size_approx();
+		return n;
+	}
+
+	inline void MPMCThreadPool::reapRetired()
+	{
+		for (std::size_t i = 0; i < _retired.size(); ) {
+			internal::Worker &worker = *_retired[i];
+			if (worker.exited.load(std::memory_order_acquire)) {
+				if (worker.thread.joinable())
+					worker.thread.join();
+#if MPMC_TP_STATS
+				worker.counters.snapshot(_retiredStats);
+#endif
+				_retired.erase(_retired.begin() + i);
+			} else {
+				++i;
+			}
+		}
+	}
+
+	inline void MPMCThreadPool::supervise()
+	{
+		typedef std::chrono::steady_clock Clock;
+		// the fewest threads found parked at each check since idleSince:
+		// they are not needed
+		bool idle = false;
+		std::size_t minParked = 0;
+		Clock::time_point idleSince;
+		std::unique_lock<std::mutex> lock(_supervisorMutex);
+		while (_supervising) {
+			lock.unlock();
+			while (_flag.test_and_set())
+				;
+			reapRetired();
+			const ElasticPolicy policy = _elasticPolicy;
+			const std::size_t size = _workers->size();
+			_flag.clear();
+			const Clock::time_point now = Clock::now();
+			const std::size_t nParked = _eventCount.nWaiters();
+			if (nParked == 0) {
+				idle = false;
+				// the delay of a probe task, pending or completed, measures
+				// the latency of the pool
+				const std::int64_t nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(now.time_since_epoch()).count();
+				const std::int64_t maxLatency = std::chrono::duration_cast<std::chrono::nanoseconds>(policy.maxLatency).count();
+				const std::int64_t submitted = _probeSubmitted.load(std::memory_order_acquire);
+				bool slow = false;
+				if (submitted != 0) {
+					slow = nanos - submitted > maxLatency;
+				} else {
+					slow = _probeLatency.load(std::memory_order_relaxed) > maxLatency;
+					_probeSubmitted.store(nanos, std::memory_order_relaxed);
+					// at the capacity no probe is needed: the queue depth tells
+					if (!trySubmit([this, nanos](){
+						_probeLatency.store(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count() - nanos, std::memory_order_relaxed);
+						_probeSubmitted.store(0, std::memory_order_release);
+					}))
+						_probeSubmitted.store(0, std::memory_order_relaxed);
+				}
+				const std::size_t maxQueueDepth = std::max(policy.maxQueueDepth, std::size_t(1));
+				const std::size_t queued = queuedTasks();
+				std::size_t n = slow ? 1 : 0;
+				if (queued > maxQueueDepth * size)
+					// enough threads to bring the depth under the threshold, at
+					// most doubling at a time
+					n = std::max(n, std::min(queued / maxQueueDepth - size + 1, std::max(size, std::size_t(1))));
+				if (n > 0 && size < policy.maxSize)
+					expand(std::min(n, policy.maxSize - size));
+			} else {
+				if (!idle) {
+					idle = true;
+					minParked = nParked;
+					idleSince = now;
+				}
+				minParked = std::min(minParked, nParked);
+				if (now - idleSince >= policy.idleTimeout) {
+					if (size > policy.minSize)
+						shrink(std::min(minParked, size - policy.minSize));
+					idle = false;
+				}
+			}
+			lock.lock();
+			_supervisorCondVar.wait_for(lock, policy.period, [this]()->bool{ return !_supervising; });
+		}
+	}
+
+	inline void MPMCThreadPool::stopSupervisor()
+	{
+		std::thread supervisor;
+		{
+			std::lock_guard<std::mutex> lock(_supervisorMutex);
+			_supervising = false;
+			supervisor.swap(_supervisor);
+		}
+		_supervisorCondVar.notify_all();
+		if (supervisor.joinable())
+			supervisor.join();
+	}
+
+	inline bool MPMCThreadPool::hasPendingTasks(internal::Worker &worker)
+	{
+		for (std::size_t p = 0; p < _taskQueues.size(); ++p)
+			if (_taskQueues[p].size_approx() > 0)
+				return true;
+		for (std::size_t i = 0; i < _nodeQueues.size(); ++i)
+			if (_nodeQueues[i].size_approx() > 0)
+				return true;
+		if (worker.victims)
+			for (std::size_t i = 0; i < worker.victims->size(); ++i)
+				if (worker.victims->at(i)->localQueue.sizeApprox() > 0)
+					return true;
+		return _workersVersion.load(std::memory_order_acquire) != worker.victimsVersion;
+	}
+
+	inline bool MPMCThreadPool::compensate(internal::Worker &worker)
+	{
+		if (!_compensate || !_active.load(std::memory_order_relaxed))
+			return false;
+		// a parked thread takes over the pending tasks anyway
+		if (_eventCount.nWaiters() > 0 || !hasPendingTasks(worker))
+			return false;
+		expand(1);
+		return true;
+	}
+
+	////////////////////////////////////////////////////////////////////////////
+
+
+
+	////////////////////////////////////////////////////////////////////////////
+	// BlockingScope METHODS
+	////////////////////////////////////////////////////////////////////////////
+
+	inline BlockingScope::BlockingScope() : _pool(nullptr)
+	{
+		internal::Worker *worker = internal::currentWorker();
+		if (worker != nullptr && worker->pool->compensate(*worker))
+			_pool = worker->pool;
+	}
+
+	inline BlockingScope::~BlockingScope()
+	{
+		if (_pool != nullptr)
+			_pool->shrink(1);
+	}
+
+	inline bool BlockingScope::compensated() const
+	{
+		return _pool != nullptr;
+	}
+
+	////////////////////////////////////////////////////////////////////////////
+
+
+
+	////////////////////////////////////////////////////////////////////////////
+	// CANCELLATION METHODS
+	////////////////////////////////////////////////////////////////////////////
+
+	inline StopToken::StopToken()
+	{ }
+
+	inline StopToken::StopToken(std::shared_ptr<const std::atomic_bool> flag) : _flag(std::move(flag))
+	{ }
+
+	inline bool StopToken::stopRequested() const
+	{
+		return _flag && _flag->load(std::memory_order_relaxed);
+	}
+
+	inline bool StopToken::stopPossible() const
+	{
+		return static_cast<bool>(_flag);
+	}
+
+	namespace internal {
+
+		template < class F >
+		inline GroupTask<F>::GroupTask(std::shared_ptr<const std::atomic_bool> flag, F &&f) : _flag(std::move(flag)), _f(std::forward<F>(f))
+		{ }
+
+		template < class F >
+		inline void GroupTask<F>::operator()()
+		{
+			if (!_flag->load(std::memory_order_relaxed))
+				_f();
+		}
+
+	}
+
+	inline TaskGroup::TaskGroup() : _cancelled(std::make_shared<std::atomic_bool>(false))
+	{ }
+
+	template < class F >
+	inline internal::GroupTask<typename std::decay<F>::type> TaskGroup::wrap(F &&f) const
+	{
+		return internal::GroupTask<typename std::decay<F>::type>(_cancelled, typename std::decay<F>::type(std::forward<F>(f)));
+	}
+
+	inline void TaskGroup::cancel()
+	{
+		_cancelled->store(true, std::memory_order_relaxed);
+	}
+
+	inline bool TaskGroup::cancelled() const
+	{
+		return _cancelled->load(std::memory_order_relaxed);
+	}
+
+	inline StopToken TaskGroup::token() const
+	{
+		return StopToken(_cancelled);
+	}
+
+	////////////////////////////////////////////////////////////////////////////
+
+
+
+	////////////////////////////////////////////////////////////////////////////
+	// TIMER METHODS
+	////////////////////////////////////////////////////////////////////////////
+
+	namespace internal {
+
+		inline TimerLink::TimerLink() : prev(this), next(this)
+		{ }
+
+		inline bool TimerLink::empty() const
+		{
+			return next == this;
+		}
+
+		inline void TimerLink::linkBefore(TimerLink &link)
+		{
+			prev = link.prev;
+			next = &link;
+			link.prev->next = this;
+			link.prev = this;
+		}
+
+		inline void TimerLink::unlink()
+		{
+			prev->next = next;
+			next->prev = prev;
+			prev = next = this;
+		}
+
+		inline void TimerLink::take(TimerLink &other)
+		{
+			if (other.empty())
+				return;
+			next = other.next;
+			prev = other.prev;
+			next->prev = this;
+			prev->next = this;
+			other.prev = other.next = &other;
+		}
+
+		inline TimerNode::TimerNode(TimerWheel &w, Task &&t, const std::uint64_t p) : wheel(&w), task(std::move(t)), expiry(0), period(p), state(ARMED)
+		{ }
+
+		inline TimerTask::TimerTask(std::shared_ptr<TimerNode> &&node) : _node(std::move(node))
+		{ }
+
+		inline void TimerTask::operator()()
+		{
+			int state = TimerNode::FIRED;
+			if (!_node->state.compare_exchange_strong(state, TimerNode::RUNNING, std::memory_order_acq_rel))
+				// cancelled meanwhile
+				return;
+			if (_node->period == 0) {
+				_node->state.store(TimerNode::DONE, std::memory_order_release);
+				Task task(std::move(_node->task));
+				task();
+			} else {
+				_node->task();
+				_node->wheel->rearm(_node);
+			}
+		}
+
+		inline TimerWheel::TimerWheel(MPMCThreadPool &pool) : _pool(&pool), _start(Clock::now()), _current(0), _wakeTick(0), _size(0), _running(false), _stopped(false)
+		{ }
+
+		inline TimerWheel::~TimerWheel()
+		{
+			stop();
+			for (std::size_t l = 0; l < N_LEVELS; ++l)
+				for (std::size_t i = 0; i < N_SLOTS; ++i)
+					while (!_slots[l][i].empty()) {
+						TimerNode &node = static_cast<TimerNode &>(*_slots[l][i].next);
+						node.unlink();
+						node.state.store(TimerNode::CANCELLED, std::memory_order_release);
+						std::shared_ptr<TimerNode> self(std::move(node.self));
+					}
+		}
+
+		inline std::shared_ptr<TimerNode> TimerWheel::schedule(const Clock::time_point time, const Clock::duration period, Task &&task)
+		{
+			const std::uint64_t periodTicks = period > Clock::duration::zero() ? std::max(ticks(_start + period), std::uint64_t(1)) : 0;
+			std::shared_ptr<TimerNode> node = std::make_shared<TimerNode>(*this, std::forward<Task>(task), periodTicks);
+			std::unique_lock<std::mutex> lock(_mutex);
+			if (_size == 0)
+				// the wheel is not advanced while empty: catch up, which needs
+				// no cascade
+				_current = std::max(_current, elapsedTicks());
+			node->expiry = ticks(time);
+			if (node->expiry <= _current) {
+				// due already
+				node->state.store(TimerNode::FIRED, std::memory_order_relaxed);
+				lock.unlock();
+				resubmit(*_pool, TimerTask(std::shared_ptr<TimerNode>(node)));
+				return node;
+			}
+			node->self = node;
+			insert(*node);
+			if (!_running && !_stopped) {
+				_running = true;
+				_thread = std::thread(&TimerWheel::run, this);
+			} else if (node->expiry < _wakeTick) {
+				_condVar.notify_one();
+			}
+			return node;
+		}
+
+		inline bool TimerWheel::cancel(TimerNode &node)
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			// only this thread and the thread advancing the wheel (both
+			// holding _mutex) change the state of an armed timer
+			int state = node.state.load(std::memory_order_acquire);
+			if (state == TimerNode::ARMED) {
+				node.unlink();
+				--_size;
+				node.state.store(TimerNode::CANCELLED, std::memory_order_release);
+				node.self.reset();
+				return true;
+			}
+			while (state == TimerNode::FIRED || (state == TimerNode::RUNNING && node.period > 0))
+				if (node.state.compare_exchange_weak(state, TimerNode::CANCELLED, std::memory_order_acq_rel))
+					return true;
+			return false;
+		}
+
+		inline void TimerWheel::rearm(const std::shared_ptr<TimerNode> &node)
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			int state = TimerNode::RUNNING;
+			if (!node->state.compare_exchange_strong(state, TimerNode::ARMED, std::memory_order_acq_rel))
+				// cancelled meanwhile
+				return;
+			// no overlapping runs, no bursts for the late ones
+			node->expiry = std::max(node->expiry + node->period, _current + 1);
+			node->self = node;
+			insert(*node);
+			if (node->expiry < _wakeTick)
+				_condVar.notify_one();
+		}
+
+		inline void TimerWheel::stop()
+		{
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				_stopped = true;
+			}
+			_condVar.notify_all();
+			if (_thread.joinable())
+				_thread.join();
+		}
+
+		inline std::size_t TimerWheel::size() const
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			return _size;
+		}
+
+		inline std::uint64_t TimerWheel::ticks(const Clock::time_point time) const
+		{
+			if (time <= _start)
+				return 0;
+			const std::int64_t nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(time - _start).count();
+			return static_cast<std::uint64_t>((nanos + TICK_NS - 1) / TICK_NS);
+		}
+
+		inline std::uint64_t TimerWheel::elapsedTicks() const
+		{
+			return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - _start).count() / TICK_NS);
+		}
+
+		inline void TimerWheel::insert(TimerNode &node)
+		{
+			static const std::uint64_t MAX_DELTA = (std::uint64_t(1) << (SLOT_BITS * N_LEVELS)) - 1;
+			std::uint64_t delta = node.expiry - _current;
+			std::uint64_t expiry = node.expiry;
+			if (delta > MAX_DELTA) {
+				// beyond the span of the wheel: it is cascaded until it fits
+				delta = MAX_DELTA;
+				expiry = _current + MAX_DELTA;
+			}
+			std::size_t level = 0;
+			while (delta >= (std::uint64_t(1) << (SLOT_BITS * (level + 1))))
+				++level;
+			node.linkBefore(_slots[level][(expiry >> (SLOT_BITS * level)) & (N_SLOTS - 1)]);
+			++_size;
+		}
+
+		inline void TimerWheel::advance(std::vector<Task> &fired)
+		{
+			++_current;
+			// the slots of the upper levels crossed by the current tick, from
+			// the highest one
+			std::size_t level = 1;
+			while (level < N_LEVELS && (_current & ((std::uint64_t(1) << (SLOT_BITS * level)) - 1)) == 0)
+				++level;
+			TimerLink list;
+			while (--level > 0) {
+				list.take(_slots[level][(_current >> (SLOT_BITS * level)) & (N_SLOTS - 1)]);
+				while (!list.empty()) {
+					TimerNode &node = static_cast<TimerNode &>(*list.next);
+					node.unlink();
+					--_size;
+					insert(node);
+				}
+			}
+			list.take(_slots[0][_current & (N_SLOTS - 1)]);
+			while (!list.empty()) {
+				TimerNode &node = static_cast<TimerNode &>(*list.next);
+				node.unlink();
+				--_size;
+				node.state.store(TimerNode::FIRED, std::memory_order_release);
+				fired.emplace_back(TimerTask(std::move(node.self)));
+			}
+		}
+
+		inline void TimerWheel::run()
+		{
+			std::vector<Task> fired;
+			std::unique_lock<std::mutex> lock(_mutex);
+			while (!_stopped) {
+				const std::uint64_t now = elapsedTicks();
+				if (_size == 0)
+					// nothing to cascade: jump
+					_current = std::max(_current, now);
+				while (_current < now)
+					advance(fired);
+				if (!fired.empty()) {
+					lock.unlock();
+					resubmit(*_pool, std::make_move_iterator(fired.begin()), std::make_move_iterator(fired.end()));
+					fired.clear();
+					lock.lock();
+					continue;
+				}
+				// sleep until the next non-empty slot of level 0 or the next
+				// cascade, whichever comes first
+				if (_size == 0) {
+					_wakeTick = std::numeric_limits<std::uint64_t>::max();
+					_condVar.wait(lock);
+				} else {
+					_wakeTick = (_current | (N_SLOTS - 1)) + 1;
+					for (std::uint64_t t = _current + 1; t < _wakeTick; ++t)
+						if (!_slots[0][t & (N_SLOTS - 1)].empty()) {
+							_wakeTick = t;
+							break;
+						}
+					_condVar.wait_until(lock, _start + std::chrono::nanoseconds(static_cast<std::int64_t>(_wakeTick) * TICK_NS));
+				}
+			}
+		}
+
+	}
+
+	////////////////////////////////////////////////////////////////////////////
+
+
+
+	////////////////////////////////////////////////////////////////////////////
+	// TOKEN METHODS
+	////////////////////////////////////////////////////////////////////////////
+
+	namespace internal {
+
+		inline TokenRegistry::TokenRegistry(ConcurrentQueue<SimpleTaskType> &queue) : _queue(&queue)
+		{ }
+
+		inline ProducerToken * TokenRegistry::acquire()
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			if (_queue == nullptr)
+				return nullptr;
+			_tokens.push_back(std::unique_ptr<ProducerToken>(new ProducerToken(*_queue)));
+			return _tokens.back().get();
+		}
+
+		inline void TokenRegistry::release(ProducerToken *token)
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			for (std::size_t i = 0; i < _tokens.size(); ++i)
+				if (_tokens[i].get() == token) {
+					// destroyed holding _mutex: the queue outlives it
+					std::swap(_tokens[i], _tokens.back());
+					_tokens.pop_back();
+					return;
+				}
+		}
+
+		inline void TokenRegistry::close()
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_tokens.clear();
+			_queue = nullptr;
+		}
+
+		inline bool TokenRegistry::closed() const
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			return _queue == nullptr;
+		}
+
+		inline TokenCache::TokenCache()
+		{ }
+
+		inline TokenCache::~TokenCache()
+		{
+			for (std::size_t i = 0; i < _entries.size(); ++i)
+				_entries[i].registry->release(_entries[i].token);
+		}
+
+		inline ProducerToken * TokenCache::get(const std::shared_ptr<TokenRegistry> &registry)
+		{
+			for (std::size_t i = 0; i < _entries.size(); ++i)
+				if (_entries[i].registry == registry)
+					return _entries[i].token;
+			// forget the pools destroyed meanwhile
+			std::size_t n = 0;
+			for (std::size_t i = 0; i < _entries.size(); ++i)
+				if (!_entries[i].registry->closed())
+					_entries[n++] = std::move(_entries[i]);
+			_entries.resize(n);
+			Entry entry;
+			entry.registry = registry;
+			entry.token = registry->acquire();
+			if (entry.token == nullptr)
+				return nullptr;
+			_entries.push_back(std::move(entry));
+			return _entries.back().token;
+		}
+
+		inline TokenCache & tokenCache()
+		{
+			static thread_local TokenCache cache;
+			return cache;
+		}
+
+	}
+
+	////////////////////////////////////////////////////////////////////////////
+
+
+
+	////////////////////////////////////////////////////////////////////////////
+	// TimerHandle METHODS
+	////////////////////////////////////////////////////////////////////////////
+
+	inline TimerHandle::TimerHandle()
+	{ }
+
+	inline TimerHandle::TimerHandle(std::shared_ptr<internal::TimerNode> node) : _node(std::move(node))
+	{ }
+
+	inline bool TimerHandle::cancel()
+	{
+		return _node && _node->wheel->cancel(*_node);
+	}
+
+	inline bool TimerHandle::pending() const
+	{
+		if (!_node)
+			return false;
+		const int state = _node->state.load(std::memory_order_acquire);
+		return state == internal::TimerNode::ARMED || state == internal::TimerNode::FIRED || (state == internal::TimerNode::RUNNING && _node->period > 0);
+	}
+
+	////////////////////////////////////////////////////////////////////////////
+
+
+
+
+
+
+	////////////////////////////////////////////////////////////////////////////
+	// TRAITS
+	////////////////////////////////////////////////////////////////////////////
+
+	////////////////////////////////////////////////////////////////////////
+	// TaskPackTraitsLockFree METHODS
+	////////////////////////////////////////////////////////////////////////
+
+	inline TaskPackTraitsLockFree::TaskPackTraitsLockFree(const std::size_t size) : _size(size), _completion(size), _interval(0)
+	{ }
+
+	template < class Rep, class Period >
+	inline TaskPackTraitsLockFree::TaskPackTraitsLockFree(const std::size_t size, const std::chrono::duration<Rep, Period> &interval) : _size(size), _completion(size), _interval(interval)
+	{ }
+
+	template < class Rep, class Period >
+	inline TaskPackTraitsLockFree::TaskPackTraitsLockFree(const std::size_t size, std::chrono::duration<Rep, Period> &&interval) : _size(size), _completion(size), _interval(std::forward<std::chrono::duration<Rep, Period>>(interval))
+	{ }
+
+	inline void TaskPackTraitsLockFree::setTraitsSize(const std::size_t size)
+	{
+		_size = size;
+		_completion.reset(size);
+	}
+
+	template < class Rep, class Period >
+	inline void TaskPackTraitsLockFree::setInterval(const std::chrono::duration<Rep, Period> &interval)
+	{
+		_interval = interval;
+	}
+
+	template < class Rep, class Period >
+	inline void TaskPackTraitsLockFree::setInterval(std::chrono::duration<Rep, Period> &&interval)
+	{
+		_interval = std::forward<std::chrono::duration<Rep, Period>>(interval);
+	}
+
+	template < class C, class ...Args >
+	inline void TaskPackTraitsLockFree::setCallback(C &&c, Args &&...args)
+	{
+		_callback = std::bind(std::forward<C>(c), std::placeholders::_1, std::forward<Args>(args)...);
+	}
+
+	inline void TaskPackTraitsLockFree::signalTaskComplete(const std::size_t i)
+	{
+		// the callback comes first: once the counter reaches _size the pack
+		// may be destroyed
+		if (_callback)
+			_callback(i);
+		_completion.signal(i);
+	}
+
+	inline std::size_t TaskPackTraitsLockFree::nCompletedTasks() const
+	{
+		return _completion.count();
+	}
+
+	inline void TaskPackTraitsLockFree::wait() const
+	{
+		waitComplete();
+	}
+
+	inline void TaskPackTraitsLockFree::waitComplete() const
+	{
+		const bool helping = internal::currentWorker() != nullptr;
+		while (!_completion.complete())
+			if (!(helping && internal::helpCurrentPool()) && _interval.count() > 0)
+				std::this_thread::sleep_for(_interval);
+	}
+
+	////////////////////////////////////////////////////////////////////////
+
+
+
+	////////////////////////////////////////////////////////////////////////
+	// TaskPackTraitsBlocking METHODS
+	////////////////////////////////////////////////////////////////////////
+
+	inline TaskPackTraitsBlocking::TaskPackTraitsBlocking(const std::size_t size) : TaskPackTraitsLockFree(size), _waitWoken(false)
+	{ }
+
+	template < class Rep, class Period >
+	inline TaskPackTraitsBlocking::TaskPackTraitsBlocking(const std::size_t size, const std::chrono::duration<Rep, Period> &interval) : TaskPackTraitsLockFree(size, interval), _waitWoken(false)
+	{ }
+
+	template < class Rep, class Period >
+	inline TaskPackTraitsBlocking::TaskPackTraitsBlocking(const std::size_t size, std::chrono::duration<Rep, Period> &&interval) : TaskPackTraitsLockFree(size, std::forward<std::chrono::duration<Rep, Period>>(interval)), _waitWoken(false)
+	{ }
+
+	inline void TaskPackTraitsBlocking::setTraitsSize(const std::size_t size)
+	{
+		TaskPackTraitsLockFree::setTraitsSize(size);
+		_waitWoken.store(false, std::memory_order_relaxed);
+	}
+
+	inline void TaskPackTraitsBlocking::signalTaskComplete(const std::size_t i)
+	{
+		if (_callback)
+			_callback(i);
+		if (_completion.signal(i)) {
+			{
+				std::lock_guard<std::mutex> lock(_waitMutex);
+				_waitCondVar.notify_all();
+			}
+			// last access to the pack: the waiting thread can return now
+			_waitWoken.store(true, std::memory_order_release);
+		}
+	}
+
+	inline void TaskPackTraitsBlocking::wait() const
+	{
+		// how long a thread of a pool blocks before looking for tasks again
+		static const std::chrono::microseconds HELP_INTERVAL(100);
+		const bool helping = internal::currentWorker() != nullptr;
+		std::unique_lock<std::mutex> lock(_waitMutex, std::defer_lock);
+		while (!_completion.complete()) {
+			if (helping && internal::helpCurrentPool())
+				continue;
+			lock.lock();
+			if (helping)
+				_waitCondVar.wait_for(lock, HELP_INTERVAL, [this]()->bool{ return _completion.complete(); });
+			else
+				_waitCondVar.wait(lock, [this]()->bool{ return _completion.complete(); });
+			lock.unlock();
+		}
+		// the last task may still be notifying
+		while (_size > 0 && !_waitWoken.load(std::memory_order_acquire))
+			std::this_thread::yield();
+	}
+
+	////////////////////////////////////////////////////////////////////////////
+
+
+
+
+
+
+	////////////////////////////////////////////////////////////////////////////
+	// INTERNAL STUFF
+	////////////////////////////////////////////////////////////////////////////
+
+	namespace internal {
+
+#if MPMC_TP_STATS
+		////////////////////////////////////////////////////////////////////////
+		// WorkerCounters METHODS
+		////////////////////////////////////////////////////////////////////////
+
+		inline WorkerCounters::WorkerCounters()
+		{
+			reset();
+		}
+
+		inline void WorkerCounters::taskExecuted(const std::chrono::nanoseconds delay, const std::chrono::nanoseconds duration)
+		{
+			// single writer
+			_tasksExecuted.store(_tasksExecuted.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+			_busyNanos.store(_busyNanos.load(std::memory_order_relaxed) + static_cast<std::uint64_t>(duration.count()), std::memory_order_relaxed);
+			if (delay.count() < 0)
+				return;
+			std::size_t bucket = 0;
+			for (std::uint64_t ns = static_cast<std::uint64_t>(delay.count()); ns > 1 && bucket < WorkerStats::N_LATENCY_BUCKETS - 1; ns >>= 1)
+				++bucket;
+			_latency[bucket].store(_latency[bucket].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		}
+
+		inline void WorkerCounters::taskStolen()
+		{
+			// single writer
+			_tasksStolen.store(_tasksStolen.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		}
+
+		inline void WorkerCounters::wokenUp(const std::chrono::nanoseconds parked)
+		{
+			// single writer
+			_wakeups.store(_wakeups.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+			_parkedNanos.store(_parkedNanos.load(std::memory_order_relaxed) + static_cast<std::uint64_t>(parked.count()), std::memory_order_relaxed);
+		}
+
+		inline void WorkerCounters::snapshot(WorkerStats &stats) const
+		{
+			stats.tasksExecuted += _tasksExecuted.load(std::memory_order_relaxed);
+			stats.tasksStolen += _tasksStolen.load(std::memory_order_relaxed);
+			stats.wakeups += _wakeups.load(std::memory_order_relaxed);
+			stats.busyTime += std::chrono::nanoseconds(_busyNanos.load(std::memory_order_relaxed));
+			stats.parkedTime += std::chrono::nanoseconds(_parkedNanos.load(std::memory_order_relaxed));
+			for (std::size_t i = 0; i < WorkerStats::N_LATENCY_BUCKETS; ++i)
+				stats.latency[i] += _latency[i].load(std::memory_order_relaxed);
+		}
+
+		inline void WorkerCounters::reset()
+		{
+			_tasksExecuted.store(0, std::memory_order_relaxed);
+			_tasksStolen.store(0, std::memory_order_relaxed);
+			_wakeups.store(0, std::memory_order_relaxed);
+			_busyNanos.store(0, std::memory_order_relaxed);
+			_parkedNanos.store(0, std::memory_order_relaxed);
+			for (std::size_t i = 0; i < WorkerStats::N_LATENCY_BUCKETS; ++i)
+				_latency[i].store(0, std::memory_order_relaxed);
+		}
+
+		////////////////////////////////////////////////////////////////////////
+#endif
+
+
+
+		////////////////////////////////////////////////////////////////////////
+		// WorkStealingQueue METHODS
+		////////////////////////////////////////////////////////////////////////
+
+		inline WorkStealingQueue::WorkStealingQueue() : _size(0)
+		{
+			_flag.clear();
+		}
+
+		inline std::size_t WorkStealingQueue::sizeApprox() const
+		{
+			return _size.load(std::memory_order_relaxed);
+		}
+
+		inline void WorkStealingQueue::push(SimpleTaskType &&task)
+		{
+			while (_flag.test_and_set(std::memory_order_acquire))
+				;
+			_tasks.push_back(std::forward<SimpleTaskType>(task));
+			_size.store(_tasks.size(), std::memory_order_relaxed);
+			_flag.clear(std::memory_order_release);
+		}
+
+		template < class It >
+		inline void WorkStealingQueue::pushBulk(It first, It last)
+		{
+			while (_flag.test_and_set(std::memory_order_acquire))
+				;
+			_tasks.insert(_tasks.end(), first, last);
+			_size.store(_tasks.size(), std::memory_order_relaxed);
+			_flag.clear(std::memory_order_release);
+		}
+
+		inline bool WorkStealingQueue::pop(SimpleTaskType &task)
+		{
+			if (sizeApprox() == 0)
+				return false;
+			while (_flag.test_and_set(std::memory_order_acquire))
+				;
+			bool popped = !_tasks.empty();
+			if (popped) {
+				task = std::move(_tasks.back());
+				_tasks.pop_back();
+				_size.store(_tasks.size(), std::memory_order_relaxed);
+			}
+			_flag.clear(std::memory_order_release);
+			return popped;
+		}
+
+		inline bool WorkStealingQueue::steal(SimpleTaskType &task)
+		{
+			while (_flag.test_and_set(std::memory_order_acquire))
+				;
+			bool stolen = !_tasks.empty();
+			if (stolen) {
+				task = std::move(_tasks.front());
+				_tasks.pop_front();
+				_size.store(_tasks.size(), std::memory_order_relaxed);
+			}
+			_flag.clear(std::memory_order_release);
+			return stolen;
+		}
+
+		////////////////////////////////////////////////////////////////////////
+
+
+
+		////////////////////////////////////////////////////////////////////////
+		// Worker METHODS
+		////////////////////////////////////////////////////////////////////////
+
+		inline Worker::Worker(MPMCThreadPool &p, ConcurrentQueue<SimpleTaskType> &queue, const std::size_t seed) : pool(&p), active(true), exited(false), random(static_cast<std::minstd_rand::result_type>(seed + 1)), victimsVersion(0), spins(MPMCThreadPool::DEFAULT_MAX_SPINS()), nPolls(0), node(0), consumerToken(queue), batchSize(1)
+		{ }
+
+		inline Worker *& currentWorker()
+		{
+			static thread_local Worker *worker = nullptr;
+			return worker;
+		}
+
+		inline bool helpCurrentPool()
+		{
+			Worker *worker = currentWorker();
+			return worker != nullptr && worker->pool->runPendingTask();
+		}
+
+		inline void resubmit(MPMCThreadPool &pool, SimpleTaskType &&task)
+		{
+			pool.admitInternal(1);
+			pool.markSubmitted(task);
+			if (Worker *worker = pool.localWorker())
+				worker->localQueue.push(std::forward<SimpleTaskType>(task));
+			else
+				pool.enqueue(std::forward<SimpleTaskType>(task));
+			pool._eventCount.notifyOne();
+		}
+
+		template < class It >
+		inline void resubmit(MPMCThreadPool &pool, It first, It last)
+		{
+			const std::size_t n = std::distance(first, last);
+			if (n == 0)
+				return;
+			pool.admitInternal(n);
+			pool.markSubmitted(first, last);
+			if (Worker *worker = pool.localWorker())
+				worker->localQueue.pushBulk(first, last);
+			else
+				pool.enqueueBulk(std::forward<It>(first), n);
+			if (n > 1)
+				pool._eventCount.notifyAll();
+			else
+				pool._eventCount.notifyOne();
+		}
+
+		////////////////////////////////////////////////////////////////////////
+
+
+
+		////////////////////////////////////////////////////////////////////////
+		// Topology METHODS
+		////////////////////////////////////////////////////////////////////////
+
+		inline const Topology & Topology::instance()
+		{
+			static const Topology topology;
+			return topology;
+		}
+
+		inline Topology::Topology()
+		{
+#if defined(__linux__)
+			// the CPUs the process may run on
+			cpu_set_t mask;
+			const bool masked = sched_getaffinity(0, sizeof(cpu_set_t), &mask) == 0;
+			if (DIR *dir = opendir("/sys/devices/system/node")) {
+				while (dirent *entry = readdir(dir)) {
+					const std::string name(entry->d_name);
+					if (name.compare(0, 4, "node") != 0 || name.size() == 4 || name.find_first_not_of("0123456789", 4) != std::string::npos)
+						continue;
+					const std::size_t node = std::stoul(name.substr(4));
+					std::ifstream file("/sys/devices/system/node/" + name + "/cpulist");
+					std::string list;
+					if (!std::getline(file, list))
+						continue;
+					std::vector<std::size_t> cpus;
+					// the list has form "0-3,8,10-11"
+					std::istringstream ranges(list);
+					std::string range;
+					while (std::getline(ranges, range, ',')) {
+						if (range.empty() || range.find_first_not_of("0123456789-\n") != std::string::npos)
+							continue;
+						const std::size_t dash = range.find('-');
+						const std::size_t first = std::stoul(range.substr(0, dash));
+						const std::size_t last = dash == std::string::npos ? first : std::stoul(range.substr(dash + 1));
+						for (std::size_t cpu = first; cpu <= last; ++cpu)
+							if (!masked || (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &mask)))
+								cpus.push_back(cpu);
+					}
+					if (cpus.empty())
+						continue;
+					if (_nodes.size() <= node)
+						_nodes.resize(node + 1);
+					_nodes[node] = cpus;
+				}
+				closedir(dir);
+			}
+			// drop the gaps of the node numbering
+			for (std::size_t i = _nodes.size(); i > 0; --i)
+				if (_nodes[i - 1].empty())
+					_nodes.erase(_nodes.begin() + (i - 1));
+			if (_nodes.empty() && masked) {
+				_nodes.resize(1);
+				for (std::size_t cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+					if (CPU_ISSET(cpu, &mask))
+						_nodes[0].push_back(cpu);
+				if (_nodes[0].empty())
+					_nodes.clear();
+			}
+#endif
+			if (_nodes.empty()) {
+				_nodes.resize(1);
+				for (std::size_t cpu = 0; cpu < std::max(std::thread::hardware_concurrency(), 1u); ++cpu)
+					_nodes[0].push_back(cpu);
+			}
+		}
+
+		inline std::size_t Topology::nNodes() const
+		{
+			return _nodes.size();
+		}
+
+		inline std::size_t Topology::nodeOf(const std::size_t cpu) const
+		{
+			for (std::size_t node = 0; node < _nodes.size(); ++node)
+				if (std::find(_nodes[node].begin(), _nodes[node].end(), cpu) != _nodes[node].end())
+					return node;
+			return 0;
+		}
+
+		inline std::vector<std::size_t> Topology::cpus() const
+		{
+			return cpus(AffinityPolicy::Compact);
+		}
+
+		inline std::vector<std::size_t> Topology::cpus(const AffinityPolicy policy) const
+		{
+			std::vector<std::size_t> cpus;
+			if (policy == AffinityPolicy::Scatter) {
+				for (std::size_t i = 0, added = 1; added > 0; ++i) {
+					added = 0;
+					for (std::size_t node = 0; node < _nodes.size(); ++node)
+						if (i < _nodes[node].size()) {
+							cpus.push_back(_nodes[node][i]);
+							++added;
+						}
+				}
+			} else {
+				for (std::size_t node = 0; node < _nodes.size(); ++node)
+					cpus.insert(cpus.end(), _nodes[node].begin(), _nodes[node].end());
+			}
+			return cpus;
+		}
+
+		inline bool pinThread(std::thread &thread, const std::vector<std::size_t> &cpus)
+		{
+#if defined(__linux__)
+			cpu_set_t set;
+			CPU_ZERO(&set);
+			for (std::size_t i = 0; i < cpus.size(); ++i)
+				if (cpus[i] < CPU_SETSIZE)
+					CPU_SET(cpus[i], &set);
+			return pthread_setaffinity_np(thread.native_handle(), sizeof(cpu_set_t), &set) == 0;
+#else
+			(void)thread;
+			(void)cpus;
+			return false;
+#endif
+		}
+
+		////////////////////////////////////////////////////////////////////////
+
+
+
+		////////////////////////////////////////////////////////////////////////
+		// PackedTask METHODS
+		////////////////////////////////////////////////////////////////////////
+
+		template < class Pack, class G >
+		inline PackedTask<Pack, G>::PackedTask(Pack &pack, const std::size_t i, G &&g) : _pack(&pack), _i(i), _g(std::forward<G>(g))
+		{ }
+
+		template < class Pack, class G >
+		inline void PackedTask<Pack, G>::operator()()
+		{
+			_pack->runTaskAt(_i, _g);
+		}
+
+		////////////////////////////////////////////////////////////////////////
+
+
+
+		////////////////////////////////////////////////////////////////////////
+		// ArenaAllocator METHODS
+		////////////////////////////////////////////////////////////////////////
+
+		template < class T >
+		inline ArenaAllocator<T>::ArenaAllocator(TaskPackArena *arena) : _arena(arena)
+		{ }
+
+		template < class T > template < class U >
+		inline ArenaAllocator<T>::ArenaAllocator(const ArenaAllocator<U> &other) : _arena(other.arena())
+		{ }
+
+		template < class T >
+		inline T * ArenaAllocator<T>::allocate(const std::size_t n)
+		{
+			if (_arena != nullptr)
+				return static_cast<T *>(_arena->allocate(n * sizeof(T), alignof(T)));
+			return static_cast<T *>(::operator new(n * sizeof(T)));
+		}
+
+		template < class T >
+		inline void ArenaAllocator<T>::deallocate(T *p, const std::size_t)
+		{
+			if (_arena == nullptr)
+				::operator delete(p);
+		}
+
+		template < class T >
+		inline TaskPackArena * ArenaAllocator<T>::arena() const
+		{
+			return _arena;
+		}
+
+		template < class T, class U >
+		inline bool operator==(const ArenaAllocator<T> &a, const ArenaAllocator<U> &b)
+		{
+			return a.arena() == b.arena();
+		}
+
+		template < class T, class U >
+		inline bool operator!=(const ArenaAllocator<T> &a, const ArenaAllocator<U> &b)
+		{
+			return !(a == b);
+		}
+
+		////////////////////////////////////////////////////////////////////////
+
+
+
+		////////////////////////////////////////////////////////////////////////
+		// TaskPackBase METHODS
+		////////////////////////////////////////////////////////////////////////
+
+		inline TaskPackBase::TaskPackBase(const std::size_t size) : _tasks(size), _cancelled(false)
+		{ }
+
+		inline TaskPackBase::TaskPackBase(const std::size_t size, TaskPackArena &arena) : _tasks(ArenaAllocator<SimpleTaskType>(&arena)), _cancelled(false)
+		{
+			_tasks.resize(size);
+		}
+
+		inline std::size_t TaskPackBase::size() const
+		{
+			return _tasks.size();
+		}
+
+		inline TaskPackBase::iterator TaskPackBase::begin()
+		{
+			return _tasks.begin();
+		}
+
+		inline TaskPackBase::const_iterator TaskPackBase::begin() const
+		{
+			return _tasks.begin();
+		}
+
+		inline TaskPackBase::move_iterator TaskPackBase::moveBegin()
+		{
+			return std::make_move_iterator(_tasks.begin());
+		}
+
+		inline TaskPackBase::iterator TaskPackBase::end()
+		{
+			return _tasks.end();
+		}
+
+		inline TaskPackBase::const_iterator TaskPackBase::end() const
+		{
+			return _tasks.end();
+		}
+
+		inline TaskPackBase::move_iterator TaskPackBase::moveEnd()
+		{
+			return std::make_move_iterator(_tasks.end());
+		}
+
+		inline void TaskPackBase::cancel()
+		{
+			_cancelled.store(true, std::memory_order_relaxed);
+		}
+
+		inline bool TaskPackBase::cancelled() const
+		{
+			return _cancelled.load(std::memory_order_relaxed);
+		}
+
+		inline StopToken TaskPackBase::token() const
+		{
+			// not owning: the pack outlives its tasks
+			return StopToken(std::shared_ptr<const std::atomic_bool>(std::shared_ptr<const std::atomic_bool>(), &_cancelled));
+		}
+
+		////////////////////////////////////////////////////////////////////////
+
+	}
+
+	////////////////////////////////////////////////////////////////////////////
+
+
+
+	////////////////////////////////////////////////////////////////////////////
+	// TaskPackArena METHODS
+	////////////////////////////////////////////////////////////////////////////
+
+	inline TaskPackArena::TaskPackArena(const std::size_t capacity) : _used(0), _capacity(0)
+	{
+		if (capacity > 0)
+			addBlock(capacity);
+	}
+
+	inline TaskPackArena::~TaskPackArena()
+	{
+		for (std::size_t i = 0; i < _blocks.size(); ++i)
+			delete[] _blocks[i].memory;
+	}
+
+	inline void * TaskPackArena::allocate(const std::size_t size, const std::size_t alignment)
+	{
+		// the smallest block worth allocating
+		static const std::size_t MIN_BLOCK_SIZE = 4096;
+		if (!_blocks.empty()) {
+			const Block &block = _blocks.back();
+			const std::uintptr_t address = reinterpret_cast<std::uintptr_t>(block.memory) + _used;
+			const std::size_t offset = _used + static_cast<std::size_t>((alignment - address % alignment) % alignment);
+			if (offset + size <= block.size) {
+				_used = offset + size;
+				return block.memory + offset;
+			}
+		}
+		addBlock(std::max(size + alignment - 1, std::max(_capacity, MIN_BLOCK_SIZE)));
+		const Block &block = _blocks.back();
+		const std::uintptr_t address = reinterpret_cast<std::uintptr_t>(block.memory);
+		const std::size_t offset = static_cast<std::size_t>((alignment - address % alignment) % alignment);
+		_used = offset + size;
+		return block.memory + offset;
+	}
+
+	inline void TaskPackArena::release()
+	{
+		if (_blocks.size() > 1) {
+			const std::size_t capacity = _capacity;
+			for (std::size_t i = 0; i < _blocks.size(); ++i)
+				delete[] _blocks[i].memory;
+			_blocks.clear();
+			_capacity = 0;
+			addBlock(capacity);
+		}
+		_used = 0;
+	}
+
+	inline std::size_t TaskPackArena::capacity() const
+	{
+		return _capacity;
+	}
+
+	inline void TaskPackArena::addBlock(const std::size_t size)
+	{
+		_blocks.reserve(_blocks.size() + 1);
+		Block block = { new char[size], size };
+		_blocks.push_back(block);
+		_used = 0;
+		_capacity += size;
+	}
+
+	////////////////////////////////////////////////////////////////////////////
+
+
+
+	////////////////////////////////////////////////////////////////////////////
+	// TaskPack METHODS
+	////////////////////////////////////////////////////////////////////////////
+
+	template < class R, class TaskPackTraits > template < class ...Args >
+	inline TaskPack<R, TaskPackTraits>::TaskPack(const std::size_t size, Args &&...args) : internal::TaskPackBase(size), TaskPackTraits(size, std::forward<Args>(args)...), _results(size)
+	{ }
+
+	template < class R, class TaskPackTraits > template < class ...Args >
+	inline TaskPack<R, TaskPackTraits>::TaskPack(TaskPackArena &arena, const std::size_t size, Args &&...args) : internal::TaskPackBase(size, arena), TaskPackTraits(size, std::forward<Args>(args)...), _results(size, arena)
+	{ }
+
+	template < class R, class TaskPackTraits > template < class F, class ...Args >
+	inline void TaskPack<R, TaskPackTraits>::setTaskAt(const std::size_t i, F &&f, Args &&...args)
+	{
+		static_assert(std::is_convertible<internal::InvokeResult<F, Args...>, R>::value, "Result type of callable object must be same of TaskPack template parameter.");
+		static_assert(std::is_void<decltype(std::declval<TaskPack<R, TaskPackTraits>>().signalTaskComplete(std::declval<std::size_t>()))>::value, "TaskPackTraits template parameter must have a 'void signalTaskComplete(std::size_t)' method.");
+		using G = decltype(std::bind(std::forward<F>(f), std::forward<Args>(args)...));
+		_tasks.at(i) = internal::PackedTask<TaskPack<R, TaskPackTraits>, G>(*this, i, std::bind(std::forward<F>(f), std::forward<Args>(args)...));
+	}
+
+	template < class R, class TaskPackTraits >
+	inline const R & TaskPack<R, TaskPackTraits>::resultAt(const std::size_t i) const
+	{
+		return _results.at(i).value();
+	}
+
+	template < class R, class TaskPackTraits >
+	inline bool TaskPack<R, TaskPackTraits>::hasResultAt(const std::size_t i) const
+	{
+		return _results.at(i).hasValue();
+	}
+
+	template < class R, class TaskPackTraits >
+	inline void TaskPack<R, TaskPackTraits>::reset()
+	{
+		for (std::size_t i = 0; i < _results.size(); ++i)
+			_results[i].reset();
+		_cancelled.store(false, std::memory_order_relaxed);
+		this->setTraitsSize(_tasks.size());
+	}
+
+	template < class R, class TaskPackTraits > template < class G >
+	inline void TaskPack<R, TaskPackTraits>::runTaskAt(const std::size_t i, G &g)
+	{
+		if (!cancelled())
+			_results.at(i).emplace(g);
+		this->signalTaskComplete(i);
+	}
+
+
+
+	template < class TaskPackTraits > template < class ...Args >
+	inline TaskPack<void, TaskPackTraits>::TaskPack(const std::size_t size, Args &&...args) : internal::TaskPackBase(size), TaskPackTraits(size, std::forward<Args>(args)...)
+	{ }
+
+	template < class TaskPackTraits > template < class ...Args >
+	inline TaskPack<void, TaskPackTraits>::TaskPack(TaskPackArena &arena, const std::size_t size, Args &&...args) : internal::TaskPackBase(size, arena), TaskPackTraits(size, std::forward<Args>(args)...)
+	{ }
+
+	template < class TaskPackTraits > template < class F, class ...Args >
+	inline void TaskPack<void, TaskPackTraits>::setTaskAt(const std::size_t i, F &&f, Args &&...args)
+	{
+		static_assert(std::is_void<internal::InvokeResult<F, Args...>>::value, "Result type of callable object must be same of TaskPack template parameter.");
+		static_assert(std::is_void<decltype(std::declval<TaskPack<void, TaskPackTraits>>().signalTaskComplete(std::declval<std::size_t>()))>::value, "TaskPackTraits template parameter must have a 'void signalTaskComplete(std::size_t)' method.");
+		using G = decltype(std::bind(std::forward<F>(f), std::forward<Args>(args)...));
+		_tasks.at(i) = internal::PackedTask<TaskPack<void, TaskPackTraits>, G>(*this, i, std::bind(std::forward<F>(f), std::forward<Args>(args)...));
+	}
+
+	template < class TaskPackTraits >
+	inline void TaskPack<void, TaskPackTraits>::reset()
+	{
+		_cancelled.store(false, std::memory_order_relaxed);
+		this->setTraitsSize(_tasks.size());
+	}
+
+	template < class TaskPackTraits > template < class G >
+	inline void TaskPack<void, TaskPackTraits>::runTaskAt(const std::size_t i, G &g)
+	{
+		if (!cancelled())
+			g();
+		this->signalTaskComplete(i);
+	}
+
+	////////////////////////////////////////////////////////////////////////////
+
+
+
+
+	////////////////////////////////////////////////////////////////////////////
+	// FUTURES
+	////////////////////////////////////////////////////////////////////////////
+
+	namespace internal {
+
+		////////////////////////////////////////////////////////////////////////
+		// FutureValue METHODS
+		////////////////////////////////////////////////////////////////////////
+
+		template < class R >
+		inline FutureValue<R>::FutureValue() : _constructed(false)
+		{ }
+
+		template < class R >
+		inline FutureValue<R>::~FutureValue()
+		{
+			reset();
+		}
+
+		template < class R > template < class G >
+		inline void FutureValue<R>::emplace(G &g)
+		{
+			reset();
+			::new (&_storage) R(g());
+			_constructed = true;
+		}
+
+		template < class R >
+		inline R FutureValue<R>::take()
+		{
+			return std::move(*reinterpret_cast<R *>(&_storage));
+		}
+
+		template < class R >
+		inline const R & FutureValue<R>::value() const
+		{
+			return *reinterpret_cast<const R *>(&_storage);
+		}
+
+		template < class R >
+		inline void FutureValue<R>::reset()
+		{
+			if (_constructed) {
+				reinterpret_cast<R *>(&_storage)->~R();
+				_constructed = false;
+			}
+		}
+
+		template < class R >
+		inline bool FutureValue<R>::hasValue() const
+		{
+			return _constructed;
+		}
+
+		template < class G >
+		inline void FutureValue<void>::emplace(G &g)
+		{
+			g();
+		}
+
+		inline void FutureValue<void>::take()
+		{ }
+
+		////////////////////////////////////////////////////////////////////////
+
+
+
+		////////////////////////////////////////////////////////////////////////
+		// FutureState METHODS
+		////////////////////////////////////////////////////////////////////////
+
+		template < class R >
+		inline FutureState<R>::FutureState(MPMCThreadPool &pool) : _pool(&pool), _status(0)
+		{ }
+
+		template < class R >
+		inline MPMCThreadPool & FutureState<R>::pool() const
+		{
+			return *_pool;
+		}
+
+		template < class R > template < class G >
+		inline void FutureState<R>::run(G &g)
+		{
+			try {
+				_value.emplace(g);
+			} catch (...) {
+				_exception = std::current_exception();
+			}
+			complete();
+		}
+
+		template < class R >
+		inline void FutureState<R>::setException(std::exception_ptr e)
+		{
+			_exception = std::move(e);
+			complete();
+		}
+
+		template < class R >
+		inline bool FutureState<R>::ready() const
+		{
+			return (_status.load(std::memory_order_acquire) & READY) != 0;
+		}
+
+		template < class R >
+		inline void FutureState<R>::wait()
+		{
+			if (currentWorker() != nullptr) {
+				// a thread of a pool runs the pending tasks meanwhile
+				while (!ready())
+					if (!helpCurrentPool())
+						std::this_thread::yield();
+				return;
+			}
+			while (!ready()) {
+				const std::uint64_t key = _eventCount.prepareWait();
+				if (ready())
+					_eventCount.cancelWait();
+				else
+					_eventCount.commitWait(key);
+			}
+		}
+
+		template < class R >
+		inline std::exception_ptr FutureState<R>::exception() const
+		{
+			return _exception;
+		}
+
+		template < class R >
+		inline R FutureState<R>::take()
+		{
+			if (_exception)
+				std::rethrow_exception(_exception);
+			return _value.take();
+		}
+
+		template < class R >
+		inline void FutureState<R>::setContinuation(Task &&c)
+		{
+			_continuation = std::forward<Task>(c);
+			if (_status.fetch_or(CONTINUATION, std::memory_order_acq_rel) & READY) {
+				// too late to run it in the completing thread
+				Task continuation(std::move(_continuation));
+				resubmit(*_pool, std::move(continuation));
+			}
+		}
+
+		template < class R >
+		inline void FutureState<R>::complete()
+		{
+			const unsigned status = _status.fetch_or(READY, std::memory_order_acq_rel);
+			_eventCount.notifyAll();
+			if (status & CONTINUATION) {
+				// the continuation owns a reference to this state: moving it
+				// out breaks the cycle once it has run
+				Task continuation(std::move(_continuation));
+				continuation();
+			}
+		}
+
+		////////////////////////////////////////////////////////////////////////
+
+
+
+		////////////////////////////////////////////////////////////////////////
+		// FutureTask METHODS
+		////////////////////////////////////////////////////////////////////////
+
+		template < class R, class G >
+		inline FutureTask<R, G>::FutureTask(std::shared_ptr<FutureState<R>> state, G &&g) : _state(std::move(state)), _g(std::forward<G>(g))
+		{ }
+
+		template < class R, class G >
+		inline FutureTask<R, G>::~FutureTask()
+		{
+			if (_state)
+				_state->setException(std::make_exception_ptr(std::future_error(std::future_errc::broken_promise)));
+		}
+
+		template < class R, class G >
+		inline void FutureTask<R, G>::operator()()
+		{
+			std::shared_ptr<FutureState<R>> state(std::move(_state));
+			state->run(_g);
+		}
+
+		////////////////////////////////////////////////////////////////////////
+
+
+
+		////////////////////////////////////////////////////////////////////////
+		// Continuation METHODS
+		////////////////////////////////////////////////////////////////////////
+
+		template < class R, class F >
+		inline Continuation<R, F>::Continuation(std::shared_ptr<FutureState<R>> antecedent, std::shared_ptr<FutureState<Result>> next, F f) : _antecedent(std::move(antecedent)), _next(std::move(next)), _f(std::move(f))
+		{ }
+
+		template < class R, class F >
+		inline void Continuation<R, F>::operator()()
+		{
+			std::shared_ptr<FutureState<R>> antecedent(std::move(_antecedent));
+			if (std::exception_ptr e = antecedent->exception()) {
+				_next->setException(std::move(e));
+			} else {
+				auto call = [this, &antecedent]()->Result { return this->call(*antecedent); };
+				_next->run(call);
+			}
+		}
+
+		template < class R, class F > template < class S >
+		inline typename Continuation<R, F>::Result Continuation<R, F>::call(FutureState<S> &antecedent)
+		{
+			return _f(antecedent.take());
+		}
+
+		template < class R, class F >
+		inline typename Continuation<R, F>::Result Continuation<R, F>::call(FutureState<void> &antecedent)
+		{
+			antecedent.take();
+			return _f();
+		}
+
+		////////////////////////////////////////////////////////////////////////
+
+	}
+
+
+
+	////////////////////////////////////////////////////////////////////////////
+	// Future METHODS
+	////////////////////////////////////////////////////////////////////////////
+
+	template < class R >
+	inline Future<R>::Future(std::shared_ptr<internal::FutureState<R>> state) : _state(std::move(state))
+	{ }
+
+	template < class R >
+	inline bool Future<R>::valid() const
+	{
+		return static_cast<bool>(_state);
+	}
+
+	template < class R >
+	inline bool Future<R>::ready() const
+	{
+		return _state->ready();
+	}
+
+	template < class R >
+	inline void Future<R>::wait() const
+	{
+		_state->wait();
+	}
+
+	template < class R >
+	inline R Future<R>::get()
+	{
+		std::shared_ptr<internal::FutureState<R>> state(std::move(_state));
+		state->wait();
+		return state->take();
+	}
+
+	template < class R > template < class F >
+	inline Future<typename internal::ContinuationResult<R, typename std::decay<F>::type>::type> Future<R>::then(F &&f)
+	{
+		using C = internal::Continuation<R, typename std::decay<F>::type>;
+		std::shared_ptr<internal::FutureState<typename C::Result>> next = std::make_shared<internal::FutureState<typename C::Result>>(_state->pool());
+		std::shared_ptr<internal::FutureState<R>> state(std::move(_state));
+		state->setContinuation(C(state, next, std::forward<F>(f)));
+		return Future<typename C::Result>(std::move(next));
 	}
 
 	////////////////////////////////////////////////////////////////////////////
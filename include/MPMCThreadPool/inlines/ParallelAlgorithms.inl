@@ -0,0 +1,203 @@
+// Copyright (c) 2016 Giorgio Marcias
+//
+// This source code is subject to the simplified BSD license.
+//
+// Author: Giorgio Marcias
+// email: marcias.giorgio@gmail.com
+
+#include <MPMCThreadPool/ParallelAlgorithms.hpp>
+
+namespace mpmc_tp {
+
+	////////////////////////////////////////////////////////////////////////////
+	// INTERNAL STUFF
+	////////////////////////////////////////////////////////////////////////////
+
+	namespace internal {
+
+		////////////////////////////////////////////////////////////////////////
+		// ChunkLoop METHODS
+		////////////////////////////////////////////////////////////////////////
+
+		inline ChunkLoop::ChunkLoop(const std::size_t n, const std::size_t grain) : _n(n), _grain(grain), _nChunks((n + grain - 1) / grain), _next(0), _nDone(0), _failed(false)
+		{ }
+
+		inline std::size_t ChunkLoop::nChunks() const
+		{
+			return _nChunks;
+		}
+
+		template < class Body >
+		inline void ChunkLoop::run(Body &body)
+		{
+			for (;;) {
+				const std::size_t c = _next.fetch_add(1, std::memory_order_relaxed);
+				if (c >= _nChunks)
+					return;
+				if (!_failed.load(std::memory_order_relaxed)) {
+					try {
+						body(c, c * _grain, std::min(_n, (c + 1) * _grain));
+					} catch (...) {
+						if (!_failed.exchange(true, std::memory_order_relaxed))
+							_exception = std::current_exception();
+					}
+				}
+				if (_nDone.fetch_add(1, std::memory_order_acq_rel) + 1 == _nChunks)
+					_eventCount.notifyAll();
+			}
+		}
+
+		inline void ChunkLoop::wait()
+		{
+			while (_nDone.load(std::memory_order_acquire) < _nChunks) {
+				const std::uint64_t key = _eventCount.prepareWait();
+				if (_nDone.load(std::memory_order_acquire) < _nChunks)
+					_eventCount.commitWait(key);
+				else
+					_eventCount.cancelWait();
+			}
+			if (_exception)
+				std::rethrow_exception(_exception);
+		}
+
+		////////////////////////////////////////////////////////////////////////
+
+
+
+		////////////////////////////////////////////////////////////////////////
+		// ChunkHelper METHODS
+		////////////////////////////////////////////////////////////////////////
+
+		template < class Body >
+		inline ChunkHelper<Body>::ChunkHelper(const std::shared_ptr<ChunkLoop> &loop, Body &body) : _loop(loop), _body(&body)
+		{ }
+
+		template < class Body >
+		inline void ChunkHelper<Body>::operator()()
+		{
+			_loop->run(*_body);
+		}
+
+		////////////////////////////////////////////////////////////////////////
+
+
+
+		template < class Body >
+		inline std::size_t forEachChunk(MPMCThreadPool &pool, const std::size_t n, const std::size_t grain, Body &body)
+		{
+			if (n == 0)
+				return 0;
+			std::shared_ptr<ChunkLoop> loop = std::make_shared<ChunkLoop>(n, chunkGrain(pool, n, grain));
+			const std::size_t nHelpers = std::min(pool.size(), loop->nChunks() - 1);
+			if (nHelpers > 0) {
+				std::vector<Task> helpers;
+				helpers.reserve(nHelpers);
+				for (std::size_t i = 0; i < nHelpers; ++i)
+					helpers.emplace_back(ChunkHelper<Body>(loop, body));
+				pool.submitTasks(std::make_move_iterator(helpers.begin()), std::make_move_iterator(helpers.end()));
+			}
+			loop->run(body);
+			loop->wait();
+			return loop->nChunks();
+		}
+
+		inline std::size_t chunkGrain(MPMCThreadPool &pool, const std::size_t n, const std::size_t grain)
+		{
+			if (grain > 0)
+				return grain;
+			return std::max(n / (4 * (pool.size() + 1)), std::size_t(1));
+		}
+
+	}
+
+	////////////////////////////////////////////////////////////////////////////
+
+
+
+	////////////////////////////////////////////////////////////////////////////
+	// PARALLEL ALGORITHMS
+	////////////////////////////////////////////////////////////////////////////
+
+	template < class Index, class F >
+	inline void parallelFor(MPMCThreadPool &pool, Index first, Index last, const std::size_t grain, F &&f)
+	{
+		using Diff = decltype(last - first);
+		const std::size_t n = last > first ? static_cast<std::size_t>(last - first) : 0;
+		auto body = [&first, &f](std::size_t, std::size_t begin, std::size_t end) {
+			for (std::size_t i = begin; i < end; ++i)
+				f(first + static_cast<Diff>(i));
+		};
+		internal::forEachChunk(pool, n, grain, body);
+	}
+
+	template < class Index, class T, class F, class Op >
+	inline T parallelReduce(MPMCThreadPool &pool, Index first, Index last, const std::size_t grain, T identity, F &&f, Op &&op)
+	{
+		using Diff = decltype(last - first);
+		const std::size_t n = last > first ? static_cast<std::size_t>(last - first) : 0;
+		const std::size_t g = internal::chunkGrain(pool, n, grain);
+		std::vector<T> partials((n + g - 1) / g, identity);
+		auto body = [&first, &identity, &f, &op, &partials](std::size_t c, std::size_t begin, std::size_t end) {
+			T partial = identity;
+			for (std::size_t i = begin; i < end; ++i)
+				partial = op(std::move(partial), f(first + static_cast<Diff>(i)));
+			partials[c] = std::move(partial);
+		};
+		internal::forEachChunk(pool, n, g, body);
+		for (std::size_t c = 0; c < partials.size(); ++c)
+			identity = op(std::move(identity), std::move(partials[c]));
+		return identity;
+	}
+
+	template < class InputIt, class OutputIt, class F >
+	inline OutputIt parallelTransform(MPMCThreadPool &pool, InputIt first, InputIt last, OutputIt dFirst, const std::size_t grain, F &&f)
+	{
+		using Diff = typename std::iterator_traits<InputIt>::difference_type;
+		using DDiff = typename std::iterator_traits<OutputIt>::difference_type;
+		const std::size_t n = last > first ? static_cast<std::size_t>(last - first) : 0;
+		auto body = [&first, &dFirst, &f](std::size_t, std::size_t begin, std::size_t end) {
+			for (std::size_t i = begin; i < end; ++i)
+				*(dFirst + static_cast<DDiff>(i)) = f(*(first + static_cast<Diff>(i)));
+		};
+		internal::forEachChunk(pool, n, grain, body);
+		return dFirst + static_cast<DDiff>(n);
+	}
+
+	template < class InputIt, class OutputIt, class T, class Op >
+	inline OutputIt parallelScan(MPMCThreadPool &pool, InputIt first, InputIt last, OutputIt dFirst, const std::size_t grain, T identity, Op &&op)
+	{
+		using Diff = typename std::iterator_traits<InputIt>::difference_type;
+		using DDiff = typename std::iterator_traits<OutputIt>::difference_type;
+		const std::size_t n = last > first ? static_cast<std::size_t>(last - first) : 0;
+		const std::size_t g = internal::chunkGrain(pool, n, grain);
+		// first pass: reduce each chunk
+		std::vector<T> offsets((n + g - 1) / g, identity);
+		auto reduce = [&first, &identity, &op, &offsets](std::size_t c, std::size_t begin, std::size_t end) {
+			T partial = identity;
+			for (std::size_t i = begin; i < end; ++i)
+				partial = op(std::move(partial), *(first + static_cast<Diff>(i)));
+			offsets[c] = std::move(partial);
+		};
+		internal::forEachChunk(pool, n, g, reduce);
+		// turn the reductions into the offsets of the chunks
+		T offset = identity;
+		for (std::size_t c = 0; c < offsets.size(); ++c) {
+			T next = op(offset, offsets[c]);
+			offsets[c] = std::move(offset);
+			offset = std::move(next);
+		}
+		// second pass: scan each chunk from its offset
+		auto scan = [&first, &dFirst, &op, &offsets](std::size_t c, std::size_t begin, std::size_t end) {
+			T partial = offsets[c];
+			for (std::size_t i = begin; i < end; ++i) {
+				partial = op(std::move(partial), *(first + static_cast<Diff>(i)));
+				*(dFirst + static_cast<DDiff>(i)) = partial;
+			}
+		};
+		internal::forEachChunk(pool, n, g, scan);
+		return dFirst + static_cast<DDiff>(n);
+	}
+
+	////////////////////////////////////////////////////////////////////////////
+
+}
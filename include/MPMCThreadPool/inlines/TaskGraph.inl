@@ -0,0 +1,213 @@
+// Copyright (c) 2016 Giorgio Marcias
+//
+// This source code is subject to the simplified BSD license.
+//
+// Author: Giorgio Marcias
+// email: marcias.giorgio@gmail.com
+
+#include <MPMCThreadPool/TaskGraph.hpp>
+
+namespace mpmc_tp {
+
+	////////////////////////////////////////////////////////////////////////////
+	// INTERNAL STUFF
+	////////////////////////////////////////////////////////////////////////////
+
+	namespace internal {
+
+		////////////////////////////////////////////////////////////////////////
+		// GraphNodeTask METHODS
+		////////////////////////////////////////////////////////////////////////
+
+		inline GraphNodeTask::GraphNodeTask(TaskGraph &graph, const std::size_t node) : _graph(&graph), _node(node)
+		{ }
+
+		inline void GraphNodeTask::operator()()
+		{
+			_graph->runFrom(_node);
+		}
+
+		////////////////////////////////////////////////////////////////////////
+
+	}
+
+	////////////////////////////////////////////////////////////////////////////
+
+
+
+	////////////////////////////////////////////////////////////////////////////
+	// TaskGraph METHODS
+	////////////////////////////////////////////////////////////////////////////
+
+	inline TaskGraph::Node::Node(Task &&f) : function(std::move(f)), nPredecessors(0), nWaiting(0)
+	{ }
+
+	inline TaskGraph::TaskGraph() : _validated(false), _pool(nullptr), _nDone(0), _finished(true), _failed(false)
+	{ }
+
+	inline TaskGraph::~TaskGraph()
+	{
+		try {
+			wait();
+		} catch (...) {
+		}
+	}
+
+	template < class F, class ...Args >
+	inline std::size_t TaskGraph::addNode(F &&f, Args &&...args)
+	{
+		_nodes.emplace_back(Task(std::bind(std::forward<F>(f), std::forward<Args>(args)...)));
+		_validated = false;
+		return _nodes.size() - 1;
+	}
+
+	template < class F, class ...Args >
+	inline std::size_t TaskGraph::addNode(std::initializer_list<std::size_t> predecessors, F &&f, Args &&...args)
+	{
+		for (std::initializer_list<std::size_t>::const_iterator it = predecessors.begin(); it != predecessors.end(); ++it)
+			if (*it >= _nodes.size())
+				throw std::out_of_range("TaskGraph::addNode: invalid predecessor");
+		const std::size_t node = addNode(std::forward<F>(f), std::forward<Args>(args)...);
+		for (std::initializer_list<std::size_t>::const_iterator it = predecessors.begin(); it != predecessors.end(); ++it)
+			addDependency(node, *it);
+		return node;
+	}
+
+	inline void TaskGraph::addDependency(const std::size_t node, const std::size_t predecessor)
+	{
+		Node &n = _nodes.at(node);
+		_nodes.at(predecessor).successors.push_back(node);
+		++n.nPredecessors;
+		_validated = false;
+	}
+
+	inline std::size_t TaskGraph::size() const
+	{
+		return _nodes.size();
+	}
+
+	inline void TaskGraph::clear()
+	{
+		_nodes.clear();
+		_roots.clear();
+		_validated = false;
+	}
+
+	inline void TaskGraph::run(MPMCThreadPool &pool)
+	{
+		if (!done())
+			throw std::logic_error("TaskGraph::run: the graph is still running");
+		validate();
+		_pool = &pool;
+		_nDone.store(0, std::memory_order_relaxed);
+		_failed.store(false, std::memory_order_relaxed);
+		_exception = nullptr;
+		if (_nodes.empty())
+			return;
+		for (std::size_t i = 0; i < _nodes.size(); ++i)
+			_nodes[i].nWaiting.store(_nodes[i].nPredecessors, std::memory_order_relaxed);
+		_finished.store(false, std::memory_order_relaxed);
+		_rootTasks.clear();
+		for (std::size_t i = 0; i < _roots.size(); ++i)
+			_rootTasks.emplace_back(internal::GraphNodeTask(*this, _roots[i]));
+		pool.submitTasks(std::make_move_iterator(_rootTasks.begin()), std::make_move_iterator(_rootTasks.end()));
+	}
+
+	inline void TaskGraph::wait()
+	{
+		const bool helping = internal::currentWorker() != nullptr;
+		while (!_finished.load(std::memory_order_acquire)) {
+			if (helping) {
+				// a thread of a pool runs the pending tasks meanwhile
+				if (!internal::helpCurrentPool())
+					std::this_thread::yield();
+			} else if (_nDone.load(std::memory_order_acquire) < _nodes.size()) {
+				const std::uint64_t key = _eventCount.prepareWait();
+				if (_nDone.load(std::memory_order_acquire) < _nodes.size())
+					_eventCount.commitWait(key);
+				else
+					_eventCount.cancelWait();
+			} else {
+				// the last node is notifying: it is a matter of instants
+				std::this_thread::yield();
+			}
+		}
+		if (_exception)
+			std::rethrow_exception(_exception);
+	}
+
+	inline bool TaskGraph::done() const
+	{
+		return _finished.load(std::memory_order_acquire);
+	}
+
+	inline void TaskGraph::validate()
+	{
+		if (_validated)
+			return;
+		_roots.clear();
+		std::vector<std::size_t> nWaiting(_nodes.size());
+		std::vector<std::size_t> ready;
+		for (std::size_t i = 0; i < _nodes.size(); ++i) {
+			nWaiting[i] = _nodes[i].nPredecessors;
+			if (nWaiting[i] == 0) {
+				_roots.push_back(i);
+				ready.push_back(i);
+			}
+		}
+		std::size_t nVisited = 0;
+		while (!ready.empty()) {
+			const std::size_t node = ready.back();
+			ready.pop_back();
+			++nVisited;
+			const std::vector<std::size_t> &successors = _nodes[node].successors;
+			for (std::size_t i = 0; i < successors.size(); ++i)
+				if (--nWaiting[successors[i]] == 0)
+					ready.push_back(successors[i]);
+		}
+		if (nVisited < _nodes.size())
+			throw std::logic_error("TaskGraph::run: the graph has a cycle");
+		_rootTasks.reserve(_roots.size());
+		_validated = true;
+	}
+
+	inline void TaskGraph::runFrom(std::size_t node)
+	{
+		const std::size_t nNodes = _nodes.size();
+		for (;;) {
+			Node &n = _nodes[node];
+			if (!_failed.load(std::memory_order_relaxed)) {
+				try {
+					n.function();
+				} catch (...) {
+					if (!_failed.exchange(true, std::memory_order_relaxed))
+						_exception = std::current_exception();
+				}
+			}
+			// release the successors: run the first ready one in this thread,
+			// submit the others
+			std::size_t next = nNodes;
+			for (std::size_t i = 0; i < n.successors.size(); ++i) {
+				const std::size_t successor = n.successors[i];
+				if (_nodes[successor].nWaiting.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+					if (next == nNodes)
+						next = successor;
+					else
+						internal::resubmit(*_pool, internal::GraphNodeTask(*this, successor));
+				}
+			}
+			if (_nDone.fetch_add(1, std::memory_order_acq_rel) + 1 == nNodes) {
+				_eventCount.notifyAll();
+				// the graph may be destroyed from now on
+				_finished.store(true, std::memory_order_release);
+				return;
+			}
+			if (next == nNodes)
+				return;
+			node = next;
+		}
+	}
+
+	////////////////////////////////////////////////////////////////////////////
+
+}